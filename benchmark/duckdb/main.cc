@@ -1,3 +1,4 @@
+#include <fstream>
 #include <iostream>
 #include <memory>
 
@@ -17,7 +18,9 @@ cxxopts::ParseResult ParseCommandLine(int argc, const char *argv[]) {
       .set_tab_expansion()
       .allow_unrecognised_options()
       .add_options()("q,query-num", "The query number you want to execute",
-                     cxxopts::value<int>())("h,help", "Print help")(
+                     cxxopts::value<int>())(
+          "queries", "Comma-separated query numbers (default: all)",
+          cxxopts::value<std::string>())("h,help", "Print help")(
           "policy-path", "The path to the policy file",
           cxxopts::value<std::string>())("data-path",
                                          "The path to the data file",
@@ -25,7 +28,25 @@ cxxopts::ParseResult ParseCommandLine(int argc, const char *argv[]) {
           "enable-profiling", "Whether to enable profing on the Picachv side",
           cxxopts::value<bool>()->default_value("false"))(
           "t,thread-num", "The number of availble threads to use (0 = use all)",
-          cxxopts::value<uint32_t>()->default_value("0"));
+          cxxopts::value<uint32_t>()->default_value("0"))(
+          "r,repeat", "The number of timed runs of each query",
+          cxxopts::value<uint32_t>()->default_value("1"))(
+          "warmup", "The number of untimed runs before the timed ones",
+          cxxopts::value<uint32_t>()->default_value("0"))(
+          "no-baseline", "Do not also run the queries without policy checking",
+          cxxopts::value<bool>()->default_value("false"))(
+          "explain", "Print the plan of each query",
+          cxxopts::value<bool>()->default_value("false"))(
+          "print-result", "Print the result of each query after timing it",
+          cxxopts::value<bool>()->default_value("false"))(
+          "format", "The format of the statistics (csv or json)",
+          cxxopts::value<std::string>()->default_value("csv"))(
+          "o,output", "The file to write the statistics to (default: stdout)",
+          cxxopts::value<std::string>())(
+          "clients",
+          "Comma-separated numbers of concurrent clients to measure the "
+          "throughput with, each with a connection and context of its own",
+          cxxopts::value<std::string>());
 
   return options.parse(argc, argv);
 }
@@ -33,6 +54,24 @@ cxxopts::ParseResult ParseCommandLine(int argc, const char *argv[]) {
 int main(int argc, const char *argv[]) {
   auto options = ParseCommandLine(argc, argv);
 
+  const std::string format = options["format"].as<std::string>();
+  if (format != "csv" && format != "json") {
+    std::cerr << "Unknown format: " << format << std::endl;
+    return 1;
+  }
+
+  // Open the output first so that a bad path does not waste a run.
+  std::ofstream file;
+  if (options.count("output")) {
+    const std::string path = options["output"].as<std::string>();
+    file.open(path);
+    if (!file.is_open()) {
+      std::cerr << "Failed to open the output file: " << path << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &output = options.count("output") ? file : std::cout;
+
   // Set up the query factory.
   DuckDB db(nullptr);
   auto con = std::make_unique<duckdb::Connection>(db);
@@ -43,15 +82,31 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
 
-  // Execute the query.
-  QueryStat stat = factory->ExecuteQuery();
-  if (!stat.success) {
-    std::cerr << "Query failed to execute!" << std::endl;
-    return 1;
+  if (factory->Concurrent()) {
+    // Measure the throughput of the query mix.
+    std::vector<ThroughputStat> stats = factory->ExecuteConcurrently(db);
+    WriteThroughput(output, stats, format);
+
+    for (const auto &stat : stats) {
+      if (stat.failed > 0) {
+        std::cerr << "Some queries failed to execute!" << std::endl;
+        return 1;
+      }
+    }
+
+    return stats.empty() ? 1 : 0;
   }
 
-  std::cout << "Query executed successfully! Time cost: " << stat.time.count()
-            << " seconds." << std::endl;
+  // Execute the queries.
+  std::vector<QueryStat> stats = factory->ExecuteQueries();
+  WriteStats(output, stats, format);
+
+  for (const auto &stat : stats) {
+    if (!stat.success) {
+      std::cerr << "Some queries failed to execute!" << std::endl;
+      return 1;
+    }
+  }
 
   return 0;
 }
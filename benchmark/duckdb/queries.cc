@@ -1,33 +1,336 @@
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <sstream>
+#include <thread>
 
 #include "picachv_interfaces.h"
 #include "queries.h"
 
-QueryStat QueryFactory::ExecuteQueryInternal(const std::string &query) {
-  bool prev = con_->PolicyCheckingEnabled();
-  if (prev) {
-    con_->DisablePolicyChecking();
+namespace {
+
+// The queries run when none is given; Q15 defines a view and is not supported.
+const std::vector<int> kAllQueries = {1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11,
+                                      12, 13, 14, 16, 17, 18, 19, 20, 21, 22};
+
+// Parses a comma-separated list of numbers.
+std::vector<int> ParseList(const std::string &list) {
+  std::vector<int> queries;
+  std::stringstream ss(list);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      queries.push_back(std::stoi(item));
+    }
   }
-  auto desc = con_->Query("EXPLAIN(" + query + ")");
-  desc->Print();
-  if (prev) {
-    con_->EnablePolicyChecking();
+
+  return queries;
+}
+
+// Writes a CSV field that is left empty if there is no value.
+void WriteField(std::ostream &os, const std::optional<double> &value) {
+  if (value.has_value()) {
+    os << value.value();
+  }
+}
+
+// A value read by `ReadJson`, or none if it was missing.
+std::optional<double> Present(double value) {
+  if (std::isnan(value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void WriteJsonField(std::ostream &os, const std::optional<double> &value) {
+  if (value.has_value()) {
+    os << value.value();
+  } else {
+    os << "null";
+  }
+}
+
+void WriteJsonRuns(std::ostream &os, const std::vector<Duration> &runs) {
+  if (runs.empty()) {
+    os << "null";
+    return;
+  }
+
+  os << "{\"min_ms\": ";
+  WriteJsonField(os, Percentile(runs, 0.0));
+  os << ", \"median_ms\": ";
+  WriteJsonField(os, Percentile(runs, 0.5));
+  os << ", \"p95_ms\": ";
+  WriteJsonField(os, Percentile(runs, 0.95));
+  os << ", \"p99_ms\": ";
+  WriteJsonField(os, Percentile(runs, 0.99));
+  os << ", \"runs_ms\": [";
+  for (size_t i = 0; i < runs.size(); i++) {
+    os << (i ? ", " : "")
+       << std::chrono::duration<double, std::milli>(runs[i]).count();
+  }
+  os << "]}";
+}
+
+// Reads the unsigned integers under `keys` from the flat JSON object that
+// `get` copies, scaled by `scale`. A key that is missing or null is NaN.
+template <size_t N>
+std::optional<std::array<double, N>>
+ReadJson(ErrorCode (*get)(uint8_t *, size_t *), const std::string (&keys)[N],
+         double scale) {
+  std::string json(1024, '\0');
+  size_t len = json.size();
+
+  ErrorCode err = get(reinterpret_cast<uint8_t *>(json.data()), &len);
+  if (err != ErrorCode::Success) {
+    std::cerr << "Failed to read the statistics from Picachv: " << err
+              << std::endl;
+    return std::nullopt;
+  }
+  json.resize(len);
+
+  std::array<double, N> values;
+  values.fill(std::nan(""));
+  for (size_t i = 0; i < N; i++) {
+    const std::string key = "\"" + keys[i] + "\":";
+    size_t pos = json.find(key);
+    if (pos != std::string::npos && std::isdigit(json[pos + key.size()])) {
+      values[i] = std::stoull(json.substr(pos + key.size())) * scale;
+    }
   }
 
-  auto start = std::chrono::high_resolution_clock::now();
-  auto result = con_->Query(query);
-  auto end = std::chrono::high_resolution_clock::now();
-  result->Print();
+  return values;
+}
 
-  if (result->HasError()) {
-    std::cerr << "Query failed:\n\t";
+// Writes the values under `keys` as a JSON object, or null if there are none.
+template <size_t N>
+void WriteJsonObject(std::ostream &os, const std::string (&keys)[N],
+                     const std::optional<std::array<double, N>> &values) {
+  if (!values.has_value()) {
+    os << "null";
+    return;
+  }
+
+  for (size_t i = 0; i < N; i++) {
+    os << (i ? ", " : "{") << "\"" << keys[i] << "\": ";
+    WriteJsonField(os, Present(values.value()[i]));
+  }
+  os << "}";
+}
+
+} // namespace
+
+std::optional<double> Percentile(std::vector<Duration> runs, double p) {
+  if (runs.empty()) {
+    return std::nullopt;
+  }
+
+  // Nearest rank, so that the minimum is p = 0 and the median of an even number
+  // of runs is the lower one.
+  std::sort(runs.begin(), runs.end());
+  size_t rank = static_cast<size_t>(std::ceil(p * runs.size()));
+  rank = std::clamp<size_t>(rank, 1, runs.size());
+
+  return std::chrono::duration<double, std::milli>(runs[rank - 1]).count();
+}
+
+std::optional<double> QueryStat::Ratio() const {
+  auto picachv_ms = Percentile(picachv, 0.5);
+  auto baseline_ms = Percentile(baseline, 0.5);
+
+  if (!picachv_ms.has_value() || !baseline_ms.has_value() ||
+      baseline_ms.value() == 0) {
+    return std::nullopt;
+  }
+
+  return picachv_ms.value() / baseline_ms.value();
+}
+
+void WriteStats(std::ostream &os, const std::vector<QueryStat> &stats,
+                const std::string &format) {
+  os << std::fixed << std::setprecision(3);
+
+  if (format == "json") {
+    os << "[\n";
+    for (size_t i = 0; i < stats.size(); i++) {
+      const auto &stat = stats[i];
+      os << "  {\"query\": \"Q" << stat.query_num
+         << "\", \"success\": " << (stat.success ? "true" : "false")
+         << ", \"baseline\": ";
+      WriteJsonRuns(os, stat.baseline);
+      os << ", \"picachv\": ";
+      WriteJsonRuns(os, stat.picachv);
+      os << ", \"ratio\": ";
+      WriteJsonField(os, stat.Ratio());
+      os << ", \"phases_ms\": ";
+      WriteJsonObject(os, kPhaseNames, stat.phases);
+      os << ", \"memory_mb\": ";
+      WriteJsonObject(os, kMemoryNames, stat.memory);
+      os << "}" << (i + 1 < stats.size() ? "," : "") << "\n";
+    }
+    os << "]" << std::endl;
+    return;
+  }
+
+  // The query labels match the `xs` used by the notebooks in `tools/plotting`.
+  os << "query,success,runs,baseline_min_ms,baseline_median_ms,baseline_p95_"
+        "ms,baseline_p99_ms,picachv_min_ms,picachv_median_ms,picachv_p95_ms,"
+        "picachv_p99_ms,ratio";
+  for (const auto &phase : kPhaseNames) {
+    os << "," << phase << "_ms";
+  }
+  for (const auto &memory : kMemoryNames) {
+    os << "," << memory << "_mb";
+  }
+  os << "\n";
+  for (const auto &stat : stats) {
+    os << "Q" << stat.query_num << "," << stat.success << ","
+       << std::max(stat.baseline.size(), stat.picachv.size());
+    for (const auto *runs : {&stat.baseline, &stat.picachv}) {
+      for (double p : {0.0, 0.5, 0.95, 0.99}) {
+        os << ",";
+        WriteField(os, Percentile(*runs, p));
+      }
+    }
+    os << ",";
+    WriteField(os, stat.Ratio());
+    for (int i = 0; i < kPhaseNum; i++) {
+      os << ",";
+      if (stat.phases.has_value()) {
+        os << stat.phases.value()[i];
+      }
+    }
+    for (int i = 0; i < kMemoryNum; i++) {
+      os << ",";
+      if (stat.memory.has_value()) {
+        WriteField(os, Present(stat.memory.value()[i]));
+      }
+    }
+    os << "\n";
+  }
+  os.flush();
+}
+
+double ThroughputStat::QueriesPerSecond() const {
+  return wall.count() > 0 ? queries / wall.count() : 0;
+}
+
+void WriteThroughput(std::ostream &os, const std::vector<ThroughputStat> &stats,
+                     const std::string &format) {
+  os << std::fixed << std::setprecision(3);
+
+  if (format == "json") {
+    os << "[\n";
+    for (size_t i = 0; i < stats.size(); i++) {
+      const auto &stat = stats[i];
+      os << "  {\"clients\": " << stat.clients
+         << ", \"queries\": " << stat.queries
+         << ", \"failed\": " << stat.failed
+         << ", \"wall_s\": " << stat.wall.count()
+         << ", \"qps\": " << stat.QueriesPerSecond() << ", \"p50_ms\": ";
+      WriteJsonField(os, Percentile(stat.latencies, 0.5));
+      os << ", \"p95_ms\": ";
+      WriteJsonField(os, Percentile(stat.latencies, 0.95));
+      os << ", \"p99_ms\": ";
+      WriteJsonField(os, Percentile(stat.latencies, 0.99));
+      os << ", \"max_ms\": ";
+      WriteJsonField(os, Percentile(stat.latencies, 1.0));
+      os << "}" << (i + 1 < stats.size() ? "," : "") << "\n";
+    }
+    os << "]" << std::endl;
+    return;
+  }
+
+  os << "clients,queries,failed,wall_s,qps,p50_ms,p95_ms,p99_ms,max_ms\n";
+  for (const auto &stat : stats) {
+    os << stat.clients << "," << stat.queries << "," << stat.failed << ","
+       << stat.wall.count() << "," << stat.QueriesPerSecond();
+    for (double p : {0.5, 0.95, 0.99, 1.0}) {
+      os << ",";
+      WriteField(os, Percentile(stat.latencies, p));
+    }
+    os << "\n";
+  }
+  os.flush();
+}
+
+bool QueryFactory::Measure(const std::string &query,
+                           std::vector<Duration> &runs,
+                           std::optional<Phases> *phases) {
+  std::unique_ptr<duckdb::MaterializedQueryResult> result;
+
+  for (uint32_t i = 0; i < warmup_ + repeat_; i++) {
+    // Only the timed runs are profiled.
+    if (phases && i == warmup_) {
+      reset_profiles();
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    result = con_->Query(query);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if (result->HasError()) {
+      std::cerr << "Query failed:\n\t" << result->GetError() << std::endl;
+      return false;
+    }
+
+    if (i >= warmup_) {
+      runs.push_back(end - start);
+    }
+  }
+
+  if (phases) {
+    *phases = ReadJson(get_profile_phases, kPhaseNames, 1e-6);
+    if (phases->has_value()) {
+      for (double &ms : phases->value()) {
+        ms /= repeat_;
+      }
+    }
+  }
+
+  // Printing is kept out of the timed region.
+  if (print_result_ && result) {
     result->Print();
-    return QueryStat{.success = false, .time = end - start};
   }
 
-  return QueryStat{.success = true, .time = end - start};
+  return true;
+}
+
+QueryStat QueryFactory::ExecuteQueryInternal(int query_num,
+                                             const std::string &query) {
+  QueryStat stat{.query_num = query_num, .success = true};
+  bool policy = con_->PolicyCheckingEnabled();
+
+  if (policy) {
+    con_->DisablePolicyChecking();
+  }
+
+  if (explain_) {
+    auto desc = con_->Query("EXPLAIN(" + query + ")");
+    desc->Print();
+  }
+
+  // The policies are registered once in `Setup`, so toggling the policy
+  // checking is all it takes to measure the same query without Picachv.
+  if (!policy || baseline_) {
+    stat.success = Measure(query, stat.baseline, nullptr);
+  }
+
+  if (policy) {
+    con_->EnablePolicyChecking();
+    stat.success =
+        stat.success &&
+        Measure(query, stat.picachv, enable_profiling_ ? &stat.phases : nullptr);
+  }
+
+  return stat;
 }
 
 QueryFactory::QueryFactory(cxxopts::ParseResult &options) {
@@ -38,20 +341,42 @@ QueryFactory::QueryFactory(cxxopts::ParseResult &options) {
     policy_path_ = std::nullopt;
   }
 
-  if (!options.count("query-num")) {
-    std::cerr << "Please specify the query number!" << std::endl;
+  if (!options.count("data-path")) {
+    std::cerr << "Please specify the data path!" << std::endl;
     exit(1);
   }
 
-  if (!options.count("data-path")) {
-    std::cerr << "Please specify the data path!" << std::endl;
+  if (options.count("queries")) {
+    queries_ = ParseList(options["queries"].as<std::string>());
+  } else if (options.count("query-num")) {
+    queries_ = {options["query-num"].as<int>()};
+  } else {
+    queries_ = kAllQueries;
+  }
+
+  if (queries_.empty()) {
+    std::cerr << "Please specify at least one query!" << std::endl;
     exit(1);
   }
 
   data_path_ = options["data-path"].as<std::string>();
   enable_profiling_ = options["enable-profiling"].as<bool>();
-  query_num_ = options["query-num"].as<int>();
   thread_num_ = options["thread-num"].as<uint32_t>();
+  repeat_ = std::max<uint32_t>(options["repeat"].as<uint32_t>(), 1);
+  warmup_ = options["warmup"].as<uint32_t>();
+  explain_ = options["explain"].as<bool>();
+  print_result_ = options["print-result"].as<bool>();
+  baseline_ = !options["no-baseline"].as<bool>();
+
+  if (options.count("clients")) {
+    for (int clients : ParseList(options["clients"].as<std::string>())) {
+      if (clients <= 0) {
+        std::cerr << "The number of clients must be positive!" << std::endl;
+        exit(1);
+      }
+      clients_.push_back(clients);
+    }
+  }
 }
 
 bool QueryFactory::PrepareTable(const std::string &table_name) {
@@ -72,103 +397,252 @@ bool QueryFactory::Setup(std::unique_ptr<duckdb::Connection> con) {
   con_ = std::move(con);
 
   if (thread_num_ > 0) {
-    std::cout << "Setting the number of threads to " << thread_num_
+    std::cerr << "Setting the number of threads to " << thread_num_
               << std::endl;
     con_->Query("SET threads TO " + std::to_string(thread_num_));
   }
 
+  return SetupContext(*con_);
+}
+
+bool QueryFactory::SetupContext(duckdb::Connection &con) {
   if (policy_path_.has_value()) {
     // Set up the context.
-    ErrorCode err = con_->InitializeCtx();
+    ErrorCode err = con.InitializeCtx();
     if (err != ErrorCode::Success) {
       std::cerr << "Failed to initialize the context: " << err << std::endl;
       return false;
     }
 
-    con_->EnablePolicyChecking();
+    con.EnablePolicyChecking();
 
     if (enable_profiling_) {
-      con_->EnableProfiling();
-      con_->EnablePicachvProfiling();
+      con.EnableProfiling();
+      con.EnablePicachvProfiling();
     }
 
     // Register policies.
+    auto start = std::chrono::high_resolution_clock::now();
     for (size_t i = 0; i < kTableNum; i++) {
       const std::string table_path =
           data_path_ + "/" + kTableNames[i] + ".parquet";
       const std::string policy_path =
           policy_path_.value() + kTableNames[i] + ".parquet.policy.parquet";
 
-      std::cout << "table_path: " << table_path << std::endl;
-      std::cout << "policy_path: " << policy_path << std::endl;
+      std::cerr << "table_path: " << table_path << std::endl;
+      std::cerr << "policy_path: " << policy_path << std::endl;
 
-      err = con_->RegisterPolicyParquet(table_path, policy_path);
+      err = con.RegisterPolicyParquet(table_path, policy_path);
       if (err != ErrorCode::Success) {
         std::cerr << "Failed to register the policy: " << err << std::endl;
         return false;
       }
     }
+    register_time_ = std::chrono::high_resolution_clock::now() - start;
+
+    std::cerr << "Registered the policies in "
+              << std::chrono::duration<double, std::milli>(register_time_)
+                     .count()
+              << " ms" << std::endl;
   }
 
   return true;
 }
 
-QueryStat QueryFactory::ExecuteQuery() {
-  switch (query_num_) {
+std::optional<std::string> QueryFactory::QueryString(int query_num) const {
+  switch (query_num) {
   case 1:
-    return ExecuteQuery1();
+    return Query1();
   case 2:
-    return ExecuteQuery2();
+    return Query2();
   case 3:
-    return ExecuteQuery3();
+    return Query3();
   case 4:
-    return ExecuteQuery4();
+    return Query4();
   case 5:
-    return ExecuteQuery5();
+    return Query5();
   case 6:
-    return ExecuteQuery6();
+    return Query6();
   case 7:
-    return ExecuteQuery7();
+    return Query7();
   case 8:
-    return ExecuteQuery8();
+    return Query8();
   case 9:
-    return ExecuteQuery9();
+    return Query9();
   case 10:
-    return ExecuteQuery10();
+    return Query10();
   case 11:
-    return ExecuteQuery11();
+    return Query11();
   case 12:
-    return ExecuteQuery12();
+    return Query12();
   case 13:
-    return ExecuteQuery13();
+    return Query13();
   case 14:
-    return ExecuteQuery14();
+    return Query14();
   case 16:
-    return ExecuteQuery16();
+    return Query16();
   case 17:
-    return ExecuteQuery17();
+    return Query17();
   case 18:
-    return ExecuteQuery18();
+    return Query18();
   case 19:
-    return ExecuteQuery19();
+    return Query19();
   case 20:
-    return ExecuteQuery20();
+    return Query20();
+  case 21:
+    return Query21();
+  case 22:
+    return Query22();
   default:
-    std::cerr << "no such query: " << query_num_ << std::endl;
-    return QueryStat{.success = false,
-                     .time = std::chrono::duration<double>(0)};
+    return std::nullopt;
   }
 }
 
-QueryStat QueryFactory::ExecuteQuery1() {
-  const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
+std::vector<QueryStat> QueryFactory::ExecuteQueries() {
+  std::vector<QueryStat> stats;
+
+  for (int query_num : queries_) {
+    auto query = QueryString(query_num);
+    if (!query.has_value()) {
+      std::cerr << "no such query: " << query_num << std::endl;
+      stats.push_back(QueryStat{.query_num = query_num, .success = false});
+      continue;
+    }
 
-  if (!PrepareTable(kTableNames[0])) {
-    std::cerr << "Failed to prepare the table: " << kTableNames[0] << std::endl;
-    return QueryStat{.success = false,
-                     .time = std::chrono::duration<double>(0)};
+    stats.push_back(ExecuteQueryInternal(query_num, query.value()));
+    stats.back().memory =
+        ReadJson(get_memory_stats, kMemoryNames, 1.0 / (1 << 20));
+
+    const auto &stat = stats.back();
+    std::cerr << "Q" << query_num << ": "
+              << (stat.success ? "finished" : "failed");
+    if (auto ms = Percentile(stat.baseline, 0.5)) {
+      std::cerr << ", baseline median " << ms.value() << " ms";
+    }
+    if (auto ms = Percentile(stat.picachv, 0.5)) {
+      std::cerr << ", picachv median " << ms.value() << " ms";
+    }
+    if (auto ratio = stat.Ratio()) {
+      std::cerr << ", ratio " << ratio.value();
+    }
+    if (stat.phases.has_value()) {
+      for (int i = 0; i < kPhaseNum; i++) {
+        std::cerr << (i ? ", " : " (") << kPhaseNames[i] << " "
+                  << stat.phases.value()[i] << " ms";
+      }
+      std::cerr << ")";
+    }
+    std::cerr << std::endl;
   }
 
+  return stats;
+}
+
+std::vector<ThroughputStat>
+QueryFactory::ExecuteConcurrently(duckdb::DuckDB &db) {
+  std::vector<std::string> queries;
+  for (int query_num : queries_) {
+    auto query = QueryString(query_num);
+    if (!query.has_value()) {
+      std::cerr << "no such query: " << query_num << std::endl;
+      return {};
+    }
+    queries.push_back(query.value());
+  }
+
+  std::vector<ThroughputStat> stats;
+  for (uint32_t clients : clients_) {
+    // Connections are kept across the rounds so that the policies of each
+    // context are only registered once.
+    while (client_cons_.size() + 1 < clients) {
+      auto con = std::make_unique<duckdb::Connection>(db);
+      if (!SetupContext(*con)) {
+        return stats;
+      }
+      client_cons_.push_back(std::move(con));
+    }
+
+    std::vector<std::vector<Duration>> latencies(clients);
+    std::vector<uint64_t> failed(clients, 0);
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t ready = 0;
+    bool go = false;
+
+    auto client = [&](uint32_t id) {
+      auto &con = id == 0 ? *con_ : *client_cons_[id - 1];
+      auto run = [&](size_t k) {
+        // Each client starts at a different query so that the mix is spread
+        // over the clients.
+        auto start = std::chrono::high_resolution_clock::now();
+        auto result = con.Query(queries[(id + k) % queries.size()]);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (result->HasError()) {
+          failed[id]++;
+        }
+        return end - start;
+      };
+
+      for (uint32_t i = 0; i < warmup_ * queries.size(); i++) {
+        run(i);
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready++;
+        cv.notify_all();
+        cv.wait(lock, [&] { return go; });
+      }
+
+      for (uint32_t i = 0; i < repeat_ * queries.size(); i++) {
+        latencies[id].push_back(run(i));
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t id = 0; id < clients; id++) {
+      threads.emplace_back(client, id);
+    }
+
+    std::chrono::high_resolution_clock::time_point start;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return ready == clients; });
+      go = true;
+      start = std::chrono::high_resolution_clock::now();
+      cv.notify_all();
+    }
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    ThroughputStat stat{.clients = clients,
+                        .queries = 0,
+                        .failed = 0,
+                        .wall = std::chrono::high_resolution_clock::now() -
+                                start};
+    for (uint32_t id = 0; id < clients; id++) {
+      stat.queries += latencies[id].size();
+      stat.failed += failed[id];
+      stat.latencies.insert(stat.latencies.end(), latencies[id].begin(),
+                            latencies[id].end());
+    }
+
+    std::cerr << clients << " clients: " << stat.QueriesPerSecond()
+              << " queries/s, p99 " << Percentile(stat.latencies, 0.99).value()
+              << " ms, " << stat.failed << " failed" << std::endl;
+
+    stats.push_back(std::move(stat));
+  }
+
+  return stats;
+}
+
+std::string QueryFactory::Query1() const {
+  const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
+
   // Query 1
   std::string query =
       "SELECT l_returnflag, l_linestatus, "
@@ -187,31 +661,10 @@ QueryStat QueryFactory::ExecuteQuery1() {
       "GROUP BY l_returnflag, l_linestatus "
       "ORDER BY l_returnflag, l_linestatus";
 
-  bool prev = con_->PolicyCheckingEnabled();
-  if (prev) {
-    con_->DisablePolicyChecking();
-  }
-  auto desc = con_->Query("EXPLAIN(" + query + ")");
-  desc->Print();
-  if (prev) {
-    con_->EnablePolicyChecking();
-  }
-
-  auto start = std::chrono::high_resolution_clock::now();
-  auto result = con_->Query(query);
-  auto end = std::chrono::high_resolution_clock::now();
-  result->Print();
-
-  if (result->HasError()) {
-    std::cerr << "Query 1 failed:\n\t";
-    result->Print();
-    return QueryStat{.success = false, .time = end - start};
-  }
-
-  return QueryStat{.success = true, .time = end - start};
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery2() {
+std::string QueryFactory::Query2() const {
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
   const std::string partsupp = data_path_ + "/" + kTableNames[5] + ".parquet";
@@ -248,10 +701,10 @@ QueryStat QueryFactory::ExecuteQuery2() {
                       "order by s_acctbal desc, n_name, s_name, p_partkey "
                       "limit 100";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery3() {
+std::string QueryFactory::Query3() const {
   const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
@@ -271,10 +724,10 @@ QueryStat QueryFactory::ExecuteQuery3() {
       "ORDER BY revenue desc, o_orderdate "
       "LIMIT 10";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery4() {
+std::string QueryFactory::Query4() const {
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
 
@@ -296,10 +749,10 @@ QueryStat QueryFactory::ExecuteQuery4() {
                       "group by o_orderpriority "
                       "order by o_orderpriority";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery5() {
+std::string QueryFactory::Query5() const {
   const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
@@ -326,10 +779,10 @@ QueryStat QueryFactory::ExecuteQuery5() {
       "order by revenue desc";
   ;
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery6() {
+std::string QueryFactory::Query6() const {
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
 
   std::string query = "select sum(l_extendedprice * l_discount) as revenue "
@@ -341,10 +794,10 @@ QueryStat QueryFactory::ExecuteQuery6() {
                       "and l_discount between 0.06 - 0.01 and 0.06 + 0.01 "
                       "and l_quantity < 24";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery7() {
+std::string QueryFactory::Query7() const {
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
@@ -377,11 +830,11 @@ QueryStat QueryFactory::ExecuteQuery7() {
       "group by supp_nation, cust_nation, l_year "
       "order by supp_nation, cust_nation, l_year";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // PASSED.
-QueryStat QueryFactory::ExecuteQuery8() {
+std::string QueryFactory::Query8() const {
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
@@ -419,10 +872,10 @@ QueryStat QueryFactory::ExecuteQuery8() {
                       "group by o_year "
                       "order by o_year";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery9() {
+std::string QueryFactory::Query9() const {
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
@@ -453,10 +906,10 @@ QueryStat QueryFactory::ExecuteQuery9() {
                       "group by nation, o_year "
                       "order by nation, o_year desc";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery10() {
+std::string QueryFactory::Query10() const {
   const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
@@ -478,11 +931,11 @@ QueryStat QueryFactory::ExecuteQuery10() {
       "c_comment "
       "order by revenue desc";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // FIXME: Stuck.
-QueryStat QueryFactory::ExecuteQuery11() {
+std::string QueryFactory::Query11() const {
   const std::string partsupp = data_path_ + "/" + kTableNames[5] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
   const std::string nation = data_path_ + "/" + kTableNames[6] + ".parquet";
@@ -509,11 +962,11 @@ QueryStat QueryFactory::ExecuteQuery11() {
       ") "
       "order by value desc";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // PASSED
-QueryStat QueryFactory::ExecuteQuery12() {
+std::string QueryFactory::Query12() const {
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
 
@@ -540,10 +993,10 @@ QueryStat QueryFactory::ExecuteQuery12() {
       "group by l_shipmode "
       "order by l_shipmode";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
-QueryStat QueryFactory::ExecuteQuery13() {
+std::string QueryFactory::Query13() const {
   const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
 
@@ -551,21 +1004,20 @@ QueryStat QueryFactory::ExecuteQuery13() {
                       "from ( "
                       "select c_custkey, count(o_orderkey) as c_count "
                       "from '" +
-                      customer + "', '" + orders +
-                      "' " // due to technical limitation we don't use outer
-                           // join here; but can be implemented.
-                      "where c_custkey = o_custkey "
+                      customer + "' left outer join '" + orders +
+                      "' "
+                      "on c_custkey = o_custkey "
                       "and o_comment not like '%special%requests%' "
                       "group by c_custkey "
                       ") as c_orders (c_custkey, c_count)"
                       "group by c_count "
                       "order by custdist desc, c_count desc";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // CASE WHEN.
-QueryStat QueryFactory::ExecuteQuery14() {
+std::string QueryFactory::Query14() const {
   const std::string linitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
 
@@ -582,11 +1034,11 @@ QueryStat QueryFactory::ExecuteQuery14() {
       "and l_shipdate >= '1995-09-01' "
       "and l_shipdate < '1995-10-01'";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // FIXME: Many bugs.
-QueryStat QueryFactory::ExecuteQuery16() {
+std::string QueryFactory::Query16() const {
   const std::string partsupp = data_path_ + "/" + kTableNames[5] + ".parquet";
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
@@ -612,11 +1064,11 @@ QueryStat QueryFactory::ExecuteQuery16() {
       "group by p_brand, p_type, p_size ";
   // "order by supplier_cnt desc, p_brand, p_type, p_size";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // TODO: RIGHT_DELIM_JOIN. WTF is this.
-QueryStat QueryFactory::ExecuteQuery17() {
+std::string QueryFactory::Query17() const {
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
 
@@ -636,11 +1088,11 @@ QueryStat QueryFactory::ExecuteQuery17() {
                       "and l_quantity < (" +
                       sub_query + ")";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // PASSED
-QueryStat QueryFactory::ExecuteQuery18() {
+std::string QueryFactory::Query18() const {
   const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
@@ -668,11 +1120,11 @@ QueryStat QueryFactory::ExecuteQuery18() {
                       "order by o_totalprice desc, o_orderdate "
                       "limit 100";
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // PASSED
-QueryStat QueryFactory::ExecuteQuery19() {
+std::string QueryFactory::Query19() const {
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
 
@@ -710,11 +1162,11 @@ QueryStat QueryFactory::ExecuteQuery19() {
                       "and l_shipinstruct = 'DELIVER IN PERSON' "
                       ") GROUP BY NULL"; /* A trick to bypass "ungrouped" */
 
-  return ExecuteQueryInternal(query);
+  return query;
 }
 
 // PASSED.
-QueryStat QueryFactory::ExecuteQuery20() {
+std::string QueryFactory::Query20() const {
   const std::string part = data_path_ + "/" + kTableNames[2] + ".parquet";
   const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
   const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
@@ -757,5 +1209,95 @@ QueryStat QueryFactory::ExecuteQuery20() {
                       "and n_name = 'CANADA' "
                       "order by s_name";
 
-  return ExecuteQueryInternal(query);
+  return query;
+}
+
+// EXISTS / NOT EXISTS: semi and anti joins.
+std::string QueryFactory::Query21() const {
+  const std::string supplier = data_path_ + "/" + kTableNames[3] + ".parquet";
+  const std::string lineitem = data_path_ + "/" + kTableNames[0] + ".parquet";
+  const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
+  const std::string nation = data_path_ + "/" + kTableNames[6] + ".parquet";
+
+  std::string sub_query1 = "select * "
+                           "from '" +
+                           lineitem +
+                           "' l2 "
+                           "where l2.l_orderkey = l1.l_orderkey "
+                           "and l2.l_suppkey <> l1.l_suppkey";
+
+  std::string sub_query2 = "select * "
+                           "from '" +
+                           lineitem +
+                           "' l3 "
+                           "where l3.l_orderkey = l1.l_orderkey "
+                           "and l3.l_suppkey <> l1.l_suppkey "
+                           "and l3.l_receiptdate > l3.l_commitdate";
+
+  std::string query = "select s_name, count(*) as numwait "
+                      "from '" +
+                      supplier + "', '" + lineitem + "' l1, '" + orders +
+                      "', '" + nation +
+                      "' "
+                      "where s_suppkey = l1.l_suppkey "
+                      "and o_orderkey = l1.l_orderkey "
+                      "and o_orderstatus = 'F' "
+                      "and l1.l_receiptdate > l1.l_commitdate "
+                      "and exists (" +
+                      sub_query1 +
+                      ") "
+                      "and not exists (" +
+                      sub_query2 +
+                      ") "
+                      "and s_nationkey = n_nationkey "
+                      "and n_name = 'SAUDI ARABIA' "
+                      "group by s_name "
+                      "order by numwait desc, s_name "
+                      "limit 100";
+
+  return query;
+}
+
+// NOT EXISTS: anti join.
+std::string QueryFactory::Query22() const {
+  const std::string customer = data_path_ + "/" + kTableNames[4] + ".parquet";
+  const std::string orders = data_path_ + "/" + kTableNames[1] + ".parquet";
+
+  const std::string codes = "('13', '31', '23', '29', '30', '18', '17')";
+
+  std::string sub_query1 = "select avg(c_acctbal) "
+                           "from '" +
+                           customer +
+                           "' "
+                           "where c_acctbal > 0.00 "
+                           "and substring(c_phone, 1, 2) in " +
+                           codes;
+
+  std::string sub_query2 = "select * "
+                           "from '" +
+                           orders +
+                           "' "
+                           "where o_custkey = c_custkey";
+
+  std::string query = "select cntrycode, count(*) as numcust, "
+                      "sum(c_acctbal) as totacctbal "
+                      "from ( "
+                      "select substring(c_phone, 1, 2) as cntrycode, c_acctbal "
+                      "from '" +
+                      customer +
+                      "' "
+                      "where substring(c_phone, 1, 2) in " +
+                      codes +
+                      " "
+                      "and c_acctbal > (" +
+                      sub_query1 +
+                      ") "
+                      "and not exists (" +
+                      sub_query2 +
+                      ") "
+                      ") as custsale "
+                      "group by cntrycode "
+                      "order by cntrycode";
+
+  return query;
 }
@@ -1,8 +1,13 @@
 #ifndef _PICACHV_DUCKDB_QUERIES_H_
 #define _PICACHV_DUCKDB_QUERIES_H_
 
+#include <array>
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <vector>
 
 #include "cxxopts.h"
 #include "duckdb.hpp"
@@ -14,54 +19,132 @@ static const std::string kTableNames[] = {"lineitem", "orders",   "part",
 
 static const int kTableNum = sizeof(kTableNames) / sizeof(kTableNames[0]);
 
+// The phases reported by `get_profile_phases`.
+static const std::string kPhaseNames[] = {"load", "scan",     "filter",
+                                          "aggregate", "join", "finalize",
+                                          "other"};
+
+static const int kPhaseNum = sizeof(kPhaseNames) / sizeof(kPhaseNames[0]);
+
+// The memory statistics reported by `get_memory_stats`.
+static const std::string kMemoryNames[] = {"allocated", "active", "resident",
+                                           "peak_rss"};
+
+static const int kMemoryNum = sizeof(kMemoryNames) / sizeof(kMemoryNames[0]);
+
+using Duration = std::chrono::duration<double>;
+
+// The milliseconds spent in each phase, in the order of `kPhaseNames`.
+using Phases = std::array<double, kPhaseNum>;
+
+// The memory statistics in MiB, in the order of `kMemoryNames`; NaN if Picachv
+// does not report them, e.g., the allocator figures without jemalloc.
+using Memory = std::array<double, kMemoryNum>;
+
 struct QueryStat {
+  int query_num;
   bool success;
-  std::chrono::duration<double> time;
+  // The timed runs without and with policy checking, warmups excluded.
+  std::vector<Duration> baseline;
+  std::vector<Duration> picachv;
+  // The mean time of the timed runs with policy checking spent in each phase,
+  // if profiling is enabled.
+  std::optional<Phases> phases;
+  // The memory used by the process after the query.
+  std::optional<Memory> memory;
+
+  // The ratio of the median with policy checking to the median without it.
+  std::optional<double> Ratio() const;
+};
+
+// Returns the `p`-th percentile (0 <= p <= 1) of the runs in milliseconds.
+std::optional<double> Percentile(std::vector<Duration> runs, double p);
+
+// The throughput of several clients running the queries at the same time.
+struct ThroughputStat {
+  uint32_t clients;
+  uint64_t queries;
+  uint64_t failed;
+  // From the moment all clients are ready to the moment the last one is done.
+  Duration wall;
+  // The latency of every query run by any client.
+  std::vector<Duration> latencies;
+
+  double QueriesPerSecond() const;
 };
 
+// Writes the statistics as either "csv" or "json".
+void WriteStats(std::ostream &os, const std::vector<QueryStat> &stats,
+                const std::string &format);
+
+void WriteThroughput(std::ostream &os, const std::vector<ThroughputStat> &stats,
+                     const std::string &format);
+
 class QueryFactory {
   std::optional<std::string> policy_path_;
   uint32_t thread_num_;
   std::string data_path_;
   bool enable_profiling_;
-  int query_num_;
+  std::vector<int> queries_;
+  uint32_t repeat_;
+  uint32_t warmup_;
+  bool explain_;
+  bool print_result_;
+  bool baseline_;
+  // The time taken to register the policies of all the tables.
+  Duration register_time_;
+  // The numbers of concurrent clients to measure the throughput with.
+  std::vector<uint32_t> clients_;
 
   std::unique_ptr<duckdb::Connection> con_;
+  // The connections of the clients other than the first one, which uses
+  // `con_`. Each connection has a context of its own.
+  std::vector<std::unique_ptr<duckdb::Connection>> client_cons_;
 
 private:
   bool PrepareTable(const std::string &table_name);
+  bool SetupContext(duckdb::Connection &con);
 
-  QueryStat ExecuteQuery1();
-  QueryStat ExecuteQuery2();
-  QueryStat ExecuteQuery3();
-  QueryStat ExecuteQuery4();
-  QueryStat ExecuteQuery5();
-  QueryStat ExecuteQuery6();
-  QueryStat ExecuteQuery7();
-  QueryStat ExecuteQuery8();
-  QueryStat ExecuteQuery9();
-  QueryStat ExecuteQuery10();
-  QueryStat ExecuteQuery11();
-  QueryStat ExecuteQuery12();
-  QueryStat ExecuteQuery13();
-  QueryStat ExecuteQuery14();
-  // QueryStat ExecuteQuery15();
-  QueryStat ExecuteQuery16();
-  QueryStat ExecuteQuery17();
-  QueryStat ExecuteQuery18();
-  QueryStat ExecuteQuery19();
-  QueryStat ExecuteQuery20();
-  QueryStat ExecuteQuery21();
-  QueryStat ExecuteQuery22();
-
-  QueryStat ExecuteQueryInternal(const std::string &query);
+  std::string Query1() const;
+  std::string Query2() const;
+  std::string Query3() const;
+  std::string Query4() const;
+  std::string Query5() const;
+  std::string Query6() const;
+  std::string Query7() const;
+  std::string Query8() const;
+  std::string Query9() const;
+  std::string Query10() const;
+  std::string Query11() const;
+  std::string Query12() const;
+  std::string Query13() const;
+  std::string Query14() const;
+  // std::string Query15() const;
+  std::string Query16() const;
+  std::string Query17() const;
+  std::string Query18() const;
+  std::string Query19() const;
+  std::string Query20() const;
+  std::string Query21() const;
+  std::string Query22() const;
+
+  std::optional<std::string> QueryString(int query_num) const;
+
+  bool Measure(const std::string &query, std::vector<Duration> &runs,
+               std::optional<Phases> *phases);
+  QueryStat ExecuteQueryInternal(int query_num, const std::string &query);
 
 public:
   QueryFactory(cxxopts::ParseResult &options);
 
   bool Setup(std::unique_ptr<duckdb::Connection> con);
 
-  QueryStat ExecuteQuery();
+  std::vector<QueryStat> ExecuteQueries();
+
+  // Whether the throughput is measured instead of the latency of each query.
+  bool Concurrent() const { return !clients_.empty(); }
+
+  std::vector<ThroughputStat> ExecuteConcurrently(duckdb::DuckDB &db);
 };
 
 #endif // _PICACHV_DUCKDB_QUERIES_H_
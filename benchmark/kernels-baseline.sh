@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+#
+# Saves or compares criterion baselines of the picachv-core kernels.
+#
+#   ./kernels-baseline.sh save <name> [filter]     record a baseline
+#   ./kernels-baseline.sh compare <name> [filter]  fail if any kernel regressed against it
+#
+# Baselines are kept under benchmark/baselines (or $CRITERION_HOME) so that they can be
+# shared between checkouts. They are machine-specific: only compare baselines recorded on the
+# same host.
+
+set -euo pipefail
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 save|compare <name> [filter]" >&2
+  exit 1
+fi
+
+cmd=$1
+name=$2
+filter=${3:-}
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+export CRITERION_HOME=${CRITERION_HOME:-$root/benchmark/baselines}
+
+bench() {
+  cargo bench --manifest-path "$root/Cargo.toml" -p picachv-core --bench kernels -- "$@" $filter
+}
+
+case $cmd in
+save)
+  bench --save-baseline "$name"
+  ;;
+compare)
+  log=$(mktemp)
+  trap 'rm -f "$log"' EXIT
+  bench --baseline "$name" | tee "$log"
+  if grep -q "Performance has regressed" "$log"; then
+    echo "Some kernels regressed against the baseline '$name'." >&2
+    exit 1
+  fi
+  ;;
+*)
+  echo "unknown command: $cmd" >&2
+  exit 1
+  ;;
+esac
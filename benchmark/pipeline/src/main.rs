@@ -0,0 +1,193 @@
+use std::error::Error;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use clap::{Parser, ValueEnum};
+use picachv_core::constants::GroupByMethod;
+use picachv_core::dataframe::{PolicyGuardedColumn, PolicyGuardedDataFrame};
+use picachv_core::policy::{AggOps, AggType, Policy, PolicyLabel};
+
+/// Measures the policy tracking cost of a scan→filter→project pipeline that runs vector by
+/// vector, as DuckDB does, and prints the results as CSV.
+#[derive(Parser, Debug)]
+pub struct Args {
+    #[clap(
+        long,
+        default_value = "1048576",
+        help = "The number of rows of the scanned table"
+    )]
+    rows: usize,
+
+    #[clap(long, default_value = "16", help = "The number of policy columns")]
+    columns: usize,
+
+    #[clap(
+        long,
+        default_value = "2",
+        help = "The number of columns kept by the projection"
+    )]
+    project: usize,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "0,0.01,0.1,1",
+        help = "The fractions of cells that carry a non-clean policy"
+    )]
+    density: Vec<f64>,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "0.01,0.5,1",
+        help = "The fractions of rows kept by the filter"
+    )]
+    selectivity: Vec<f64>,
+
+    #[clap(long, default_value = "2048", help = "The number of rows in a vector")]
+    vector_size: usize,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "view,materialize",
+        help = "How the intermediate dataframes are kept"
+    )]
+    mode: Vec<Mode>,
+
+    #[clap(
+        long,
+        default_value = "3",
+        help = "The number of runs; the fastest one is reported"
+    )]
+    repeat: usize,
+}
+
+#[derive(ValueEnum, Clone, Copy, Debug)]
+enum Mode {
+    /// Slices and filters are composed into the row map of a view and the policies are only
+    /// gathered for the projected columns at the end.
+    View,
+    /// Every step copies the policies of all the columns it keeps.
+    Materialize,
+}
+
+impl Mode {
+    fn name(&self) -> &'static str {
+        match self {
+            Mode::View => "view",
+            Mode::Materialize => "materialize",
+        }
+    }
+}
+
+/// Builds a dataframe of `rows` rows where roughly `density` of the cells carry a policy.
+fn build_df(
+    rows: usize,
+    columns: usize,
+    density: f64,
+) -> Result<PolicyGuardedDataFrame, Box<dyn Error>> {
+    let policy = Arc::new(Policy::PolicyDeclassify {
+        label: PolicyLabel::PolicyAgg {
+            ops: AggOps(vec![AggType {
+                how: GroupByMethod::Sum,
+                group_size: 5,
+            }]),
+        }
+        .into(),
+        next: Arc::new(Policy::PolicyClean),
+    });
+
+    let column = Arc::new(PolicyGuardedColumn::new_with_density(
+        rows, 0, density, &policy,
+    )?);
+
+    Ok(PolicyGuardedDataFrame::new(vec![column; columns]))
+}
+
+/// Copies the policies of `df` into a new dataframe without any pending row map.
+fn materialize(df: &PolicyGuardedDataFrame) -> PolicyGuardedDataFrame {
+    PolicyGuardedDataFrame::new(df.columns().to_vec())
+}
+
+/// Runs the pipeline over every vector of `df` and returns the number of rows produced.
+fn run_pipeline(
+    df: &PolicyGuardedDataFrame,
+    args: &Args,
+    selectivity: f64,
+    mode: Mode,
+) -> Result<usize, Box<dyn Error>> {
+    let rows = df.shape().0;
+    let project_list = (0..args.project.min(args.columns)).collect::<Vec<_>>();
+    let threshold = (selectivity * 1_000_000.0) as u64;
+
+    let mut produced = 0;
+    for start in (0..rows).step_by(args.vector_size.max(1)) {
+        let end = (start + args.vector_size).min(rows);
+
+        // The scan hands out one vector of the table.
+        let sel_vec = (start as u32..end as u32).collect::<Vec<_>>();
+        let mut vector = match mode {
+            Mode::View => df.slice_view(&sel_vec)?,
+            Mode::Materialize => materialize(
+                &df.new_from_slice(&sel_vec.iter().map(|&i| i as usize).collect::<Vec<_>>())?,
+            ),
+        };
+
+        let pred = (start as u64..end as u64)
+            .map(|i| i.wrapping_mul(40503) % 1_000_000 < threshold)
+            .collect::<Vec<_>>();
+        vector.filter(&pred)?;
+        if let Mode::Materialize = mode {
+            vector = materialize(&vector);
+        }
+
+        vector.projection_by_id(&project_list)?;
+        // Reading the policies is what the check of the projected expressions does.
+        produced += vector.columns().iter().map(|c| c.len()).sum::<usize>();
+    }
+
+    Ok(produced)
+}
+
+fn timer<T>(f: impl FnOnce() -> T) -> (Duration, T) {
+    let begin = Instant::now();
+    let res = f();
+    (begin.elapsed(), res)
+}
+
+fn main() -> Result<(), Box<dyn Error>> {
+    let args = Args::parse();
+    let vectors = args.rows.div_ceil(args.vector_size.max(1)).max(1);
+
+    println!("mode,rows,columns,project,density,selectivity,vector_size,total_ms,vector_us");
+    for &density in args.density.iter() {
+        let df = build_df(args.rows, args.columns, density)?;
+
+        for (&selectivity, &mode) in args
+            .selectivity
+            .iter()
+            .flat_map(|s| args.mode.iter().map(move |m| (s, m)))
+        {
+            let mut best = Duration::MAX;
+            for _ in 0..args.repeat.max(1) {
+                let (elapsed, res) = timer(|| run_pipeline(&df, &args, selectivity, mode));
+                std::hint::black_box(res?);
+                best = best.min(elapsed);
+            }
+
+            println!(
+                "{},{},{},{},{density},{selectivity},{},{:.3},{:.3}",
+                mode.name(),
+                args.rows,
+                args.columns,
+                args.project,
+                args.vector_size,
+                best.as_secs_f64() * 1e3,
+                best.as_secs_f64() * 1e6 / vectors as f64,
+            );
+        }
+    }
+
+    Ok(())
+}
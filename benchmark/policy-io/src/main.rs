@@ -0,0 +1,220 @@
+use std::error::Error;
+use std::fs::File;
+use std::io::{Read, Seek, SeekFrom};
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use clap::Parser;
+use picachv_core::constants::GroupByMethod;
+use picachv_core::dataframe::{PolicyGuardedColumn, PolicyGuardedDataFrame};
+use picachv_core::io::parquet::{PolicyCompression, PolicyParquetOptions};
+use picachv_core::io::scan::PolicyScan;
+use picachv_core::policy::{AggOps, AggType, Policy, PolicyLabel};
+
+/// The number of rows of `lineitem` at scale factor 1.
+const LINEITEM_ROWS_PER_SF: f64 = 6_001_215.0;
+
+/// Measures the size and the I/O cost of policy files over scale factors, policy
+/// densities, compression codecs and row group sizes, and prints the results as CSV.
+#[derive(Parser, Debug)]
+pub struct Args {
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "0.01,0.1,1",
+        help = "The scale factors"
+    )]
+    sf: Vec<f64>,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "0,0.01,0.1,1",
+        help = "The fractions of cells that carry a non-clean policy"
+    )]
+    density: Vec<f64>,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "none,snappy,lz4,zstd1,zstd9",
+        help = "The codecs; `zstdN` means zstd at level N"
+    )]
+    codec: Vec<String>,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "2048,131072,1048576",
+        help = "The numbers of rows in a row group"
+    )]
+    row_group_size: Vec<usize>,
+
+    #[clap(
+        long,
+        default_value = "2048",
+        help = "The number of rows read by each row-range read"
+    )]
+    range_len: usize,
+
+    #[clap(long, default_value = "100", help = "The number of row-range reads")]
+    ranges: usize,
+
+    #[clap(long, default_value = "4", help = "The number of policy columns")]
+    columns: usize,
+
+    #[clap(long, default_value = "3", help = "The number of reads per file")]
+    repeat: usize,
+
+    #[clap(
+        long,
+        help = "Where the policy files are written (a temporary directory if unset)"
+    )]
+    output_dir: Option<PathBuf>,
+}
+
+fn parse_codec(codec: &str) -> Result<PolicyCompression, Box<dyn Error>> {
+    Ok(match codec {
+        "none" => PolicyCompression::None,
+        "snappy" => PolicyCompression::Snappy,
+        "lz4" => PolicyCompression::Lz4,
+        zstd if zstd.starts_with("zstd") => {
+            PolicyCompression::Zstd(zstd["zstd".len()..].parse().unwrap_or(1))
+        },
+        codec => return Err(format!("Invalid codec {codec}").into()),
+    })
+}
+
+/// Builds a dataframe of `rows` rows where roughly `density` of the cells carry a policy.
+fn build_df(
+    rows: usize,
+    columns: usize,
+    density: f64,
+) -> Result<PolicyGuardedDataFrame, Box<dyn Error>> {
+    let policy = Arc::new(Policy::PolicyDeclassify {
+        label: PolicyLabel::PolicyAgg {
+            ops: AggOps(vec![AggType {
+                how: GroupByMethod::Sum,
+                group_size: 5,
+            }]),
+        }
+        .into(),
+        next: Arc::new(Policy::PolicyClean),
+    });
+
+    let column = Arc::new(PolicyGuardedColumn::new_with_density(
+        rows, 0, density, &policy,
+    )?);
+
+    Ok(PolicyGuardedDataFrame::new(vec![column; columns]))
+}
+
+/// Returns the size of the Parquet footer, i.e., the serialized file metadata.
+fn footer_size(path: &Path) -> Result<u64, Box<dyn Error>> {
+    let mut file = File::open(path)?;
+    let mut buf = [0u8; 8];
+    file.seek(SeekFrom::End(-8))?;
+    file.read_exact(&mut buf)?;
+
+    Ok(u32::from_le_bytes(buf[..4].try_into()?) as u64 + 8)
+}
+
+/// Returns the mean latency of `ranges` row-range reads spread over the file.
+fn range_latency(
+    path: &Path,
+    projection: &[usize],
+    rows: usize,
+    range_len: usize,
+    ranges: usize,
+) -> Result<Duration, Box<dyn Error>> {
+    let scan = PolicyScan::open(path, projection)?;
+    let range_len = range_len.min(rows);
+    let ranges = ranges.max(1);
+    let stride = (rows - range_len) / ranges;
+
+    let mut total = Duration::ZERO;
+    for i in 0..ranges {
+        let (elapsed, res) = timer(|| scan.read_rows(i * stride, range_len, None));
+        res?;
+        total += elapsed;
+    }
+
+    Ok(total / ranges as u32)
+}
+
+fn timer<T>(f: impl FnOnce() -> T) -> (Duration, T) {
+    let begin = Instant::now();
+    let res = f();
+    (begin.elapsed(), res)
+}
+
+fn run(args: &Args, dir: &Path) -> Result<(), Box<dyn Error>> {
+    let codecs = args
+        .codec
+        .iter()
+        .map(|c| Ok((c.as_str(), parse_codec(c)?)))
+        .collect::<Result<Vec<_>, Box<dyn Error>>>()?;
+    let projection = (0..args.columns).collect::<Vec<_>>();
+
+    println!(
+        "sf,density,codec,row_group_size,rows,file_size,footer_size,write_ms,read_ms,range_read_us"
+    );
+    for &sf in args.sf.iter() {
+        let rows = (sf * LINEITEM_ROWS_PER_SF) as usize;
+
+        for &density in args.density.iter() {
+            let df = build_df(rows, args.columns, density)?;
+
+            for ((name, compression), &row_group_size) in codecs
+                .iter()
+                .flat_map(|c| args.row_group_size.iter().map(move |r| (c, r)))
+            {
+                let path = dir.join(format!(
+                    "policy_{sf}_{density}_{name}_{row_group_size}.parquet"
+                ));
+                let options = PolicyParquetOptions {
+                    compression: *compression,
+                    row_group_size,
+                    ..Default::default()
+                };
+
+                let (write, res) = timer(|| df.to_parquet_with_options(&path, &options));
+                res?;
+                let file_size = std::fs::metadata(&path)?.len();
+                let footer_size = footer_size(&path)?;
+
+                let mut read = Duration::MAX;
+                for _ in 0..args.repeat.max(1) {
+                    let (elapsed, res) =
+                        timer(|| PolicyGuardedDataFrame::from_parquet(&path, &projection, None));
+                    res?;
+                    read = read.min(elapsed);
+                }
+
+                let range = range_latency(&path, &projection, rows, args.range_len, args.ranges)?;
+
+                println!(
+                    "{sf},{density},{name},{row_group_size},{rows},{file_size},{footer_size},{:.3},{:.3},{:.3}",
+                    write.as_secs_f64() * 1e3,
+                    read.as_secs_f64() * 1e3,
+                    range.as_secs_f64() * 1e6,
+                );
+                std::fs::remove_file(&path)?;
+            }
+        }
+    }
+
+    Ok(())
+}
+
+fn main() -> Result<(), Box<dyn Error>> {
+    let args = Args::parse();
+    let dir = args
+        .output_dir
+        .clone()
+        .unwrap_or_else(|| std::env::temp_dir().join("picachv-policy-io"));
+    std::fs::create_dir_all(&dir)?;
+
+    run(&args, &dir)
+}
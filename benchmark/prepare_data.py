@@ -91,7 +91,7 @@ table_columns = {
 }
 
 
-def dbgen(scale_factor: int) -> None:
+def dbgen(scale_factor: float) -> None:
     ret = subprocess.run(
         ["make", "-C", "dbgen", "dbgen"], stdout=subprocess.PIPE, check=True
     )
@@ -112,7 +112,7 @@ def dbgen(scale_factor: int) -> None:
     os.chdir("..")
 
 
-def main(percentage: float, skip_dbgen: bool, scale_factor: int) -> None:
+def main(percentage: float, skip_dbgen: bool, scale_factor: float) -> None:
     if not skip_dbgen:
         dbgen(scale_factor)
 
@@ -158,7 +158,7 @@ if __name__ == "__main__":
     )
     parser.add_argument(
         "--scale-factor",
-        type=int,
+        type=float,
         default=1,
         help="Scale factor for dbgen",
     )
@@ -0,0 +1,198 @@
+import argparse
+import csv
+import json
+import os
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+BENCHMARK_DIR = Path(__file__).resolve().parent
+ROOT_DIR = BENCHMARK_DIR.parent
+
+# Where `prepare_data.py` puts the tables; see `settings.py`.
+TABLES_DIR = ROOT_DIR / "data" / "tables"
+POLICIES_DIR = ROOT_DIR / "data" / "policies"
+
+# Must match `kPhaseNames` and `kMemoryNames` in `duckdb/queries.h`.
+PHASES = ["load", "scan", "filter", "aggregate", "join", "finalize", "other"]
+MEMORY = ["allocated", "active", "resident", "peak_rss"]
+
+
+def parse_list(value: str, ty: type) -> list:
+    return [ty(v) for v in value.split(",") if v]
+
+
+def generate_tables(scale_factor: float) -> None:
+    print(f"Generating the tables for SF {scale_factor}")
+    subprocess.run(
+        [sys.executable, "prepare_data.py", "--scale-factor", str(scale_factor)],
+        cwd=BENCHMARK_DIR,
+        check=True,
+    )
+
+
+def generate_policies(density: float, output_path: Path) -> None:
+    print(f"Generating the policies with density {density}")
+    output_path.mkdir(parents=True, exist_ok=True)
+    subprocess.run(
+        [
+            "cargo",
+            "run",
+            "--release",
+            "-p",
+            "policy-generator",
+            "--",
+            "--input-path",
+            str(TABLES_DIR),
+            "--output-path",
+            str(output_path),
+            "--format",
+            "parquet",
+            "--density",
+            str(density),
+        ],
+        cwd=ROOT_DIR,
+        check=True,
+    )
+
+
+def run_tpch(args: argparse.Namespace, policy_path: Path) -> tuple[int, float, list]:
+    """Runs all the queries in one `tpch` process and returns its exit status, its peak RSS
+    in MiB and the statistics of the queries."""
+    with tempfile.NamedTemporaryFile(suffix=".json") as output:
+        cmd = [
+            args.tpch,
+            "--data-path",
+            str(TABLES_DIR),
+            # `tpch` appends the file names to the policy path.
+            "--policy-path",
+            f"{policy_path}/",
+            "--queries",
+            args.queries,
+            "--repeat",
+            str(args.repeat),
+            "--warmup",
+            str(args.warmup),
+            "--format",
+            "json",
+            "--output",
+            output.name,
+        ]
+        if not args.no_profiling:
+            cmd.append("--enable-profiling")
+
+        proc = subprocess.Popen(cmd)
+        # Unlike `getrusage(RUSAGE_CHILDREN)`, this is the peak of this process alone.
+        _, status, rusage = os.wait4(proc.pid, 0)
+        proc.returncode = os.waitstatus_to_exitcode(status)
+
+        try:
+            with open(output.name) as f:
+                stats = json.load(f)
+        except (OSError, ValueError):
+            # The process was killed, e.g., by the OOM killer, before writing anything.
+            stats = []
+
+    # `ru_maxrss` is in KiB on Linux.
+    return proc.returncode, rusage.ru_maxrss / 1024, stats
+
+
+def rows(scale_factor: float, density: float, status: int, peak_rss: float, stats: list):
+    point = {
+        "scale_factor": scale_factor,
+        "density": density,
+        "status": status,
+        "process_peak_rss_mb": peak_rss,
+    }
+
+    if not stats:
+        yield point
+        return
+
+    for stat in stats:
+        row = dict(point, query=stat["query"], success=stat["success"])
+        for mode in ["baseline", "picachv"]:
+            row[f"{mode}_median_ms"] = (stat[mode] or {}).get("median_ms")
+            row[f"{mode}_p99_ms"] = (stat[mode] or {}).get("p99_ms")
+        row["ratio"] = stat["ratio"]
+        for phase in PHASES:
+            row[f"{phase}_ms"] = (stat["phases_ms"] or {}).get(phase)
+        for memory in MEMORY:
+            row[f"{memory}_mb"] = (stat["memory_mb"] or {}).get(memory)
+        yield row
+
+
+def main(args: argparse.Namespace) -> None:
+    fields = (
+        ["scale_factor", "density", "status", "process_peak_rss_mb", "query", "success"]
+        + [f"{m}_{s}_ms" for m in ["baseline", "picachv"] for s in ["median", "p99"]]
+        + ["ratio"]
+        + [f"{phase}_ms" for phase in PHASES]
+        + [f"{memory}_mb" for memory in MEMORY]
+    )
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+
+        for scale_factor in parse_list(args.sf, float):
+            if not args.skip_generation:
+                generate_tables(scale_factor)
+
+            for density in parse_list(args.density, float):
+                policy_path = POLICIES_DIR / f"sf-{scale_factor}-density-{density}"
+                if not args.skip_generation:
+                    generate_policies(density, policy_path)
+
+                status, peak_rss, stats = run_tpch(args, policy_path)
+                print(
+                    f"SF {scale_factor}, density {density}: exit status {status}, "
+                    f"peak RSS {peak_rss:.1f} MiB"
+                )
+
+                writer.writerows(rows(scale_factor, density, status, peak_rss, stats))
+                # Keep what has been measured if a later point runs out of memory.
+                f.flush()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Sweep the scale factor and the policy density of TPC-H"
+    )
+    parser.add_argument(
+        "--sf",
+        default="0.1,1,10,30",
+        help="Comma-separated scale factors",
+    )
+    parser.add_argument(
+        "--density",
+        default="0,0.01,0.1",
+        help="Comma-separated fractions of cells that carry a non-clean policy",
+    )
+    parser.add_argument(
+        "--tpch",
+        default=str(BENCHMARK_DIR / "duckdb" / "build" / "tpch"),
+        help="The path to the `tpch` binary",
+    )
+    parser.add_argument(
+        "--queries",
+        default="1,3,5,6,10,12,14,19",
+        help="Comma-separated query numbers",
+    )
+    parser.add_argument("--repeat", type=int, default=3, help="Timed runs per query")
+    parser.add_argument("--warmup", type=int, default=1, help="Untimed runs per query")
+    parser.add_argument(
+        "--no-profiling",
+        action="store_true",
+        help="Do not break the time down into phases, which costs some overhead",
+    )
+    parser.add_argument(
+        "--skip-generation",
+        action="store_true",
+        help="Reuse the tables and policies generated before; the tables are not kept per "
+        "scale factor, so this only makes sense for a single one",
+    )
+    parser.add_argument("--output", default="sweep.csv", help="The output CSV file")
+
+    main(parser.parse_args())
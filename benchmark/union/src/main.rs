@@ -0,0 +1,169 @@
+use std::error::Error;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use clap::{Parser, ValueEnum};
+use picachv_core::constants::GroupByMethod;
+use picachv_core::dataframe::{PolicyGuardedColumn, PolicyGuardedDataFrame};
+use picachv_core::policy::{AggOps, AggType, Policy, PolicyLabel};
+
+/// Measures the cost of merging the many small dataframes produced by parallel pipelines
+/// (or by `UNION ALL`) and of filtering the merged result, and prints the results as CSV.
+#[derive(Parser, Debug)]
+pub struct Args {
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "10,100,1000",
+        help = "The numbers of dataframes to merge"
+    )]
+    chunks: Vec<usize>,
+
+    #[clap(
+        long,
+        default_value = "2048",
+        help = "The number of rows of each dataframe"
+    )]
+    chunk_rows: usize,
+
+    #[clap(long, default_value = "4", help = "The number of policy columns")]
+    columns: usize,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "0,0.01,0.1",
+        help = "The fractions of cells that carry a non-clean policy"
+    )]
+    density: Vec<f64>,
+
+    #[clap(
+        long,
+        value_delimiter = ',',
+        default_value = "nway,pairwise",
+        help = "How the dataframes are merged"
+    )]
+    strategy: Vec<Strategy>,
+
+    #[clap(
+        long,
+        default_value = "5",
+        help = "The number of runs; the fastest one is reported"
+    )]
+    repeat: usize,
+}
+
+#[derive(ValueEnum, Clone, Copy, Debug)]
+enum Strategy {
+    /// One call to `union` with all the inputs.
+    Nway,
+    /// The inputs are appended to the accumulated result one at a time.
+    Pairwise,
+}
+
+impl Strategy {
+    fn name(&self) -> &'static str {
+        match self {
+            Strategy::Nway => "nway",
+            Strategy::Pairwise => "pairwise",
+        }
+    }
+}
+
+/// Builds `n` dataframes of `rows` rows each where roughly `density` of the cells carry a
+/// policy.
+fn build_dfs(
+    n: usize,
+    rows: usize,
+    columns: usize,
+    density: f64,
+) -> Result<Vec<Arc<PolicyGuardedDataFrame>>, Box<dyn Error>> {
+    let policy = Arc::new(Policy::PolicyDeclassify {
+        label: PolicyLabel::PolicyAgg {
+            ops: AggOps(vec![AggType {
+                how: GroupByMethod::Sum,
+                group_size: 5,
+            }]),
+        }
+        .into(),
+        next: Arc::new(Policy::PolicyClean),
+    });
+
+    // Spread the policies evenly over the inputs.
+    (0..n)
+        .map(|k| {
+            let column = Arc::new(PolicyGuardedColumn::new_with_density(
+                rows,
+                k * rows,
+                density,
+                &policy,
+            )?);
+
+            Ok(Arc::new(PolicyGuardedDataFrame::new(vec![column; columns])))
+        })
+        .collect()
+}
+
+fn merge(
+    dfs: &[Arc<PolicyGuardedDataFrame>],
+    strategy: Strategy,
+) -> Result<PolicyGuardedDataFrame, Box<dyn Error>> {
+    Ok(match strategy {
+        Strategy::Nway => PolicyGuardedDataFrame::union(dfs)?,
+        Strategy::Pairwise => {
+            let mut acc = dfs[0].clone();
+            for df in dfs[1..].iter() {
+                acc = Arc::new(PolicyGuardedDataFrame::union(&[acc, df.clone()])?);
+            }
+            Arc::unwrap_or_clone(acc)
+        },
+    })
+}
+
+fn timer<T>(f: impl FnOnce() -> T) -> (Duration, T) {
+    let begin = Instant::now();
+    let res = f();
+    (begin.elapsed(), res)
+}
+
+fn main() -> Result<(), Box<dyn Error>> {
+    let args = Args::parse();
+
+    println!("strategy,chunks,chunk_rows,columns,density,result_chunks,union_ms,filter_ms");
+    for &density in args.density.iter() {
+        for &n in args.chunks.iter().filter(|&&n| n > 0) {
+            let dfs = build_dfs(n, args.chunk_rows, args.columns, density)?;
+            let pred = (0..n * args.chunk_rows)
+                .map(|i| i % 2 == 0)
+                .collect::<Vec<_>>();
+
+            for &strategy in args.strategy.iter() {
+                let (mut union, mut filter) = (Duration::MAX, Duration::MAX);
+                let mut result_chunks = 0;
+
+                for _ in 0..args.repeat.max(1) {
+                    let (elapsed, res) = timer(|| merge(&dfs, strategy));
+                    let mut df = res?;
+                    union = union.min(elapsed);
+                    result_chunks = df.columns().first().map_or(0, |c| c.chunks().len());
+
+                    // The merged result is what the rest of the plan works on.
+                    let (elapsed, res) = timer(|| df.filter(&pred));
+                    res?;
+                    filter = filter.min(elapsed);
+                }
+
+                println!(
+                    "{},{n},{},{},{density},{result_chunks},{:.3},{:.3}",
+                    strategy.name(),
+                    args.chunk_rows,
+                    args.columns,
+                    union.as_secs_f64() * 1e3,
+                    filter.as_secs_f64() * 1e3,
+                );
+            }
+        }
+    }
+
+    Ok(())
+}
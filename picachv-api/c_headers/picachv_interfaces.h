@@ -106,20 +106,24 @@ ErrorCode reify_expression(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
 /**
  * @brief Creates a sliced dataframe.
  *
+ * The slice is a view over the dataframe that records the selection vector
+ * only, so no policy is copied until the slice is read.
+ *
  * @param [in] ctx_uuid The UUID of the context.
  * @param [in] ctx_uuid_len The length of the context UUID.
  * @param [in] df_uuid The UUID of the dataframe.
  * @param [in] df_uuid_len The length of the dataframe UUID.
- * @param start The start index of the slice.
- * @param end The end index of the slice.
+ * @param [in] sel_vec The selection vector: the `i`-th row of the slice is the
+ * `sel_vec[i]`-th row of the dataframe.
+ * @param [in] sel_vec_len The length of the selection vector.
  * @param [out] slice_uuid The buffer for holding the UUID of the sliced
  * @param [in] slice_uuid_len The length of the slice UUID buffer.
  * @return ErrorCode
  */
 ErrorCode create_slice(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
                        const uint8_t *df_uuid, std::size_t df_uuid_len,
-                       uint64_t start, uint64_t end, uint8_t *slice_uuid,
-                       std::size_t slice_uuid_len);
+                       const uint32_t *sel_vec, std::size_t sel_vec_len,
+                       uint8_t *slice_uuid, std::size_t slice_uuid_len);
 
 /**
  * @brief Finalize should be called whenever the analytical result is collected.
@@ -183,6 +187,13 @@ ErrorCode execute_epilogue(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
 ErrorCode debug_print_df(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
                          const uint8_t *df_uuid, std::size_t df_uuid_len);
 
+/**
+ * @brief Prints the counters.
+ *
+ * @return ErrorCode
+ */
+ErrorCode debug_print_counters();
+
 /**
  * @brief Enable the profiling.
  *
@@ -194,6 +205,132 @@ ErrorCode debug_print_df(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
 ErrorCode enable_profiling(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
                            bool enable);
 
+/**
+ * @brief Copies the profile of the context as JSON. By default this is a
+ * summary with the call tree of the profiled phases and their total and self
+ * time in nanoseconds; with `trace` it is a Chrome trace that can be opened
+ * with Perfetto.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] trace Whether to export a Chrome trace instead of the summary.
+ * @param [out] output The buffer for holding the profile.
+ * @param [in,out] output_len The size of the buffer; set to the size of the
+ * profile. If the buffer is too small, nothing is copied and
+ * `InvalidOperation` is returned.
+ * @return ErrorCode
+ */
+ErrorCode get_profile(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                      bool trace, uint8_t *output, std::size_t *output_len);
+
+/**
+ * @brief Drops the spans recorded by the profiler of the context.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @return ErrorCode
+ */
+ErrorCode reset_profile(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len);
+
+/**
+ * @brief Copies the time spent in each phase of the queries (`load`, `scan`,
+ * `filter`, `aggregate`, `join`, `finalize` and `other`), summed over all the
+ * contexts, as a JSON object of nanoseconds keyed by the names of the phases.
+ * Only the contexts with profiling enabled record the phases.
+ *
+ * @param [out] output The buffer for holding the phases.
+ * @param [in,out] output_len The size of the buffer; set to the size of the
+ * phases. If the buffer is too small, nothing is copied and `InvalidOperation`
+ * is returned.
+ * @return ErrorCode
+ */
+ErrorCode get_profile_phases(uint8_t *output, std::size_t *output_len);
+
+/**
+ * @brief Drops the spans recorded by the profilers of all the contexts.
+ *
+ * @return ErrorCode
+ */
+ErrorCode reset_profiles();
+
+/**
+ * @brief Copies the memory statistics of the process as a JSON object with the
+ * bytes `allocated`, `active` and `resident` and the `peak_rss` of the whole
+ * process. With the `jemalloc` feature, the first three are reported by jemalloc
+ * and only cover the allocations made by Picachv; otherwise they are `null`.
+ *
+ * @param [out] output The buffer for holding the statistics.
+ * @param [in,out] output_len The size of the buffer; set to the size of the
+ * statistics. If the buffer is too small, nothing is copied and
+ * `InvalidOperation` is returned.
+ * @return ErrorCode
+ */
+ErrorCode get_memory_stats(uint8_t *output, std::size_t *output_len);
+
+/**
+ * @brief Copies the memory statistics of the process, as in
+ * `get_memory_stats`, along with the numbers of `dataframes` and `expressions`
+ * kept by the context as a JSON object.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [out] output The buffer for holding the statistics.
+ * @param [in,out] output_len The size of the buffer; set to the size of the
+ * statistics. If the buffer is too small, nothing is copied and
+ * `InvalidOperation` is returned.
+ * @return ErrorCode
+ */
+ErrorCode memory_stats(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                       uint8_t *output, std::size_t *output_len);
+
+/**
+ * @brief Starts or stops sampling the stack traces of allocations. Picachv
+ * must be built with the `heap_profiling` feature and the process started with
+ * `_RJEM_MALLOC_CONF=prof:true,prof_active:false`; otherwise
+ * `InvalidOperation` is returned.
+ *
+ * @param [in] active Whether to sample allocations.
+ * @return ErrorCode
+ */
+ErrorCode set_heap_profiling(bool active);
+
+/**
+ * @brief Drops the allocations sampled so far.
+ *
+ * @return ErrorCode
+ */
+ErrorCode reset_heap_profile();
+
+/**
+ * @brief Writes the allocations sampled so far to a file that can be read by
+ * `jeprof`.
+ *
+ * @param [in] path The path to the profile.
+ * @param [in] path_len The length of the path.
+ * @return ErrorCode
+ */
+ErrorCode dump_heap_profile(const uint8_t *path, std::size_t path_len);
+
+/**
+ * @brief Copies the process-wide counters as a JSON object keyed by their
+ * names, e.g., `rows_projected` or `policy_joins`. The counters are always on
+ * and do not require `enable_profiling`.
+ *
+ * @param [out] output The buffer for holding the counters.
+ * @param [in,out] output_len The size of the buffer; set to the size of the
+ * counters. If the buffer is too small, nothing is copied and
+ * `InvalidOperation` is returned.
+ * @return ErrorCode
+ */
+ErrorCode get_counters(uint8_t *output, std::size_t *output_len);
+
+/**
+ * @brief Sets all the counters to zero.
+ *
+ * @return ErrorCode
+ */
+ErrorCode reset_counters();
+
 /**
  * @brief Enable the tracing.
  *
@@ -222,5 +359,224 @@ ErrorCode select_group(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
                        const uint8_t *df_uuid, std::size_t df_uuid_len,
                        const uint64_t *hashes, std::size_t hash_len,
                        uint8_t *result_uuid, std::size_t result_uuid_len);
+
+/**
+ * @brief Opens a persistent scan over a policy Parquet file. The footer is
+ * parsed once and the scan can be shared by all the threads scanning the file.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] path The path to the policy file.
+ * @param [in] path_len The length of the path.
+ * @param [in] projection The indices of the columns to read.
+ * @param [in] projection_len The length of the projection.
+ * @param [in] downgrade The JSON-encoded label the query downgrades the
+ * policies by, or NULL. If given, the scan fails before any row group is read
+ * when the policy statistics show a policy it cannot downgrade.
+ * @param [in] downgrade_len The length of the label.
+ * @param [out] scan_uuid The buffer for holding the UUID of the scan.
+ * @param [in] scan_uuid_len The length of the scan UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode open_policy_scan(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                           const uint8_t *path, std::size_t path_len,
+                           const std::size_t *projection,
+                           std::size_t projection_len, const uint8_t *downgrade,
+                           std::size_t downgrade_len, uint8_t *scan_uuid,
+                           std::size_t scan_uuid_len);
+
+/**
+ * @brief Reads a row group from an opened scan and registers it as a policy
+ * dataframe. This function can be called concurrently on the same scan.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] scan_uuid The UUID of the scan.
+ * @param [in] scan_uuid_len The length of the scan UUID.
+ * @param [in] row_group The index of the row group.
+ * @param [in] selection The selection vector or NULL if all rows are read.
+ * @param [in] selection_len The length of the selection vector.
+ * @param [out] df_uuid The buffer for holding the UUID of the dataframe.
+ * @param [in] df_uuid_len The length of the dataframe UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode next_row_group(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                         const uint8_t *scan_uuid, std::size_t scan_uuid_len,
+                         std::size_t row_group, const bool *selection,
+                         std::size_t selection_len, uint8_t *df_uuid,
+                         std::size_t df_uuid_len);
+
+/**
+ * @brief Reads the logical rows [start_row, start_row + len) from an opened
+ * scan and registers them as a policy dataframe. Unlike `next_row_group`, the
+ * rows need not be aligned with the row groups of the policy file.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] scan_uuid The UUID of the scan.
+ * @param [in] scan_uuid_len The length of the scan UUID.
+ * @param [in] start_row The first row to read.
+ * @param [in] len The number of rows to read.
+ * @param [in] selection The selection vector of `len` entries or NULL.
+ * @param [out] df_uuid The buffer for holding the UUID of the dataframe.
+ * @param [in] df_uuid_len The length of the dataframe UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode read_policy_rows(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                           const uint8_t *scan_uuid, std::size_t scan_uuid_len,
+                           std::size_t start_row, std::size_t len,
+                           const bool *selection, uint8_t *df_uuid,
+                           std::size_t df_uuid_len);
+
+/**
+ * @brief Joins two policy dataframes. The i-th joined row consists of the
+ * left_idx[i]-th row of the left dataframe and the right_idx[i]-th row of the
+ * right one. The index arrays are read in place without being copied.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] lhs_uuid The UUID of the left dataframe.
+ * @param [in] lhs_uuid_len The length of the left dataframe UUID.
+ * @param [in] rhs_uuid The UUID of the right dataframe.
+ * @param [in] rhs_uuid_len The length of the right dataframe UUID.
+ * @param [in] left_columns The columns of the left dataframe to keep.
+ * @param [in] left_columns_len The length of `left_columns`.
+ * @param [in] right_columns The columns of the right dataframe to keep.
+ * @param [in] right_columns_len The length of `right_columns`.
+ * @param [in] left_idx The row indices into the left dataframe.
+ * @param [in] right_idx The row indices into the right dataframe.
+ * @param [in] idx_len The number of joined rows.
+ * @param [in] join_type The `JoinType` of the protobuf definition. For outer
+ * joins, the index of the missing side of a null-extended row is SIZE_MAX.
+ * Semi and anti joins only keep the left_idx[i]-th rows of the left dataframe.
+ * @param [out] out_df_uuid The buffer for holding the UUID of the result.
+ * @param [in] out_df_uuid_len The length of the result UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode join_by_idx(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                      const uint8_t *lhs_uuid, std::size_t lhs_uuid_len,
+                      const uint8_t *rhs_uuid, std::size_t rhs_uuid_len,
+                      const std::size_t *left_columns,
+                      std::size_t left_columns_len,
+                      const std::size_t *right_columns,
+                      std::size_t right_columns_len, const std::size_t *left_idx,
+                      const std::size_t *right_idx, std::size_t idx_len,
+                      int32_t join_type, uint8_t *out_df_uuid,
+                      std::size_t out_df_uuid_len);
+
+/**
+ * @brief Filters a policy dataframe with a bitmap. Bit (i % 8) of byte (i / 8)
+ * is set if the i-th row is kept, as in an Arrow validity bitmap.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] df_uuid The UUID of the dataframe.
+ * @param [in] df_uuid_len The length of the dataframe UUID.
+ * @param [in] bitmap The bitmap.
+ * @param [in] bitmap_len The length of the bitmap in bytes.
+ * @param [out] out_df_uuid The buffer for holding the UUID of the result.
+ * @param [in] out_df_uuid_len The length of the result UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode filter_by_bitmap(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                           const uint8_t *df_uuid, std::size_t df_uuid_len,
+                           const uint8_t *bitmap, std::size_t bitmap_len,
+                           uint8_t *out_df_uuid, std::size_t out_df_uuid_len);
+
+/**
+ * @brief Filters a policy dataframe with the ascending indices of the rows to
+ * keep, e.g., a DuckDB selection vector.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] df_uuid The UUID of the dataframe.
+ * @param [in] df_uuid_len The length of the dataframe UUID.
+ * @param [in] selection The indices of the rows to keep.
+ * @param [in] selection_len The number of rows to keep.
+ * @param [out] out_df_uuid The buffer for holding the UUID of the result.
+ * @param [in] out_df_uuid_len The length of the result UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode filter_by_selection(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                              const uint8_t *df_uuid, std::size_t df_uuid_len,
+                              const uint32_t *selection,
+                              std::size_t selection_len, uint8_t *out_df_uuid,
+                              std::size_t out_df_uuid_len);
+
+/**
+ * @brief Pins the build side of a join whose probe side is streamed vector by
+ * vector with `join_probe`. The session must be released with `end_join`.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] lhs_uuid The UUID of the build-side dataframe.
+ * @param [in] lhs_uuid_len The length of the build-side dataframe UUID.
+ * @param [in] left_columns The columns of the build side to keep.
+ * @param [in] left_columns_len The length of `left_columns`.
+ * @param [in] right_columns The columns of the probe side to keep.
+ * @param [in] right_columns_len The length of `right_columns`.
+ * @param [in] join_type The `JoinType` of the protobuf definition.
+ * @param [out] session_uuid The buffer for holding the UUID of the session.
+ * @param [in] session_uuid_len The length of the session UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode begin_join(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                     const uint8_t *lhs_uuid, std::size_t lhs_uuid_len,
+                     const std::size_t *left_columns,
+                     std::size_t left_columns_len,
+                     const std::size_t *right_columns,
+                     std::size_t right_columns_len, int32_t join_type,
+                     uint8_t *session_uuid, std::size_t session_uuid_len);
+
+/**
+ * @brief Joins a probe vector with the build side of a session. The i-th
+ * joined row consists of the left_idx[i]-th row of the build side and the
+ * right_idx[i]-th row of the probe vector. This can be called concurrently on
+ * the same session.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] session_uuid The UUID of the session.
+ * @param [in] session_uuid_len The length of the session UUID.
+ * @param [in] rhs_uuid The UUID of the probe vector.
+ * @param [in] rhs_uuid_len The length of the probe vector UUID.
+ * @param [in] left_idx The row indices into the build side.
+ * @param [in] right_idx The row indices into the probe vector.
+ * @param [in] idx_len The number of joined rows.
+ * @param [out] out_df_uuid The buffer for holding the UUID of the result.
+ * @param [in] out_df_uuid_len The length of the result UUID buffer.
+ * @return ErrorCode
+ */
+ErrorCode join_probe(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                     const uint8_t *session_uuid, std::size_t session_uuid_len,
+                     const uint8_t *rhs_uuid, std::size_t rhs_uuid_len,
+                     const std::size_t *left_idx, const std::size_t *right_idx,
+                     std::size_t idx_len, uint8_t *out_df_uuid,
+                     std::size_t out_df_uuid_len);
+
+/**
+ * @brief Releases a join session.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] session_uuid The UUID of the session.
+ * @param [in] session_uuid_len The length of the session UUID.
+ * @return ErrorCode
+ */
+ErrorCode end_join(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                   const uint8_t *session_uuid, std::size_t session_uuid_len);
+
+/**
+ * @brief Closes the scan.
+ *
+ * @param [in] ctx_uuid The UUID of the context.
+ * @param [in] ctx_uuid_len The length of the context UUID.
+ * @param [in] scan_uuid The UUID of the scan.
+ * @param [in] scan_uuid_len The length of the scan UUID.
+ * @return ErrorCode
+ */
+ErrorCode close_policy_scan(const uint8_t *ctx_uuid, std::size_t ctx_uuid_len,
+                            const uint8_t *scan_uuid,
+                            std::size_t scan_uuid_len);
 }
 #endif
@@ -1,9 +1,12 @@
-use std::sync::LazyLock;
+use std::sync::{Arc, LazyLock};
 
 use picachv_core::dataframe::PolicyGuardedDataFrame;
 use picachv_core::io::JsonIO;
+use picachv_core::policy::PolicyLabel;
+use picachv_core::profiler::Phase;
+use picachv_core::{counters, memory};
 use picachv_error::{PicachvError, PicachvResult};
-use picachv_message::{ExprArgument, PlanArgument};
+use picachv_message::{ExprArgument, JoinType, PlanArgument};
 use picachv_monitor::MONITOR_INSTANCE;
 use prost::Message;
 use spin::RwLock;
@@ -205,7 +208,6 @@ pub unsafe extern "C" fn reify_expression(
     ErrorCode::Success
 }
 
-// FIXME: Should be a select vector!
 #[no_mangle]
 pub unsafe extern "C" fn create_slice(
     ctx_uuid: *const u8,
@@ -350,6 +352,15 @@ pub unsafe extern "C" fn debug_print_df(
     ErrorCode::Success
 }
 
+#[no_mangle]
+pub extern "C" fn debug_print_counters() -> ErrorCode {
+    for (counter, value) in counters::snapshot() {
+        println!("{}: {value}", counter.name());
+    }
+
+    ErrorCode::Success
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn register_policy_dataframe_from_row_group(
     ctx_uuid: *const u8,
@@ -408,6 +419,155 @@ pub unsafe extern "C" fn enable_profiling(
     ErrorCode::Success
 }
 
+/// Copies the profile of the context into `output` as JSON.
+///
+/// `output_len` holds the size of `output` and is set to the size of the profile; see
+/// [`copy_json_out`].
+#[no_mangle]
+pub unsafe extern "C" fn get_profile(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    trace: bool,
+    output: *mut u8,
+    output_len: *mut usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    let profile = match trace {
+        true => try_execute!(ctx.get_profile_trace()),
+        false => try_execute!(ctx.get_profile()),
+    };
+
+    copy_json_out(&profile, output, output_len)
+}
+
+/// Drops the spans recorded by the profiler of the context, e.g., between two queries.
+#[no_mangle]
+pub unsafe extern "C" fn reset_profile(ctx_uuid: *const u8, ctx_uuid_len: usize) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    try_execute!(ctx.reset_profile());
+
+    ErrorCode::Success
+}
+
+/// Copies the time spent in each phase of the queries, summed over all the contexts, into
+/// `output` as a JSON object of nanoseconds keyed by the names of the phases. The phases are
+/// only recorded by the contexts with profiling enabled.
+///
+/// `output_len` is handled as in [`get_profile`].
+#[no_mangle]
+pub unsafe extern "C" fn get_profile_phases(output: *mut u8, output_len: *mut usize) -> ErrorCode {
+    let json = Phase::to_json(&MONITOR_INSTANCE.read().get_profile_phases());
+
+    copy_json_out(&json, output, output_len)
+}
+
+/// Drops the spans recorded by the profilers of all the contexts.
+#[no_mangle]
+pub extern "C" fn reset_profiles() -> ErrorCode {
+    MONITOR_INSTANCE.read().reset_profiles();
+
+    ErrorCode::Success
+}
+
+/// Copies the memory statistics of the process into `output` as a JSON object; see
+/// [`picachv_core::memory::MemoryStats`].
+///
+/// `output_len` is handled as in [`get_profile`].
+#[no_mangle]
+pub unsafe extern "C" fn get_memory_stats(output: *mut u8, output_len: *mut usize) -> ErrorCode {
+    let json = try_execute!(memory::stats()).to_json();
+
+    copy_json_out(&json, output, output_len)
+}
+
+/// Copies the memory used by the process and the number of objects kept by the context into
+/// `output` as a JSON object; see [`picachv_core::memory::ContextMemoryStats`].
+///
+/// `output_len` is handled as in [`get_profile`].
+#[no_mangle]
+pub unsafe extern "C" fn memory_stats(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    output: *mut u8,
+    output_len: *mut usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    let json = try_execute!(ctx.memory_stats()).to_json();
+
+    copy_json_out(&json, output, output_len)
+}
+
+/// Starts or stops sampling allocations. Requires the `heap_profiling` feature and
+/// `_RJEM_MALLOC_CONF=prof:true`; see [`picachv_core::memory`].
+#[no_mangle]
+pub extern "C" fn set_heap_profiling(active: bool) -> ErrorCode {
+    try_execute!(memory::set_heap_profiling(active));
+
+    ErrorCode::Success
+}
+
+/// Drops the allocations sampled so far.
+#[no_mangle]
+pub extern "C" fn reset_heap_profile() -> ErrorCode {
+    try_execute!(memory::reset_heap_profile());
+
+    ErrorCode::Success
+}
+
+/// Writes the allocations sampled so far to `path` in the format of `jeprof`.
+#[no_mangle]
+pub unsafe extern "C" fn dump_heap_profile(path: *const u8, path_len: usize) -> ErrorCode {
+    let path = try_execute!(
+        String::from_utf8(std::slice::from_raw_parts(path, path_len).to_vec()),
+        ErrorCode::SerializeError
+    );
+
+    try_execute!(memory::dump_heap_profile(path));
+
+    ErrorCode::Success
+}
+
+/// Copies the process-wide counters into `output` as a JSON object keyed by their names.
+///
+/// `output_len` is handled as in [`get_profile`].
+#[no_mangle]
+pub unsafe extern "C" fn get_counters(output: *mut u8, output_len: *mut usize) -> ErrorCode {
+    let json = counters::to_json();
+
+    copy_json_out(&json, output, output_len)
+}
+
+#[no_mangle]
+pub extern "C" fn reset_counters() -> ErrorCode {
+    counters::reset();
+
+    ErrorCode::Success
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn enable_tracing(
     ctx_uuid: *const u8,
@@ -456,3 +616,420 @@ pub unsafe extern "C" fn select_group(
 
     ErrorCode::Success
 }
+
+/// Opens a persistent scan over a policy Parquet file. The footer is parsed only once
+/// and the returned scan can be read by [`next_row_group`] from many threads.
+///
+/// `downgrade`, if not null, is a JSON-encoded [`PolicyLabel`] that the query will downgrade
+/// the policies by; the scan then fails before any row group is read if the policy
+/// statistics show a policy that it cannot downgrade.
+#[no_mangle]
+pub unsafe extern "C" fn open_policy_scan(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    path: *const u8,
+    path_len: usize,
+    projection: *const usize,
+    projection_len: usize,
+    downgrade: *const u8,
+    downgrade_len: usize,
+    scan_uuid: *mut u8,
+    scan_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if scan_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let path = try_execute!(
+        String::from_utf8(std::slice::from_raw_parts(path, path_len).to_vec()),
+        ErrorCode::SerializeError
+    );
+    let projection = try_execute!(slice_or_empty(projection, projection_len));
+    let downgrade = match downgrade.is_null() {
+        true => None,
+        false => Some(Arc::new(try_execute!(PolicyLabel::from_json_bytes(
+            std::slice::from_raw_parts(downgrade, downgrade_len)
+        )))),
+    };
+
+    let uuid = try_execute!(ctx.open_policy_scan(path, projection, downgrade.as_ref()));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), scan_uuid, scan_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Reads a row group from a scan opened by [`open_policy_scan`] and registers it as a
+/// policy dataframe.
+#[no_mangle]
+pub unsafe extern "C" fn next_row_group(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    scan_uuid: *const u8,
+    scan_uuid_len: usize,
+    row_group: usize,
+    selection: *const bool,
+    selection_len: usize,
+    df_uuid: *mut u8,
+    df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let scan_id = try_execute!(recover_uuid(scan_uuid, scan_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let selection = match selection.is_null() {
+        true => None,
+        false => Some(std::slice::from_raw_parts(selection, selection_len)),
+    };
+
+    let uuid = try_execute!(ctx.next_row_group(scan_id, row_group, selection));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), df_uuid, df_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Reads the logical rows `start_row..start_row + len` from a scan opened by
+/// [`open_policy_scan`] and registers them as a policy dataframe.
+#[no_mangle]
+pub unsafe extern "C" fn read_policy_rows(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    scan_uuid: *const u8,
+    scan_uuid_len: usize,
+    start_row: usize,
+    len: usize,
+    selection: *const bool,
+    df_uuid: *mut u8,
+    df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let scan_id = try_execute!(recover_uuid(scan_uuid, scan_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let selection = match selection.is_null() {
+        true => None,
+        false => Some(std::slice::from_raw_parts(selection, len)),
+    };
+
+    let uuid = try_execute!(ctx.read_policy_rows(scan_id, start_row, len, selection));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), df_uuid, df_uuid_len);
+
+    ErrorCode::Success
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn close_policy_scan(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    scan_uuid: *const u8,
+    scan_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let scan_id = try_execute!(recover_uuid(scan_uuid, scan_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    try_execute!(ctx.close_policy_scan(scan_id));
+
+    ErrorCode::Success
+}
+
+/// Joins two dataframes where the `i`-th joined row consists of the `left_idx[i]`-th row of
+/// the left dataframe and the `right_idx[i]`-th row of the right one.
+///
+/// The index arrays are read in place; unlike `execute_epilogue` with a `JoinInformation`,
+/// nothing is serialized or copied. `join_type` is a `JoinType` of the protobuf definition.
+#[no_mangle]
+pub unsafe extern "C" fn join_by_idx(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    lhs_uuid: *const u8,
+    lhs_uuid_len: usize,
+    rhs_uuid: *const u8,
+    rhs_uuid_len: usize,
+    left_columns: *const usize,
+    left_columns_len: usize,
+    right_columns: *const usize,
+    right_columns_len: usize,
+    left_idx: *const usize,
+    right_idx: *const usize,
+    idx_len: usize,
+    join_type: i32,
+    out_df_uuid: *mut u8,
+    out_df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let lhs_id = try_execute!(recover_uuid(lhs_uuid, lhs_uuid_len));
+    let join_type = try_execute!(recover_join_type(join_type));
+    let rhs_id = try_execute!(recover_uuid(rhs_uuid, rhs_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if out_df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let left_columns = try_execute!(slice_or_empty(left_columns, left_columns_len));
+    let right_columns = try_execute!(slice_or_empty(right_columns, right_columns_len));
+    let left_idx = try_execute!(slice_or_empty(left_idx, idx_len));
+    let right_idx = try_execute!(slice_or_empty(right_idx, idx_len));
+
+    let uuid = try_execute!(ctx.join_by_idx(
+        lhs_id,
+        rhs_id,
+        left_columns,
+        right_columns,
+        left_idx,
+        right_idx,
+        join_type
+    ));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), out_df_uuid, out_df_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Pins the build side of a join. The probe side is then streamed with [`join_probe`] and the
+/// session is released with [`end_join`].
+#[no_mangle]
+pub unsafe extern "C" fn begin_join(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    lhs_uuid: *const u8,
+    lhs_uuid_len: usize,
+    left_columns: *const usize,
+    left_columns_len: usize,
+    right_columns: *const usize,
+    right_columns_len: usize,
+    join_type: i32,
+    session_uuid: *mut u8,
+    session_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let lhs_id = try_execute!(recover_uuid(lhs_uuid, lhs_uuid_len));
+    let join_type = try_execute!(recover_join_type(join_type));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if session_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let left_columns = try_execute!(slice_or_empty(left_columns, left_columns_len));
+    let right_columns = try_execute!(slice_or_empty(right_columns, right_columns_len));
+
+    let uuid = try_execute!(ctx.begin_join(lhs_id, left_columns, right_columns, join_type));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), session_uuid, session_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Joins a probe vector with the build side pinned by [`begin_join`].
+#[no_mangle]
+pub unsafe extern "C" fn join_probe(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    session_uuid: *const u8,
+    session_uuid_len: usize,
+    rhs_uuid: *const u8,
+    rhs_uuid_len: usize,
+    left_idx: *const usize,
+    right_idx: *const usize,
+    idx_len: usize,
+    out_df_uuid: *mut u8,
+    out_df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let session_id = try_execute!(recover_uuid(session_uuid, session_uuid_len));
+    let rhs_id = try_execute!(recover_uuid(rhs_uuid, rhs_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if out_df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let left_idx = try_execute!(slice_or_empty(left_idx, idx_len));
+    let right_idx = try_execute!(slice_or_empty(right_idx, idx_len));
+
+    let uuid = try_execute!(ctx.join_probe(session_id, rhs_id, left_idx, right_idx));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), out_df_uuid, out_df_uuid_len);
+
+    ErrorCode::Success
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn end_join(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    session_uuid: *const u8,
+    session_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let session_id = try_execute!(recover_uuid(session_uuid, session_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    try_execute!(ctx.end_join(session_id));
+
+    ErrorCode::Success
+}
+
+fn recover_join_type(join_type: i32) -> PicachvResult<JoinType> {
+    JoinType::try_from(join_type).map_err(|_| {
+        PicachvError::InvalidOperation(format!("Invalid join type {join_type}").into())
+    })
+}
+
+/// Filters a dataframe with a bitmap where bit `i % 8` of byte `i / 8` is set if the `i`-th
+/// row is kept, as in an Arrow validity bitmap.
+#[no_mangle]
+pub unsafe extern "C" fn filter_by_bitmap(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    df_uuid: *const u8,
+    df_uuid_len: usize,
+    bitmap: *const u8,
+    bitmap_len: usize,
+    out_df_uuid: *mut u8,
+    out_df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let df_id = try_execute!(recover_uuid(df_uuid, df_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if out_df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let bitmap = try_execute!(slice_or_empty(bitmap, bitmap_len));
+
+    let uuid = try_execute!(ctx.filter_by_bitmap(df_id, bitmap));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), out_df_uuid, out_df_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Filters a dataframe with the ascending indices of the rows to keep, e.g., a DuckDB
+/// selection vector.
+#[no_mangle]
+pub unsafe extern "C" fn filter_by_selection(
+    ctx_uuid: *const u8,
+    ctx_uuid_len: usize,
+    df_uuid: *const u8,
+    df_uuid_len: usize,
+    selection: *const u32,
+    selection_len: usize,
+    out_df_uuid: *mut u8,
+    out_df_uuid_len: usize,
+) -> ErrorCode {
+    let ctx_id = try_execute!(recover_uuid(ctx_uuid, ctx_uuid_len));
+    let df_id = try_execute!(recover_uuid(df_uuid, df_uuid_len));
+
+    let ctx = MONITOR_INSTANCE.read();
+    let ctx = ctx.get_ctx();
+    let ctx = match ctx.get(&ctx_id) {
+        Some(ctx) => ctx,
+        None => return ErrorCode::NoEntry,
+    };
+
+    if out_df_uuid_len != 16 {
+        return ErrorCode::InvalidOperation;
+    }
+
+    let selection = try_execute!(slice_or_empty(selection, selection_len));
+
+    let uuid = try_execute!(ctx.filter_by_selection(df_id, selection));
+    std::ptr::copy_nonoverlapping(uuid.to_bytes_le().as_ptr(), out_df_uuid, out_df_uuid_len);
+
+    ErrorCode::Success
+}
+
+/// Copies `json` into `output`, which holds `*output_len` bytes, and sets `*output_len` to the
+/// size of `json`. If `json` does not fit, nothing is copied and `InvalidOperation` is returned
+/// so that the caller can retry with a larger buffer.
+unsafe fn copy_json_out(json: &str, output: *mut u8, output_len: *mut usize) -> ErrorCode {
+    let capacity = *output_len;
+    *output_len = json.len();
+    if json.len() > capacity {
+        *LAST_ERROR.write() = format!(
+            "The output needs {} bytes but the buffer holds {capacity}.",
+            json.len()
+        );
+        return ErrorCode::InvalidOperation;
+    }
+
+    std::ptr::copy_nonoverlapping(json.as_ptr(), output, json.len());
+
+    ErrorCode::Success
+}
+
+/// `std::slice::from_raw_parts` does not accept null pointers even for empty slices, so a null
+/// `ptr` stands for the empty slice; it is an error if `len` is not zero.
+unsafe fn slice_or_empty<'a, T>(ptr: *const T, len: usize) -> PicachvResult<&'a [T]> {
+    match ptr.is_null() {
+        true if len > 0 => Err(PicachvError::InvalidOperation(
+            format!("A null pointer was given for {len} elements.").into(),
+        )),
+        true => Ok(&[]),
+        false => Ok(std::slice::from_raw_parts(ptr, len)),
+    }
+}
@@ -1,4 +1,11 @@
+use std::sync::Arc;
+use std::time::Duration;
+
+use picachv_core::counters::{self, Counter};
 use picachv_core::dataframe::PolicyGuardedDataFrame;
+use picachv_core::memory::{self, ContextMemoryStats, MemoryStats};
+use picachv_core::policy::PolicyLabel;
+use picachv_core::profiler::Phase;
 use picachv_error::{PicachvError, PicachvResult};
 use picachv_message::{ExprArgument, PlanArgument};
 use picachv_monitor::MONITOR_INSTANCE;
@@ -28,14 +35,54 @@ pub fn open_new() -> PicachvResult<Uuid> {
     MONITOR_INSTANCE.write().open_new()
 }
 
+/// Returns the process-wide counters; see [`picachv_core::counters`].
+pub fn get_counters() -> Vec<(Counter, u64)> {
+    counters::snapshot()
+}
+
+pub fn reset_counters() {
+    counters::reset()
+}
+
+/// Returns the time spent in each phase by all the contexts; see
+/// [`picachv_core::profiler::PicachvProfiler::phases`].
+pub fn get_profile_phases() -> Vec<(Phase, Duration)> {
+    MONITOR_INSTANCE.read().get_profile_phases()
+}
+
+pub fn reset_profiles() {
+    MONITOR_INSTANCE.read().reset_profiles()
+}
+
+/// Returns the memory statistics of the process; see [`picachv_core::memory`].
+pub fn get_memory_stats() -> PicachvResult<MemoryStats> {
+    memory::stats()
+}
+
+pub fn set_heap_profiling(active: bool) -> PicachvResult<()> {
+    memory::set_heap_profiling(active)
+}
+
+pub fn reset_heap_profile() -> PicachvResult<()> {
+    memory::reset_heap_profile()
+}
+
+pub fn dump_heap_profile(path: &str) -> PicachvResult<()> {
+    memory::dump_heap_profile(path)
+}
+
 impl_ctx_api!(build_expr, expr_from_args, ctx_id: Uuid, expr_arg: ExprArgument => Uuid);
 impl_ctx_api!(register_policy_dataframe, register_policy_dataframe, ctx_id: Uuid, df: PolicyGuardedDataFrame => Uuid);
 impl_ctx_api!(register_policy_dataframe_json, register_policy_dataframe_json, ctx_id: Uuid, path: &str => Uuid);
 impl_ctx_api!(register_policy_dataframe_bin, register_policy_dataframe_bin, ctx_id: Uuid, path: &str => Uuid);
-impl_ctx_api!(register_policy_dataframe_parquet, register_policy_dataframe_parquet, ctx_id: Uuid, path: &str, projection: &[usize], predicate: Option<&[bool]> => Uuid);
+impl_ctx_api!(register_policy_dataframe_parquet, register_policy_dataframe_parquet, ctx_id: Uuid, path: &str, projection: &[usize], predicate: Option<&[bool]>, downgrade: Option<&Arc<PolicyLabel>> => Uuid);
 impl_ctx_api!(execute_epilogue, execute_epilogue,
     ctx_id: Uuid, df_uuid: Uuid, plan_arg: Option<PlanArgument> => Uuid);
 impl_ctx_api!(finalize, finalize, ctx_id: Uuid, df_uuid: Uuid => ());
 impl_ctx_api!(reify_expression, reify_expression, ctx_id: Uuid, expr_uuid: Uuid, val: &[u8] => ());
 impl_ctx_api!(enable_tracing, enable_tracing, ctx_id: Uuid, enable: bool => ());
 impl_ctx_api!(enable_profiling, enable_profiling, ctx_id: Uuid, enable: bool => ());
+impl_ctx_api!(get_profile, get_profile, ctx_id: Uuid, => String);
+impl_ctx_api!(get_profile_trace, get_profile_trace, ctx_id: Uuid, => String);
+impl_ctx_api!(reset_profile, reset_profile, ctx_id: Uuid, => ());
+impl_ctx_api!(memory_stats, memory_stats, ctx_id: Uuid, => ContextMemoryStats);
@@ -0,0 +1,354 @@
+//! Microbenchmarks for the kernels of `picachv-core`.
+//!
+//! The kernels are parameterized over the number of rows, the fraction of cells carrying a
+//! non-clean policy (the density) and, for the lattice operations, the length of the policy
+//! chains. See `benchmark/kernels-baseline.sh` for saving and comparing baselines.
+
+use std::hint::black_box;
+use std::sync::Arc;
+use std::time::Instant;
+
+use arrow_array::{ArrayRef, Int32Array, RecordBatch};
+use criterion::{criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion, Throughput};
+use picachv_core::constants::GroupByMethod;
+use picachv_core::dataframe::{
+    apply_transform, has_policy, PolicyGuardedColumn, PolicyGuardedDataFrame, PolicyRef,
+};
+use picachv_core::expr::{convert_record_batch, fold_on_groups};
+use picachv_core::policy::{
+    AggOps, AggType, Policy, PolicyLabel, TransformOps, TransformType, UnaryTransformType,
+};
+use picachv_core::profiler::{now, profile, PicachvProfiler};
+use picachv_core::{arrays_into_bytes, record_batch_from_bytes, Arenas, GroupInformation};
+use picachv_message::transform_info::Information;
+use picachv_message::{
+    ContextOptions, FilterInformation, JoinInformation, JoinType, ReorderInformation,
+    TransformInfo, UnionInformation,
+};
+use uuid::Uuid;
+
+const ROWS: &[usize] = &[2048, 1 << 16, 1 << 20];
+const DENSITY: &[f64] = &[0.0, 0.01, 0.1];
+const DEPTH: &[usize] = &[1, 4, 16];
+
+/// The label allowing the aggregation used throughout the benchmarks.
+fn agg_label() -> Arc<PolicyLabel> {
+    Arc::new(PolicyLabel::PolicyAgg {
+        ops: AggOps(vec![AggType {
+            how: GroupByMethod::Sum,
+            group_size: 5,
+        }]),
+    })
+}
+
+/// A valid chain of `depth` transform labels. Each label is allowed fewer operations than the
+/// next one, so every label flows to its predecessor.
+fn chain(depth: usize) -> PolicyRef {
+    (0..depth)
+        .rev()
+        .fold(Arc::new(Policy::PolicyClean), |next, i| {
+            let ops = (0..=i)
+                .map(|j| {
+                    TransformType::Unary(UnaryTransformType {
+                        name: format!("op{j}"),
+                    })
+                })
+                .collect();
+
+            Arc::new(Policy::PolicyDeclassify {
+                label: Arc::new(PolicyLabel::PolicyTransform {
+                    ops: TransformOps(ops),
+                }),
+                next,
+            })
+        })
+}
+
+/// `rows` policies where roughly `density` of them are `policy`, spread evenly.
+fn policies(rows: usize, density: f64, policy: &PolicyRef) -> Vec<PolicyRef> {
+    let clean = Arc::new(Policy::PolicyClean);
+
+    (0..rows)
+        .map(|i| match has_policy(i, density) {
+            true => policy.clone(),
+            false => clean.clone(),
+        })
+        .collect()
+}
+
+fn agg_policy() -> PolicyRef {
+    Arc::new(Policy::PolicyDeclassify {
+        label: agg_label(),
+        next: Arc::new(Policy::PolicyClean),
+    })
+}
+
+fn column(rows: usize, density: f64) -> PolicyGuardedColumn {
+    PolicyGuardedColumn::new_with_density(rows, 0, density, &agg_policy()).unwrap()
+}
+
+fn dataframe(rows: usize, density: f64, columns: usize) -> Arc<PolicyGuardedDataFrame> {
+    let column = Arc::new(column(rows, density));
+    Arc::new(PolicyGuardedDataFrame::new(vec![column; columns]))
+}
+
+fn every_other(rows: usize) -> Vec<bool> {
+    (0..rows).map(|i| i % 2 == 0).collect()
+}
+
+fn bench_column(c: &mut Criterion) {
+    let mut group = c.benchmark_group("column");
+
+    for &rows in ROWS {
+        group.throughput(Throughput::Elements(rows as u64));
+
+        for &density in DENSITY {
+            let id = format!("{rows}/{density}");
+            let input = policies(rows, density, &agg_policy());
+            group.bench_with_input(
+                BenchmarkId::new("new_from_iter", &id),
+                &input,
+                |b, input| b.iter(|| PolicyGuardedColumn::new_from_iter(input).unwrap()),
+            );
+
+            let col = column(rows, density);
+            let idx = (0..rows).rev().step_by(3).collect::<Vec<_>>();
+            group.bench_with_input(BenchmarkId::new("new_from_slice", &id), &idx, |b, idx| {
+                b.iter(|| col.new_from_slice(idx).unwrap())
+            });
+
+            let pred = every_other(rows);
+            group.bench_with_input(BenchmarkId::new("filter", &id), &pred, |b, pred| {
+                b.iter(|| col.filter(pred).unwrap())
+            });
+
+            let gi = GroupInformation {
+                first: 0,
+                groups: (0..rows).step_by(7).collect(),
+                hash: None,
+            };
+            group.bench_with_input(BenchmarkId::new("groups", &id), &gi, |b, gi| {
+                b.iter(|| col.groups(gi).unwrap())
+            });
+        }
+    }
+
+    group.finish();
+}
+
+fn bench_lattice(c: &mut Criterion) {
+    let mut group = c.benchmark_group("lattice");
+
+    for &depth in DEPTH {
+        let (lhs, rhs) = (chain(depth), Arc::new((*chain(depth)).clone()));
+        group.bench_with_input(BenchmarkId::new("join", depth), &depth, |b, _| {
+            b.iter(|| black_box(&lhs).join(black_box(&rhs)).unwrap())
+        });
+        group.bench_with_input(BenchmarkId::new("le", depth), &depth, |b, _| {
+            b.iter(|| black_box(&lhs).le(black_box(&rhs)).unwrap())
+        });
+    }
+
+    // Only a chain of length one can be downgraded by a single label.
+    let (policy, label) = (agg_policy(), agg_label());
+    group.bench_function("downgrade", |b| {
+        b.iter(|| black_box(&policy).downgrade(black_box(&label)).unwrap())
+    });
+
+    for &rows in ROWS {
+        group.throughput(Throughput::Elements(rows as u64));
+
+        for &density in DENSITY {
+            let input = policies(rows, density, &agg_policy());
+            group.bench_with_input(
+                BenchmarkId::new("fold_on_groups", format!("{rows}/{density}")),
+                &input,
+                |b, input| b.iter(|| fold_on_groups(input, GroupByMethod::Sum).unwrap()),
+            );
+        }
+    }
+
+    group.finish();
+}
+
+fn bench_io(c: &mut Criterion) {
+    let mut group = c.benchmark_group("io");
+    let dir = std::env::temp_dir().join(format!("picachv-bench-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+
+    for &rows in ROWS {
+        group.throughput(Throughput::Elements(rows as u64));
+
+        let values: ArrayRef = Arc::new(Int32Array::from_iter_values(0..rows as i32));
+        let rb = RecordBatch::try_from_iter([("a", values.clone())]).unwrap();
+        group.bench_with_input(
+            BenchmarkId::new("convert_record_batch", rows),
+            &rb,
+            |b, rb| b.iter(|| convert_record_batch(rb).unwrap()),
+        );
+
+        let bytes = arrays_into_bytes(vec![values]).unwrap();
+        group.bench_with_input(
+            BenchmarkId::new("record_batch_from_bytes", rows),
+            &bytes,
+            |b, bytes| b.iter(|| record_batch_from_bytes(bytes).unwrap()),
+        );
+
+        for &density in DENSITY {
+            let path = dir.join(format!("{rows}-{density}.parquet"));
+            dataframe(rows, density, 4).to_parquet(&path).unwrap();
+            group.bench_with_input(
+                BenchmarkId::new("from_parquet", format!("{rows}/{density}")),
+                &path,
+                |b, path| {
+                    b.iter(|| {
+                        PolicyGuardedDataFrame::from_parquet(path, &[0, 1, 2, 3], None).unwrap()
+                    })
+                },
+            );
+        }
+    }
+
+    group.finish();
+    let _ = std::fs::remove_dir_all(&dir);
+}
+
+fn bench_transform(c: &mut Criterion) {
+    let mut group = c.benchmark_group("apply_transform");
+    let options = ContextOptions::default();
+
+    // `Information::GroupBy` is not applied through `apply_transform`; see `Plan::Aggregation`.
+    for &rows in ROWS {
+        group.throughput(Throughput::Elements(rows as u64));
+
+        for &density in DENSITY {
+            let id = format!("{rows}/{density}");
+            let df = dataframe(rows, density, 4);
+            // The arena is rebuilt for every run so that no run reuses the output of another.
+            let setup = |dfs: &[&Arc<PolicyGuardedDataFrame>]| {
+                let arenas = Arenas::new();
+                let uuids = dfs
+                    .iter()
+                    .map(|&df| arenas.df_arena.write().insert_arc(df.clone()).unwrap())
+                    .collect::<Vec<_>>();
+                (arenas, uuids)
+            };
+            let bytes = |uuid: &Uuid| uuid.to_bytes_le().to_vec();
+
+            let filter = FilterInformation {
+                filter: every_other(rows),
+                ..Default::default()
+            };
+            group.bench_function(BenchmarkId::new("filter", &id), |b| {
+                b.iter_batched(
+                    || setup(&[&df]),
+                    |(arenas, uuids)| {
+                        let info = Information::Filter(filter.clone());
+                        apply_transform(&arenas.df_arena, uuids[0], transform(info), &options)
+                            .unwrap()
+                    },
+                    BatchSize::LargeInput,
+                )
+            });
+
+            let rhs = dataframe(rows, density, 2);
+            group.bench_function(BenchmarkId::new("join", &id), |b| {
+                b.iter_batched(
+                    || setup(&[&df, &rhs]),
+                    |(arenas, uuids)| {
+                        let info = Information::Join(JoinInformation {
+                            lhs_df_uuid: bytes(&uuids[0]),
+                            rhs_df_uuid: bytes(&uuids[1]),
+                            left_columns: vec![0, 1, 2, 3],
+                            right_columns: vec![0, 1],
+                            left_rows: (0..rows as u64).collect(),
+                            right_rows: (0..rows as u64).rev().collect(),
+                            join_type: JoinType::Inner as i32,
+                            ..Default::default()
+                        });
+                        apply_transform(&arenas.df_arena, uuids[0], transform(info), &options)
+                            .unwrap()
+                    },
+                    BatchSize::LargeInput,
+                )
+            });
+
+            let perm = (0..rows as u64).rev().collect::<Vec<_>>();
+            group.bench_function(BenchmarkId::new("reorder", &id), |b| {
+                b.iter_batched(
+                    || setup(&[&df]),
+                    |(arenas, uuids)| {
+                        let info = Information::Reorder(ReorderInformation {
+                            perm: perm.clone(),
+                            limit: None,
+                        });
+                        apply_transform(&arenas.df_arena, uuids[0], transform(info), &options)
+                            .unwrap()
+                    },
+                    BatchSize::LargeInput,
+                )
+            });
+
+            // DuckDB vectors.
+            let parts = (0..rows.div_ceil(2048))
+                .map(|_| dataframe(2048, density, 4))
+                .collect::<Vec<_>>();
+            group.bench_function(BenchmarkId::new("union", &id), |b| {
+                b.iter_batched(
+                    || setup(&parts.iter().collect::<Vec<_>>()),
+                    |(arenas, uuids)| {
+                        let info = Information::Union(UnionInformation {
+                            df_uuids: uuids.iter().map(bytes).collect(),
+                        });
+                        apply_transform(&arenas.df_arena, uuids[0], transform(info), &options)
+                            .unwrap()
+                    },
+                    BatchSize::LargeInput,
+                )
+            });
+        }
+    }
+
+    group.finish();
+}
+
+/// The cost of a span taken through [`profile`] with an installed profiler, next to that of
+/// reading the clock. A span reads the clock twice; the rest of it should stay within a few
+/// nanoseconds.
+fn bench_profiler(c: &mut Criterion) {
+    let mut group = c.benchmark_group("profiler");
+    group.bench_function("now", |b| b.iter(now));
+
+    let profiler = Arc::new(PicachvProfiler::new());
+    group.bench_function("span", |b| {
+        b.iter_custom(|iters| {
+            // Keeps the buffer from growing across samples.
+            profiler.reset();
+            profiler.install(|| {
+                let start = Instant::now();
+                for i in 0..iters {
+                    profile(|| black_box(i), "span".into());
+                }
+                start.elapsed()
+            })
+        })
+    });
+
+    group.finish();
+}
+
+fn transform(information: Information) -> TransformInfo {
+    TransformInfo {
+        information: Some(information),
+    }
+}
+
+criterion_group!(
+    benches,
+    bench_column,
+    bench_lattice,
+    bench_io,
+    bench_transform,
+    bench_profiler
+);
+criterion_main!(benches);
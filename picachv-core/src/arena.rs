@@ -6,6 +6,8 @@ use ahash::{HashMap, HashMapExt};
 use picachv_error::{PicachvError, PicachvResult};
 use uuid::Uuid;
 
+use crate::counters::{self, Counter};
+
 // FIXME: This type is problematic. Here we need to use interior mutability!
 // Guard the `Arc<T>` with a `RwLock`.
 pub type ArenaType<T> = HashMap<Uuid, Arc<T>>;
@@ -28,6 +30,7 @@ where
     #[inline]
     pub fn insert(&mut self, object: T) -> PicachvResult<Uuid> {
         let uuid = Uuid::new_v4();
+        counters::incr(Counter::ArenaInserts);
 
         self.inner.insert(uuid, Arc::new(object));
         Ok(uuid)
@@ -36,11 +39,23 @@ where
     #[inline]
     pub fn insert_arc(&mut self, plan: Arc<T>) -> PicachvResult<Uuid> {
         let uuid = Uuid::new_v4();
+        counters::incr(Counter::ArenaInserts);
 
         self.inner.insert(uuid, plan);
         Ok(uuid)
     }
 
+    /// The number of objects in the arena.
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.inner.len()
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.inner.is_empty()
+    }
+
     #[inline]
     pub fn contains_key(&self, uuid: &Uuid) -> bool {
         self.inner.contains_key(uuid)
@@ -0,0 +1,151 @@
+//! Always-on counters for the work done by the policy checks.
+//!
+//! Unlike the profiler, the counters do not depend on `enable_profiling` and are bumped on the
+//! hot paths of every context, so they are meant to be as cheap as a relaxed atomic add. Each
+//! thread adds to one of [`SHARDS`] cache-line aligned shards, and the shards are only summed
+//! when the counters are read.
+
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+
+use serde_json::{Map, Value};
+
+macro_rules! define_counters {
+    ($($(#[$doc:meta])* $variant:ident => $name:literal,)*) => {
+        /// The work being counted.
+        #[repr(usize)]
+        #[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+        pub enum Counter {
+            $($(#[$doc])* $variant,)*
+        }
+
+        impl Counter {
+            /// All the counters, in the order of their discriminants.
+            pub const ALL: &'static [Counter] = &[$(Counter::$variant,)*];
+
+            pub fn name(self) -> &'static str {
+                match self {
+                    $(Counter::$variant => $name,)*
+                }
+            }
+        }
+    };
+}
+
+define_counters! {
+    /// Rows checked by a scan with a pushed-down selection or projection.
+    RowsScanned => "rows_scanned",
+    /// Rows checked by a `WHERE` predicate.
+    RowsSelected => "rows_selected",
+    /// Rows checked by a projection.
+    RowsProjected => "rows_projected",
+    /// Rows checked by an aggregation.
+    RowsAggregated => "rows_aggregated",
+    /// Rows checked by an `hstack`.
+    RowsHstacked => "rows_hstacked",
+    /// Rows of the dataframes that are filtered by a selection.
+    RowsFiltered => "rows_filtered",
+    /// Rows produced by joins.
+    RowsJoined => "rows_joined",
+    /// Cells whose policy has been evaluated against an expression.
+    PoliciesEvaluated => "policies_evaluated",
+    /// The number of distinct policies of each chunk built from scratch, summed over the
+    /// chunks, so a policy shared by several chunks counts once per chunk.
+    ChunkPolicies => "chunk_policies",
+    /// Calls to [`crate::policy::Policy::join`].
+    PolicyJoins => "policy_joins",
+    /// Calls to [`crate::policy::Policy::le`].
+    PolicyLe => "policy_le",
+    /// Calls to [`crate::policy::Policy::downgrade`].
+    PolicyDowngrades => "policy_downgrades",
+    /// Objects inserted into the arenas.
+    ArenaInserts => "arena_inserts",
+    /// Bytes of the values used to reify expressions.
+    BytesReified => "bytes_reified",
+    /// Bytes of Arrow IPC streams decoded.
+    IpcBytesDecoded => "ipc_bytes_decoded",
+}
+
+/// The number of shards; threads beyond this share shards.
+pub const SHARDS: usize = 64;
+
+/// The counters of one shard, on cache lines of their own.
+#[repr(align(128))]
+struct Shard([AtomicU64; Counter::ALL.len()]);
+
+static COUNTERS: [Shard; SHARDS] =
+    [const { Shard([const { AtomicU64::new(0) }; Counter::ALL.len()]) }; SHARDS];
+
+static NEXT_SHARD: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    /// The shard the current thread adds to.
+    static SHARD: usize = NEXT_SHARD.fetch_add(1, Ordering::Relaxed) % SHARDS;
+}
+
+/// Adds `n` to `counter`.
+#[inline]
+pub fn add(counter: Counter, n: u64) {
+    let shard = SHARD.with(|shard| *shard);
+    COUNTERS[shard].0[counter as usize].fetch_add(n, Ordering::Relaxed);
+}
+
+#[inline]
+pub fn incr(counter: Counter) {
+    add(counter, 1)
+}
+
+/// Returns the value of `counter` summed over all the threads.
+pub fn get(counter: Counter) -> u64 {
+    COUNTERS
+        .iter()
+        .map(|shard| shard.0[counter as usize].load(Ordering::Relaxed))
+        .sum()
+}
+
+/// Returns the value of every counter in the order of [`Counter::ALL`].
+pub fn snapshot() -> Vec<(Counter, u64)> {
+    Counter::ALL.iter().map(|&c| (c, get(c))).collect()
+}
+
+/// Sets all the counters to zero. Additions made concurrently may or may not be kept.
+pub fn reset() {
+    for shard in COUNTERS.iter() {
+        for counter in shard.0.iter() {
+            counter.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Returns the counters as a JSON object keyed by their names.
+pub fn to_json() -> String {
+    snapshot()
+        .into_iter()
+        .map(|(c, v)| (c.name().to_string(), Value::from(v)))
+        .collect::<Map<_, _>>()
+        .to_string()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_counters_sum_shards() {
+        // Other tests bump the counters concurrently, so only the increase is checked.
+        let before = get(Counter::BytesReified);
+        std::thread::scope(|s| {
+            for _ in 0..(SHARDS + 4) {
+                s.spawn(|| {
+                    for _ in 0..100 {
+                        add(Counter::BytesReified, 3);
+                    }
+                });
+            }
+        });
+        assert!(get(Counter::BytesReified) - before >= (SHARDS as u64 + 4) * 300);
+
+        let json: serde_json::Value = serde_json::from_str(&to_json()).unwrap();
+        assert_eq!(json.as_object().unwrap().len(), Counter::ALL.len());
+        assert!(json["bytes_reified"].as_u64().unwrap() > 0);
+    }
+}
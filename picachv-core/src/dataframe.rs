@@ -1,13 +1,14 @@
+use std::borrow::Cow;
 use std::fmt;
 use std::ops::{Deref, Index};
-use std::sync::Arc;
+use std::sync::{Arc, OnceLock};
 
 use ahash::{HashMap, HashMapExt, HashSet};
 use arrow_array::{LargeBinaryArray, RecordBatch};
 use picachv_error::{picachv_bail, picachv_ensure, PicachvError, PicachvResult};
 use picachv_message::transform_info::Information;
 use picachv_message::{
-    ContextOptions, GroupByIdx, GroupByIdxMultiple, JoinInformation, TransformInfo,
+    ContextOptions, GroupByIdx, GroupByIdxMultiple, JoinInformation, JoinType, TransformInfo,
 };
 use rayon::prelude::*;
 use serde::{Deserialize, Serialize};
@@ -18,11 +19,14 @@ use tabled::settings::{Alignment, Style};
 use uuid::Uuid;
 
 use crate::arena::Arena;
+use crate::counters::{self, Counter};
 use crate::expr::AExpr;
+use crate::group_index::GroupIndex;
 use crate::io::BinIo;
 use crate::plan::groupby_single;
 use crate::policy::Policy;
-use crate::profiler::PROFILER;
+use crate::profiler::profile;
+use crate::selection::Selection;
 use crate::thread_pool::THREAD_POOL;
 use crate::udf::Udf;
 use crate::{Arenas, GroupInformation};
@@ -90,8 +94,8 @@ impl Chunks {
             .df_arena
             .read()
             .get(&self.0.first().unwrap().uuid)?
-            .columns
-            .len();
+            .shape()
+            .1;
 
         // Iterate over the grouping information which stands for one group.
         // But this time we need to pick rows from different chunks.
@@ -110,20 +114,19 @@ impl Chunks {
                             let df = df_arena.get(&chunk.uuid)?;
 
                             for idx in group.groups.iter() {
-                                column.push(df.columns[col_idx][*idx].clone());
+                                column.push(df.columns()[col_idx][*idx].clone());
                             }
                         }
                     }
 
-                    Ok(PolicyGuardedDataFrame {
-                        columns: columns
+                    Ok(PolicyGuardedDataFrame::new(
+                        columns
                             .into_par_iter()
                             .map(|c| {
                                 Ok(Arc::new(PolicyGuardedColumn::new_from_iter(c.par_iter())?))
                             })
                             .collect::<PicachvResult<Vec<_>>>()?,
-                        ..Default::default()
-                    })
+                    ))
                 })
                 .collect::<PicachvResult<Vec<_>>>()
         })?;
@@ -151,9 +154,10 @@ impl Chunks {
         })?;
 
         let mut df = PolicyGuardedDataFrame::union(&groups)?;
-        df.additional_info = DfInformation {
-            hash_info: hashmap.iter().enumerate().map(|(k, v)| (*v.0, k)).collect(),
-        };
+        // The `k`-th group of `hashmap` is the `k`-th row of `df`.
+        df.additional_info = Arc::new(DfInformation {
+            group_index: GroupIndex::new(hashmap.keys().enumerate().map(|(k, &h)| (h, k)))?,
+        });
 
         Ok(df)
     }
@@ -216,38 +220,25 @@ pub(crate) fn idx_to_group_info_vec(idx: &GroupByIdx) -> Vec<GroupInformation> {
     })
 }
 
-/// A column in a [`DataFrame`] that is guarded by a vector of policies.
-///
-/// # Design considereration
-///
-/// Some might think it is more efficient to store the policies within each data
-/// cell. However, this is not a good idea because it will make the data structure
-/// more complex and harder to maintain.
-///
-/// It is thus more efficient to keep policies as a separate vector and ensure that
-/// the column and the policies are in sync.
-///
-/// # Optimizations
+/// A horizontal piece of a [`PolicyGuardedColumn`].
 ///
-/// In reality the policies are often sparse which means that most of the cells share
-/// the same policy. We can use a bitmap to indicate which cells differ from the base
-/// policy.
-#[derive(Clone, Debug, Default, PartialEq)]
-pub struct PolicyGuardedColumn {
-    /// The policies for the column.
+/// A chunk usually corresponds to a Parquet row group or to a morsel handed over by the
+/// query engine. Each chunk carries its own base policy so that chunks coming from different
+/// sources never need to agree on a common policy, and appending them never needs to touch
+/// the policies stored inside.
+#[derive(Clone, Debug, Default)]
+pub struct PolicyChunk {
+    /// The policy shared by most of the cells in this chunk.
     pub(crate) base_policy: PolicyRef,
-    /// The length of this column.
+    /// The length of this chunk.
     pub(crate) len: usize,
-    /// The policies for each cell.
+    /// The policies that differ from `base_policy`, keyed by their offset in the chunk.
     pub(crate) policies: HashMap<usize, PolicyRef>,
 }
 
-#[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
-pub(crate) struct PolicyGuardedColumnProxy {
-    pub(crate) policies: Vec<PolicyRef>,
-}
+pub type PolicyChunkRef = Arc<PolicyChunk>;
 
-impl Index<usize> for PolicyGuardedColumn {
+impl Index<usize> for PolicyChunk {
     type Output = PolicyRef;
 
     #[inline]
@@ -256,25 +247,43 @@ impl Index<usize> for PolicyGuardedColumn {
     }
 }
 
-impl PolicyGuardedColumn {
+impl PolicyChunk {
     #[inline]
     pub fn len(&self) -> usize {
         self.len
     }
 
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
     pub fn new(base_policy: PolicyRef, len: usize, policies: HashMap<usize, PolicyRef>) -> Self {
-        PolicyGuardedColumn {
+        PolicyChunk {
             base_policy,
             len,
             policies,
         }
     }
 
-    /// Construct a new [`PolicyGuardedColumn`] from an iterator.
-    ///
-    /// # Note
+    /// Returns true if every cell of this chunk carries the base policy.
+    #[inline]
+    pub fn is_uniform(&self) -> bool {
+        self.policies.is_empty()
+    }
+
+    /// Returns true if no cell of this chunk carries any policy.
+    pub fn is_clean(&self) -> bool {
+        matches!(self.base_policy.deref(), Policy::PolicyClean)
+            && self
+                .policies
+                .par_iter()
+                .all(|(_, v)| matches!(v.deref(), Policy::PolicyClean))
+    }
+
+    /// Construct a new [`PolicyChunk`] from an iterator.
     ///
-    /// This method is not recommended for frequent use as it is not efficient.
+    /// The most frequent policy becomes the base policy of the chunk.
     pub fn new_from_iter<'a>(
         iter: impl IntoParallelIterator<Item = &'a PolicyRef>,
     ) -> PicachvResult<Self> {
@@ -306,6 +315,8 @@ impl PolicyGuardedColumn {
                 )
         });
 
+        counters::add(Counter::ChunkPolicies, policy_count.len() as u64);
+
         let base_policy = THREAD_POOL.install(|| {
             policy_count
                 .into_par_iter()
@@ -335,67 +346,450 @@ impl PolicyGuardedColumn {
         })
     }
 
+    /// Apply the filter on this chunk. The length of `filter` must match the chunk.
+    pub fn filter(&self, filter: &[bool]) -> PicachvResult<Self> {
+        picachv_ensure!(
+            filter.len() == self.len,
+            ComputeError: "The length of the filter does not match the chunk: {} != {}", filter.len(), self.len,
+        );
+
+        Ok(self.filter_selection(&Selection::from_bools(filter), 0))
+    }
+
+    /// Keeps the rows of this chunk selected by `selection`, where this chunk starts at row
+    /// `offset` of `selection`. Only the cells differing from the base policy are visited.
+    pub(crate) fn filter_selection(&self, selection: &Selection, offset: usize) -> Self {
+        let base = selection.rank(offset);
+        let len = selection.rank(offset + self.len) - base;
+
+        let policies = self
+            .policies
+            .par_iter()
+            .filter(|(k, _)| selection.is_selected(offset + **k))
+            .map(|(k, v)| (selection.rank(offset + *k) - base, v.clone()))
+            .collect();
+
+        Self {
+            base_policy: self.base_policy.clone(),
+            len,
+            policies,
+        }
+    }
+}
+
+/// A column in a [`DataFrame`] that is guarded by a vector of policies.
+///
+/// # Design considereration
+///
+/// Some might think it is more efficient to store the policies within each data
+/// cell. However, this is not a good idea because it will make the data structure
+/// more complex and harder to maintain.
+///
+/// It is thus more efficient to keep policies as a separate vector and ensure that
+/// the column and the policies are in sync.
+///
+/// # Optimizations
+///
+/// In reality the policies are often sparse which means that most of the cells share
+/// the same policy. We can use a bitmap to indicate which cells differ from the base
+/// policy.
+///
+/// The column is further split into a list of [`PolicyChunk`]s, each of which has its own
+/// base policy. Appending two columns is thus only a matter of concatenating the chunk lists,
+/// and a Parquet row group maps to exactly one chunk without being reshuffled.
+#[derive(Clone, Debug, Default)]
+pub struct PolicyGuardedColumn {
+    /// The chunks of this column.
+    pub(crate) chunks: Vec<PolicyChunkRef>,
+    /// The index of the first row of each chunk.
+    pub(crate) offsets: Vec<usize>,
+    /// The length of this column.
+    pub(crate) len: usize,
+}
+
+#[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
+pub(crate) struct PolicyGuardedColumnProxy {
+    pub(crate) policies: Vec<PolicyRef>,
+}
+
+impl Index<usize> for PolicyGuardedColumn {
+    type Output = PolicyRef;
+
+    #[inline]
+    fn index(&self, index: usize) -> &Self::Output {
+        match self.locate(index) {
+            Some((chunk, offset)) => &self.chunks[chunk][offset],
+            None => panic!(
+                "index out of bounds: the len is {} but the index is {index}",
+                self.len
+            ),
+        }
+    }
+}
+
+impl PartialEq for PolicyGuardedColumn {
+    fn eq(&self, other: &Self) -> bool {
+        // Columns are compared logically since the same policies can be chunked differently.
+        self.len == other.len
+            && THREAD_POOL.install(|| (0..self.len).into_par_iter().all(|i| self[i] == other[i]))
+    }
+}
+
+impl PolicyGuardedColumn {
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    pub fn new(base_policy: PolicyRef, len: usize, policies: HashMap<usize, PolicyRef>) -> Self {
+        Self::from_chunks(vec![Arc::new(PolicyChunk::new(base_policy, len, policies))])
+    }
+
+    /// Construct a new [`PolicyGuardedColumn`] from a list of chunks. Empty chunks are dropped.
+    pub fn from_chunks(chunks: Vec<PolicyChunkRef>) -> Self {
+        let chunks = chunks
+            .into_iter()
+            .filter(|c| !c.is_empty())
+            .collect::<Vec<_>>();
+        let mut offsets = Vec::with_capacity(chunks.len());
+        let mut len = 0;
+        for chunk in chunks.iter() {
+            offsets.push(len);
+            len += chunk.len();
+        }
+
+        PolicyGuardedColumn {
+            chunks,
+            offsets,
+            len,
+        }
+    }
+
+    #[inline]
+    pub fn chunks(&self) -> &[PolicyChunkRef] {
+        &self.chunks
+    }
+
+    /// Returns the chunk index and the offset within that chunk of the `index`-th row, or `None`
+    /// if the row is out of bound, which is always the case for a column without chunks.
+    #[inline]
+    pub(crate) fn locate(&self, index: usize) -> Option<(usize, usize)> {
+        if index >= self.len {
+            return None;
+        }
+
+        match self.chunks.len() {
+            1 => Some((0, index)),
+            _ => {
+                // `offsets[0]` is zero, so at least one offset is not greater than `index`.
+                let chunk = self.offsets.partition_point(|&o| o <= index) - 1;
+                Some((chunk, index - self.offsets[chunk]))
+            },
+        }
+    }
+
+    /// Construct a new [`PolicyGuardedColumn`] from an iterator.
+    ///
+    /// # Note
+    ///
+    /// This method is not recommended for frequent use as it is not efficient.
+    pub fn new_from_iter<'a>(
+        iter: impl IntoParallelIterator<Item = &'a PolicyRef>,
+    ) -> PicachvResult<Self> {
+        Ok(Self::from_chunks(vec![Arc::new(
+            PolicyChunk::new_from_iter(iter)?,
+        )]))
+    }
+
+    /// Construct a new [`PolicyGuardedColumn`] of `len` cells where roughly `density` of them
+    /// carry `policy` and the others are clean. The cells are those at `offset..offset + len`
+    /// as decided by [`has_policy`], so that columns built with different offsets do not repeat
+    /// the same pattern.
+    ///
+    /// This is meant for generating the policies of tests and benchmarks.
+    pub fn new_with_density(
+        len: usize,
+        offset: usize,
+        density: f64,
+        policy: &PolicyRef,
+    ) -> PicachvResult<Self> {
+        let clean = Arc::new(Policy::PolicyClean);
+        let policies = (offset..offset + len)
+            .map(|i| match has_policy(i, density) {
+                true => policy.clone(),
+                false => clean.clone(),
+            })
+            .collect::<Vec<_>>();
+
+        Self::new_from_iter(&policies)
+    }
+
     /// Append to this column.
+    ///
+    /// This only concatenates the chunk lists; no policy is copied.
     pub fn append(&self, other: &Self) -> PicachvResult<Self> {
-        let mut policies = self.policies.clone();
-        for (k, v) in other.policies.iter() {
-            policies.insert(k + self.len, v.clone());
+        Ok(Self::concat([self, other]))
+    }
+
+    /// Concatenates the chunks of all the `columns` into a new column.
+    ///
+    /// Chunks are shared as they are, so the chunks of a Parquet row group or of a pipeline
+    /// keep their own base policy and exceptions. Only runs of consecutive uniform chunks with
+    /// the same base policy are merged: they are equivalent to one uniform chunk, and merging
+    /// them keeps the many mostly clean vectors produced by parallel pipelines from leaving
+    /// thousands of tiny chunks that every later operation walks one by one.
+    pub fn concat<'a>(columns: impl IntoIterator<Item = &'a Self>) -> Self {
+        // The first chunk of each run along with the number of rows in the run.
+        let mut runs: Vec<(PolicyChunkRef, usize)> = vec![];
+        for chunk in columns.into_iter().flat_map(|c| c.chunks.iter()) {
+            match runs.last_mut() {
+                Some((first, len))
+                    if first.is_uniform()
+                        && chunk.is_uniform()
+                        && same_policy(&first.base_policy, &chunk.base_policy) =>
+                {
+                    *len += chunk.len
+                },
+                _ => runs.push((chunk.clone(), chunk.len)),
+            }
         }
 
-        Ok(Self {
-            base_policy: self.base_policy.clone(),
-            len: self.len + other.len,
-            policies,
-        })
+        let chunks = runs
+            .into_iter()
+            .map(|(first, len)| match len == first.len {
+                true => first,
+                false => Arc::new(PolicyChunk::new(
+                    first.base_policy.clone(),
+                    len,
+                    HashMap::new(),
+                )),
+            })
+            .collect();
+
+        Self::from_chunks(chunks)
     }
 
     /// Apply the filter.
+    ///
+    /// The chunk layout is kept so that each chunk keeps its own base policy.
     pub fn filter(&self, filter: &[bool]) -> PicachvResult<Self> {
         picachv_ensure!(
             filter.len() == self.len,
             ComputeError: "The length of the filter does not match the column: {} != {}", filter.len(), self.len,
         );
 
-        let slice = filter
-            .par_iter()
-            .enumerate()
-            .filter_map(|(i, b)| if *b { Some(i) } else { None })
-            .collect::<Vec<_>>();
+        self.filter_selection(&Selection::from_bools(filter))
+    }
+
+    /// Keeps the rows selected by `selection`. A chunk whose rows are all kept is shared
+    /// rather than copied.
+    pub fn filter_selection(&self, selection: &Selection) -> PicachvResult<Self> {
+        picachv_ensure!(
+            selection.len() == self.len,
+            ComputeError: "The length of the filter does not match the column: {} != {}", selection.len(), self.len,
+        );
 
-        self.new_from_slice(&slice)
+        let chunks = THREAD_POOL.install(|| {
+            self.chunks
+                .par_iter()
+                .zip(self.offsets.par_iter())
+                .map(|(chunk, &offset)| {
+                    let kept = selection.rank(offset + chunk.len()) - selection.rank(offset);
+                    match kept == chunk.len() {
+                        true => chunk.clone(),
+                        false => Arc::new(chunk.filter_selection(selection, offset)),
+                    }
+                })
+                .collect::<Vec<_>>()
+        });
+
+        Ok(Self::from_chunks(chunks))
     }
 
     /// According to the `groups` struct, fetch the group of columns.
     pub fn groups(&self, groups: &GroupInformation) -> PicachvResult<Self> {
-        let policies = groups
-            .groups
-            .par_iter()
-            .map(|g| &self[*g as usize])
-            .collect::<Vec<_>>();
-
-        Self::new_from_iter(policies.into_par_iter())
+        self.new_from_slice(&groups.groups)
     }
 
     /// Construct a new [`PolicyGuardedColumn`] from a slice of the original object.
+    ///
+    /// The `i`-th row of the new column is the `slice[i]`-th row of this column.
     pub fn new_from_slice(&self, slice: &[usize]) -> PicachvResult<Self> {
-        Ok(Self {
-            base_policy: self.base_policy.clone(),
-            len: slice.len(),
-            policies: self
-                .policies
-                .par_iter()
-                .filter_map(|(k, v)| {
-                    if slice.contains(k) {
-                        Some((*k, v.clone()))
-                    } else {
-                        None
+        picachv_ensure!(
+            slice.par_iter().all(|&i| i < self.len),
+            ComputeError: "The slice is out of bound: the column has {} rows", self.len,
+        );
+
+        Ok(Self::from_chunks(vec![Arc::new(self.gather(slice))]))
+    }
+
+    /// Gathers the rows given by `slice` into a single chunk. The indices must be in bound.
+    ///
+    /// The base policy of the largest chunk is used as the new base policy so that only the
+    /// cells differing from it are materialized. Rows coming from a uniform chunk carrying that
+    /// policy are skipped without being looked up, so gathering from a clean column never
+    /// touches the policies at all.
+    #[inline]
+    pub(crate) fn gather(&self, slice: &[usize]) -> PolicyChunk {
+        self.gather_with(&self.gather_plan(), slice, false)
+    }
+
+    /// Prepares the gathers on this column so that repeated gathers need not redo it.
+    pub(crate) fn gather_plan(&self) -> GatherPlan {
+        let base_policy = match self.chunks.iter().max_by_key(|c| c.len()) {
+            Some(c) => c.base_policy.clone(),
+            None => Default::default(),
+        };
+
+        let trivial = self
+            .chunks
+            .iter()
+            .map(|c| c.is_uniform() && same_policy(&c.base_policy, &base_policy))
+            .collect::<Vec<_>>();
+
+        GatherPlan {
+            base_policy,
+            trivial,
+        }
+    }
+
+    /// Same as [`PolicyGuardedColumn::gather`] with a plan computed beforehand.
+    ///
+    /// If `nullable` is set, [`NULL_ROW`] denotes a null-extended row which is clean.
+    pub(crate) fn gather_with(
+        &self,
+        plan: &GatherPlan,
+        slice: &[usize],
+        nullable: bool,
+    ) -> PolicyChunk {
+        let GatherPlan {
+            base_policy,
+            trivial,
+        } = plan;
+        let base_policy = base_policy.clone();
+        let base_clean = matches!(base_policy.deref(), Policy::PolicyClean);
+        let clean: PolicyRef = Default::default();
+
+        // Fast path: every cell carries the same policy.
+        if trivial.iter().all(|&t| t) && (!nullable || base_clean) {
+            return PolicyChunk::new(base_policy, slice.len(), HashMap::new());
+        }
+
+        // The indices are processed block by block so that each task writes to a small
+        // buffer that stays in cache; the buffers are merged at the end.
+        let blocks = THREAD_POOL.install(|| {
+            slice
+                .par_chunks(GATHER_BLOCK_SIZE)
+                .enumerate()
+                .map(|(block, indices)| {
+                    let start = block * GATHER_BLOCK_SIZE;
+                    let mut res = vec![];
+                    for (i, &idx) in indices.iter().enumerate() {
+                        if nullable && idx == NULL_ROW {
+                            if !base_clean {
+                                res.push((start + i, clean.clone()));
+                            }
+                            continue;
+                        }
+
+                        let (chunk, offset) = self
+                            .locate(idx)
+                            .expect("the indices are checked by the caller");
+                        if trivial[chunk] {
+                            continue;
+                        }
+
+                        let p = &self.chunks[chunk][offset];
+                        if !same_policy(p, &base_policy) {
+                            res.push((start + i, p.clone()));
+                        }
                     }
+                    res
                 })
-                .collect(),
-        })
+                .collect::<Vec<_>>()
+        });
+
+        let mut policies = HashMap::with_capacity(blocks.iter().map(Vec::len).sum());
+        for block in blocks {
+            policies.extend(block);
+        }
+
+        PolicyChunk::new(base_policy, slice.len(), policies)
+    }
+}
+
+/// Decides whether the `i`-th cell carries a policy so that roughly `density` of the cells
+/// do, spread evenly over the column.
+pub fn has_policy(i: usize, density: f64) -> bool {
+    ((i as u64).wrapping_mul(2654435761) % 1_000_000) < (density * 1_000_000.0) as u64
+}
+
+/// Returns the columns in `project_list`, kept in their original order.
+fn project<'a>(
+    columns: &'a [PolicyGuardedColumnRef],
+    project_list: &[usize],
+) -> PicachvResult<Vec<&'a PolicyGuardedColumnRef>> {
+    picachv_ensure!(
+        project_list.iter().all(|&col| col < columns.len()),
+        ComputeError: "The column is out of bound: {:?} vs {:?}", columns.len(), project_list,
+    );
+
+    let index_set: HashSet<_> = project_list.iter().collect();
+    Ok(columns
+        .iter()
+        .enumerate()
+        .filter(|(i, _)| index_set.contains(i))
+        .map(|(_, c)| c)
+        .collect())
+}
+
+/// What [`PolicyGuardedColumn::gather`] needs to know about a column.
+#[derive(Clone, Debug)]
+pub(crate) struct GatherPlan {
+    /// The base policy of the gathered chunk.
+    base_policy: PolicyRef,
+    /// Whether every cell of each chunk carries `base_policy`.
+    trivial: Vec<bool>,
+}
+
+/// The row index of the missing side of a null-extended row in an outer join. On the wire this
+/// is `u64::MAX`.
+///
+/// The cells of the missing side hold `NULL` and carry no data, so they are clean.
+pub const NULL_ROW: usize = usize::MAX;
+
+/// Returns whether the left and the right side of a join of `join_type` may be null-extended.
+pub(crate) fn nullable_sides(join_type: JoinType) -> (bool, bool) {
+    match join_type {
+        JoinType::Left => (false, true),
+        JoinType::Right => (true, false),
+        JoinType::Outer => (true, true),
+        _ => (false, false),
     }
 }
 
+/// Reinterprets the indices received as `u64` as `usize` without copying them.
+#[inline]
+pub(crate) fn u64_as_usize(v: &[u64]) -> &[usize] {
+    const _: () = assert!(std::mem::size_of::<usize>() == std::mem::size_of::<u64>());
+
+    // SAFETY: `usize` and `u64` have the same size and alignment on the supported targets.
+    unsafe { std::slice::from_raw_parts(v.as_ptr() as *const usize, v.len()) }
+}
+
+/// The number of indices processed by a task in [`PolicyGuardedColumn::gather`].
+const GATHER_BLOCK_SIZE: usize = 1 << 14;
+
+#[inline]
+fn same_policy(lhs: &PolicyRef, rhs: &PolicyRef) -> bool {
+    Arc::ptr_eq(lhs, rhs) || lhs == rhs
+}
+
 impl PolicyGuardedColumnProxy {
     pub fn new(policies: Vec<PolicyRef>) -> Self {
         PolicyGuardedColumnProxy { policies }
@@ -405,8 +799,8 @@ impl PolicyGuardedColumnProxy {
 /// Some other additional information for the [`PolicyGuardedDataFrame`].
 #[derive(Clone, Debug, Serialize, Deserialize, PartialEq, Default)]
 pub struct DfInformation {
-    /// Used to quickly look up the index.
-    pub(crate) hash_info: HashMap<u64, usize>,
+    /// Maps the hash of each group to its row; see [`PolicyGuardedDataFrame::select_group`].
+    pub(crate) group_index: GroupIndex,
 }
 
 /// A contiguous growable collection of `Series` that have the same length.
@@ -417,12 +811,39 @@ pub struct DfInformation {
 ///
 /// The reason we use a vector of [`PolicyGuardedColumnRef`]s is that it is more efficient
 /// to store the reference to avoid unnecessary cloning.
-#[derive(Clone, PartialEq, Default)]
+///
+/// # Deferred row maps
+///
+/// Reorders, slices and the filters that follow them do not rewrite the columns. They are
+/// composed into a single row map on top of the unchanged columns, and projections just drop
+/// columns, so a plan that reorders, filters and then projects away most columns never copies
+/// the dropped ones. The row map is applied once, the first time the policies are read via
+/// [`PolicyGuardedDataFrame::columns`]. A filter on a dataframe without a pending row map is
+/// applied to the columns directly since that only visits the cells differing from the base
+/// policies.
+///
+/// # Sharing
+///
+/// Every field is shared: the column list is immutable and is replaced as a whole by
+/// operations that change the schema, and [`DfInformation`] is copied only when it is
+/// written. Cloning a dataframe thus copies no policy, no column list and no group map,
+/// and stitching or projecting only builds a new list of column references.
+#[derive(Clone, Default)]
 pub struct PolicyGuardedDataFrame {
-    /// Policies for the column.
-    pub(crate) columns: Vec<PolicyGuardedColumnRef>,
+    /// Policies for the column. If `row_map` is set, these are the columns before it applies.
+    pub(crate) columns: Arc<[PolicyGuardedColumnRef]>,
+    /// The deferred row map: the `i`-th row is the `row_map[i]`-th row of `columns`.
+    row_map: Option<Arc<[usize]>>,
+    /// `columns` with `row_map` applied, computed on the first read.
+    materialized: OnceLock<Arc<[PolicyGuardedColumnRef]>>,
     /// Other additional information.
-    pub(crate) additional_info: DfInformation,
+    pub(crate) additional_info: Arc<DfInformation>,
+}
+
+impl PartialEq for PolicyGuardedDataFrame {
+    fn eq(&self, other: &Self) -> bool {
+        self.columns() == other.columns() && self.additional_info == other.additional_info
+    }
 }
 
 #[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
@@ -432,10 +853,15 @@ pub(crate) struct PolicyGuardedDataFrameProxy {
 
 impl From<&PolicyGuardedColumn> for PolicyGuardedColumnProxy {
     fn from(c: &PolicyGuardedColumn) -> Self {
-        let mut policies = vec![c.base_policy.clone(); c.len()];
+        let mut policies = Vec::with_capacity(c.len());
 
-        for (&k, v) in c.policies.iter() {
-            policies[k] = v.clone();
+        for chunk in c.chunks.iter() {
+            let start = policies.len();
+            policies.extend(std::iter::repeat(chunk.base_policy.clone()).take(chunk.len()));
+
+            for (&k, v) in chunk.policies.iter() {
+                policies[start + k] = v.clone();
+            }
         }
 
         Self { policies }
@@ -452,7 +878,7 @@ impl From<PolicyGuardedColumnProxy> for PolicyGuardedColumn {
 impl From<&PolicyGuardedDataFrame> for PolicyGuardedDataFrameProxy {
     fn from(df: &PolicyGuardedDataFrame) -> Self {
         let columns =
-            THREAD_POOL.install(|| df.columns.par_iter().map(|c| c.deref().into()).collect());
+            THREAD_POOL.install(|| df.columns().par_iter().map(|c| c.deref().into()).collect());
 
         Self { columns }
     }
@@ -468,10 +894,7 @@ impl From<PolicyGuardedDataFrameProxy> for PolicyGuardedDataFrame {
                 .collect()
         });
 
-        Self {
-            columns,
-            ..Default::default()
-        }
+        Self::new(columns)
     }
 }
 
@@ -485,7 +908,7 @@ impl fmt::Debug for PolicyGuardedDataFrame {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
         let mut builder = Builder::new();
         let mut header = self
-            .columns
+            .columns()
             .iter()
             .enumerate()
             .map(|(i, _)| format!("column_{}", i))
@@ -496,7 +919,7 @@ impl fmt::Debug for PolicyGuardedDataFrame {
         for i in (0..self.shape().0).take(15) {
             let mut row = vec![i.to_string()];
             for j in 0..self.shape().1 {
-                row.push(format!("{}", self.columns[j][i]));
+                row.push(format!("{}", self.columns()[j][i]));
             }
             builder.push_record(row);
         }
@@ -541,118 +964,324 @@ impl PolicyGuardedDataFrameProxy {
 }
 
 impl PolicyGuardedDataFrame {
-    pub fn reorder(&mut self, _perm: &[usize]) -> PicachvResult<()> {
-        // THREAD_POOL.install(|| {
-        //     self.columns.par_iter_mut().for_each(|c| {
-        //         let policies = perm
-        //             .par_iter()
-        //             .map(|&i| c.policies[i].clone())
-        //             .collect::<Vec<_>>();
-        //         // c.policies = policies;
-        //     })
-        // });
+    /// Reorders the rows so that the `i`-th row becomes the `perm[i]`-th row of the original
+    /// dataframe.
+    pub fn reorder(&mut self, perm: &[usize]) -> PicachvResult<()> {
+        picachv_ensure!(
+            perm.len() == self.shape().0,
+            ComputeError: "The permutation has {} entries but the dataframe has {} rows", perm.len(), self.shape().0,
+        );
 
-        Ok(())
+        self.gather_rows(perm)
     }
 
-    /// Constructs a new [`PolicyGuardedDataFrame`] from a [`RecordBatch`].
-    #[inline]
-    pub fn new_from_record_batch(rb: RecordBatch) -> PicachvResult<Self> {
-        PolicyGuardedDataFrameProxy::new_from_record_batch(rb).map(Into::into)
+    /// Keeps the first `k` rows of the reordered dataframe, i.e., `ORDER BY ... LIMIT k`.
+    ///
+    /// Only the first `k` entries of `perm` are visited, so the rows that are cut off cost
+    /// nothing.
+    pub fn top_k(&mut self, perm: &[usize], k: usize) -> PicachvResult<()> {
+        picachv_ensure!(
+            perm.len() == self.shape().0,
+            ComputeError: "The permutation has {} entries but the dataframe has {} rows", perm.len(), self.shape().0,
+        );
+
+        self.gather_rows(&perm[..k.min(perm.len())])
+    }
+
+    /// Makes the `i`-th row the `indices[i]`-th row. The columns are not touched; `indices`
+    /// is composed into the deferred row map.
+    fn gather_rows(&mut self, indices: &[usize]) -> PicachvResult<()> {
+        let num_rows = self.shape().0;
+        picachv_ensure!(
+            THREAD_POOL.install(|| indices.par_iter().all(|&i| i < num_rows)),
+            ComputeError: "The index is out of bound: the dataframe has {} rows", num_rows,
+        );
+
+        self.settle();
+        let row_map = match &self.row_map {
+            Some(row_map) => THREAD_POOL
+                .install(|| indices.par_iter().map(|&i| row_map[i]).collect::<Vec<_>>())
+                .into(),
+            None => indices.into(),
+        };
+        self.row_map = Some(row_map);
+        // The row indices recorded for the groups are no longer valid.
+        self.additional_info = Default::default();
+
+        Ok(())
+    }
+
+    /// Returns the policy columns.
+    ///
+    /// If a row map is pending, it is applied to every column on the first call and the
+    /// result is kept, so this is cheap afterwards.
+    pub fn columns(&self) -> &[PolicyGuardedColumnRef] {
+        match &self.row_map {
+            None => &self.columns,
+            Some(row_map) => self.materialized.get_or_init(|| {
+                THREAD_POOL.install(|| {
+                    self.columns
+                        .par_iter()
+                        .map(|c| {
+                            Arc::new(PolicyGuardedColumn::from_chunks(vec![Arc::new(
+                                c.gather(row_map),
+                            )]))
+                        })
+                        .collect::<Vec<_>>()
+                        .into()
+                })
+            }),
+        }
+    }
+
+    /// Drops the row map if it has already been applied so that it is not applied twice.
+    fn settle(&mut self) {
+        if let Some(columns) = self.materialized.take() {
+            self.columns = columns;
+            self.row_map = None;
+        }
+    }
+
+    /// Returns a dataframe that shares the columns and the pending row map of this one.
+    fn view(&self) -> Self {
+        match self.materialized.get() {
+            Some(columns) => Self {
+                columns: columns.clone(),
+                ..Default::default()
+            },
+            None => Self {
+                columns: self.columns.clone(),
+                row_map: self.row_map.clone(),
+                ..Default::default()
+            },
+        }
+    }
+
+    /// Constructs a new [`PolicyGuardedDataFrame`] from a [`RecordBatch`].
+    #[inline]
+    pub fn new_from_record_batch(rb: RecordBatch) -> PicachvResult<Self> {
+        PolicyGuardedDataFrameProxy::new_from_record_batch(rb).map(Into::into)
+    }
+
+    /// Constructs a new [`PolicyGuardedDataFrame`] from a list of [`RecordBatch`]es.
+    ///
+    /// Each batch becomes one chunk of every column so the batches are never concatenated.
+    pub fn new_from_record_batches(rbs: Vec<RecordBatch>) -> PicachvResult<Self> {
+        let dfs = THREAD_POOL.install(|| {
+            rbs.into_par_iter()
+                .map(Self::new_from_record_batch)
+                .collect::<PicachvResult<Vec<_>>>()
+        })?;
+
+        match dfs.len() {
+            0 => Ok(Default::default()),
+            1 => Ok(dfs.into_iter().next().unwrap()),
+            _ => Self::union(&dfs.into_iter().map(Arc::new).collect::<Vec<_>>()),
+        }
     }
 
     /// Constructs a new [`PolicyGuardedDataFrame`] from the slice of the original
     /// object according to the `slices` parameter.
     pub fn new_from_slice(&self, slices: &[usize]) -> PicachvResult<Self> {
-        let columns = THREAD_POOL.install(|| {
-            self.columns
-                .par_iter()
-                .map(|c| Ok(Arc::new(c.new_from_slice(slices)?)))
-                .collect::<PicachvResult<Vec<_>>>()
-        })?;
+        let mut df = self.view();
+        df.gather_rows(slices)?;
 
-        Ok(PolicyGuardedDataFrame {
-            columns,
-            ..Default::default()
-        })
+        Ok(df)
+    }
+
+    /// Returns a view of the rows in the selection vector `sel_vec`, e.g., the one that comes
+    /// with a DuckDB vector.
+    ///
+    /// The view shares the columns of this dataframe and only records `sel_vec` in its row
+    /// map, so no policy is copied. Further slices, filters and projections of the view are
+    /// composed into the same row map.
+    pub fn slice_view(&self, sel_vec: &[u32]) -> PicachvResult<Self> {
+        let num_rows = self.shape().0;
+        picachv_ensure!(
+            sel_vec.iter().all(|&i| (i as usize) < num_rows),
+            ComputeError: "The index is out of bound: the dataframe has {} rows", num_rows,
+        );
+
+        let mut df = self.view();
+        // Selecting every row in order is what the engine does for unfiltered vectors.
+        if sel_vec.len() == num_rows && sel_vec.iter().enumerate().all(|(i, &j)| i == j as usize) {
+            return Ok(df);
+        }
+
+        // A selection vector holds at most one vector of rows, which is too few to be worth
+        // splitting across threads.
+        let row_map = match &df.row_map {
+            Some(row_map) => sel_vec
+                .iter()
+                .map(|&i| row_map[i as usize])
+                .collect::<Vec<_>>(),
+            None => sel_vec.iter().map(|&i| i as usize).collect(),
+        };
+        df.row_map = Some(row_map.into());
+
+        Ok(df)
     }
 
     /// Joins two policy-carrying dataframes.
     ///
-    /// The function iterates over the `row_info` to join the policies specified by `common_list`. After
-    /// this is done, it re-arranges all the columns according to the `output_schema`.
+    /// The joined rows are given either by the packed `left_rows` and `right_rows` arrays or,
+    /// for older callers, by one `row_join_info` entry per row. See
+    /// [`PolicyGuardedDataFrame::join_by_idx`] for how the policies are gathered.
     pub fn join(
         lhs: &PolicyGuardedDataFrame,
         rhs: &PolicyGuardedDataFrame,
         info: &JoinInformation,
         options: &ContextOptions,
     ) -> PicachvResult<Self> {
-        let join_preparation = || {
-            let left_columns = unsafe {
-                std::slice::from_raw_parts(
-                    info.left_columns.as_ptr() as *const usize,
-                    info.left_columns.len(),
-                )
-            };
-            let right_columns = unsafe {
-                std::slice::from_raw_parts(
-                    info.right_columns.as_ptr() as *const usize,
-                    info.right_columns.len(),
+        let (left_idx, right_idx) = match info.row_join_info.is_empty() {
+            true => (
+                Cow::Borrowed(info.left_rows.as_slice()),
+                Cow::Borrowed(info.right_rows.as_slice()),
+            ),
+            false => THREAD_POOL.install(|| {
+                rayon::join(
+                    || Cow::Owned(info.row_join_info.par_iter().map(|e| e.left_row).collect()),
+                    || Cow::Owned(info.row_join_info.par_iter().map(|e| e.right_row).collect()),
                 )
-            };
+            }),
+        };
+
+        Self::join_by_idx(
+            lhs,
+            rhs,
+            u64_as_usize(&info.left_columns),
+            u64_as_usize(&info.right_columns),
+            u64_as_usize(&left_idx),
+            u64_as_usize(&right_idx),
+            info.join_type(),
+            options,
+        )
+    }
+
+    /// Joins two policy-carrying dataframes where the `i`-th joined row consists of the
+    /// `left_idx[i]`-th row of `lhs` and the `right_idx[i]`-th row of `rhs`.
+    ///
+    /// Only the `left_columns` of `lhs` and the `right_columns` of `rhs` are gathered, directly
+    /// from the shared source columns; neither input is copied. A side whose columns are clean
+    /// produces constant columns without visiting the indices.
+    ///
+    /// For outer joins, the index of the missing side of a null-extended row is [`NULL_ROW`].
+    /// Semi and anti joins only keep the `left_idx`-th rows of `lhs`; `right_idx` is ignored
+    /// and nothing of `rhs` is stitched.
+    #[allow(clippy::too_many_arguments)]
+    pub fn join_by_idx(
+        lhs: &PolicyGuardedDataFrame,
+        rhs: &PolicyGuardedDataFrame,
+        left_columns: &[usize],
+        right_columns: &[usize],
+        left_idx: &[usize],
+        right_idx: &[usize],
+        join_type: JoinType,
+        options: &ContextOptions,
+    ) -> PicachvResult<Self> {
+        counters::add(Counter::RowsJoined, left_idx.len() as u64);
+
+        if matches!(join_type, JoinType::Semi | JoinType::Anti) {
+            let f = || THREAD_POOL.install(|| lhs.gather_projected(left_columns, left_idx, false));
+            let columns = if options.enable_profiling {
+                profile(f, "join_filter".into())
+            } else {
+                f()
+            }?;
 
-            let mut lhs = lhs.clone();
-            let mut rhs = rhs.clone();
-            let (lhs, rhs) = THREAD_POOL.install(|| {
+            return Ok(PolicyGuardedDataFrame::new(columns));
+        }
+
+        picachv_ensure!(
+            left_idx.len() == right_idx.len(),
+            ComputeError: "The number of rows must be the same: {} != {}", left_idx.len(), right_idx.len(),
+        );
+
+        let (left_nullable, right_nullable) = nullable_sides(join_type);
+        let f = || {
+            THREAD_POOL.install(|| {
                 rayon::join(
-                    || {
-                        lhs.projection_by_id(left_columns)?;
-                        PicachvResult::Ok(lhs)
-                    },
-                    || {
-                        rhs.projection_by_id(right_columns)?;
-                        PicachvResult::Ok(rhs)
-                    },
+                    || lhs.gather_projected(left_columns, left_idx, left_nullable),
+                    || rhs.gather_projected(right_columns, right_idx, right_nullable),
                 )
-            });
-
-            (lhs, rhs)
+            })
         };
-
         let (lhs, rhs) = if options.enable_profiling {
-            PROFILER.profile(join_preparation, "join_preparation".into())
+            profile(f, "join_gather".into())
         } else {
-            join_preparation()
+            f()
         };
 
-        let (lhs, rhs) = (lhs?, rhs?);
-        let (lhs, rhs) = THREAD_POOL.install(|| {
-            rayon::join(
-                || {
-                    let left_idx = info
-                        .row_join_info
-                        .par_iter()
-                        .map(|e| e.left_row as usize)
-                        .collect::<Vec<_>>();
-                    lhs.new_from_slice(&left_idx)
-                },
-                || {
-                    let right_idx = info
-                        .row_join_info
+        let mut columns = lhs?;
+        columns.extend(rhs?);
+
+        Ok(PolicyGuardedDataFrame::new(columns))
+    }
+
+    /// Returns the columns in `project_list`. The columns are kept in their original order as
+    /// [`PolicyGuardedDataFrame::projection_by_id`] does.
+    pub(crate) fn projected_columns(
+        &self,
+        project_list: &[usize],
+    ) -> PicachvResult<Vec<&PolicyGuardedColumnRef>> {
+        project(self.columns(), project_list)
+    }
+
+    /// Gathers the rows `indices` of the columns in `project_list`. If `nullable` is set,
+    /// [`NULL_ROW`] is accepted and yields a clean row.
+    pub(crate) fn gather_projected(
+        &self,
+        project_list: &[usize],
+        indices: &[usize],
+        nullable: bool,
+    ) -> PicachvResult<Vec<PolicyGuardedColumnRef>> {
+        if project_list.is_empty() {
+            return Ok(vec![]);
+        }
+
+        let num_rows = self.shape().0;
+        picachv_ensure!(
+            indices
+                .par_iter()
+                .all(|&i| i < num_rows || (nullable && i == NULL_ROW)),
+            ComputeError: "The index is out of bound: the dataframe has {} rows", num_rows,
+        );
+
+        // A pending row map is composed with `indices` so that only the gathered rows are
+        // visited instead of applying it to whole columns first.
+        let (columns, indices) = match (&self.row_map, self.materialized.get()) {
+            (Some(row_map), None) => (
+                project(&self.columns, project_list)?,
+                Cow::Owned(
+                    indices
                         .par_iter()
-                        .map(|e| e.right_row as usize)
-                        .collect::<Vec<_>>();
-                    rhs.new_from_slice(&right_idx)
-                },
-            )
-        });
-        let (lhs, rhs) = (lhs?, rhs?);
+                        .map(|&i| match i {
+                            NULL_ROW => NULL_ROW,
+                            i => row_map[i],
+                        })
+                        .collect::<Vec<_>>(),
+                ),
+            ),
+            _ => (
+                self.projected_columns(project_list)?,
+                Cow::Borrowed(indices),
+            ),
+        };
+        let indices = indices.as_ref();
 
-        // We then stitch them together.
-        let res = PolicyGuardedDataFrame::stitch(&lhs, &rhs)?;
-        Ok(res)
+        Ok(columns
+            .into_par_iter()
+            .map(|c| {
+                Arc::new(PolicyGuardedColumn::from_chunks(vec![Arc::new(
+                    c.gather_with(&c.gather_plan(), indices, nullable),
+                )]))
+            })
+            .collect())
     }
 
+    /// Selects the groups with `hashes` from a dataframe produced by a multi-chunk group by.
+    ///
+    /// A hash that names no group is an error.
     pub fn select_group(&self, hashes: &[u64]) -> PicachvResult<Self> {
         picachv_ensure!(
             hashes.len() <= self.shape().0,
@@ -660,42 +1289,14 @@ impl PolicyGuardedDataFrame {
             hashes.len(), self.shape().0
         );
 
-        let hash_info = &self.additional_info.hash_info;
-
-        let slices = match THREAD_POOL.install(|| {
-            hashes
-                .par_iter()
-                .map(|hash| {
-                    hash_info.get(hash).copied().ok_or({
-                        PicachvError::InvalidOperation(
-                            format!("The hash {} is missing.", hash).into(),
-                        )
-                    })
-                })
-                .collect::<PicachvResult<Vec<_>>>()
-        }) {
-            Ok(s) => s,
-            Err(e) => {
-                panic!("Error: {e:?}");
-            },
-        };
+        let rows = self.additional_info.group_index.lookup(hashes)?;
 
-        self.new_from_slice(&slices)
+        self.new_from_slice(&rows)
     }
 
     /// According to the `groups` struct, fetch the group of columns.
     pub fn groups(&self, groups: &GroupInformation) -> PicachvResult<Self> {
-        let columns = THREAD_POOL.install(|| {
-            self.columns
-                .par_iter()
-                .map(|c: &Arc<PolicyGuardedColumn>| Ok(Arc::new(c.groups(groups)?)))
-                .collect::<PicachvResult<Vec<_>>>()
-        })?;
-
-        Ok(PolicyGuardedDataFrame {
-            columns,
-            ..Default::default()
-        })
+        self.new_from_slice(&groups.groups)
     }
 
     pub fn row(&self, idx: usize) -> PicachvResult<Vec<&PolicyRef>> {
@@ -704,8 +1305,12 @@ impl PolicyGuardedDataFrame {
             ComputeError: "The index is out of bound.",
         );
 
-        let res =
-            THREAD_POOL.install(|| self.columns.par_iter().map(|c| &c[idx]).collect::<Vec<_>>());
+        let res = THREAD_POOL.install(|| {
+            self.columns()
+                .par_iter()
+                .map(|c| &c[idx])
+                .collect::<Vec<_>>()
+        });
 
         Ok(res)
     }
@@ -720,10 +1325,10 @@ impl PolicyGuardedDataFrame {
 
         if lhs.columns.is_empty() {
             // semi edge case.
-            return Ok(rhs.clone());
+            return Ok(rhs.view());
         } else if rhs.columns.is_empty() {
             // semi edge case.
-            return Ok(lhs.clone());
+            return Ok(lhs.view());
         }
 
         picachv_ensure!(
@@ -731,17 +1336,18 @@ impl PolicyGuardedDataFrame {
             ComputeError: "The number of rows must be the same: {} != {}", lhs.shape().0, rhs.shape().0
         );
 
+        // Only the column references are copied into the new list.
         Ok(PolicyGuardedDataFrame {
-            columns: {
-                let mut lhs = lhs.columns.clone();
-                lhs.extend(rhs.columns.clone());
-
-                lhs
-            },
+            columns: lhs.columns().iter().chain(rhs.columns()).cloned().collect(),
             ..Default::default()
         })
     }
 
+    /// Stacks the rows of all the `inputs` in order.
+    ///
+    /// This is an n-way operation: each column is built by a single
+    /// [`PolicyGuardedColumn::concat`] over all the inputs, so merging the outputs of many
+    /// parallel pipelines should call it once rather than once per input.
     pub fn union(inputs: &[Arc<Self>]) -> PicachvResult<Self> {
         // Ensures we are really doing unions.
         picachv_ensure!(
@@ -755,46 +1361,40 @@ impl PolicyGuardedDataFrame {
             ComputeError: "The schemas of the inputs must be the same.",
         );
 
-        // Do unions.
-        let mut columns = vec![];
-        for i in 0..inputs[0].columns.len() {
-            let mut policies = PolicyGuardedColumn::default();
-            for input in inputs.iter() {
-                policies = policies.append(&input.columns[i])?;
-            }
-            columns.push(Arc::new(policies));
-        }
+        // Do unions. Only the uniform chunks are merged; the others are shared.
+        let columns = THREAD_POOL.install(|| {
+            (0..inputs[0].columns.len())
+                .into_par_iter()
+                .map(|i| {
+                    Arc::new(PolicyGuardedColumn::concat(
+                        inputs.iter().map(|input| input.columns()[i].deref()),
+                    ))
+                })
+                .collect()
+        });
 
-        Ok(PolicyGuardedDataFrame {
-            columns,
-            ..Default::default()
-        })
+        Ok(PolicyGuardedDataFrame::new(columns))
     }
 
     #[inline]
     pub fn new(columns: Vec<PolicyGuardedColumnRef>) -> Self {
         PolicyGuardedDataFrame {
-            columns,
+            columns: columns.into(),
             ..Default::default()
         }
     }
 
-    pub(crate) fn projection_by_id(&mut self, project_list: &[usize]) -> PicachvResult<()> {
-        picachv_ensure!(
-            project_list.iter().all(|&col| col < self.columns.len()),
-            ComputeError: "The column is out of bound: {:?} vs {:?}", self.shape().1, project_list,
-        );
-        let index_set: HashSet<_> = project_list.iter().collect();
-
-        let mut retained = 0;
-        for i in 0..self.columns.len() {
-            if index_set.contains(&i) {
-                self.columns.swap(i, retained);
-                retained += 1;
-            }
-        }
+    /// Keeps the columns in `project_list`.
+    pub fn projection_by_id(&mut self, project_list: &[usize]) -> PicachvResult<()> {
+        // A pending row map is kept; it will only be applied to the retained columns.
+        self.settle();
+        let columns = project(&self.columns, project_list)?
+            .into_iter()
+            .cloned()
+            .collect();
+        // The list may be shared with other dataframes, so it is replaced rather than changed.
+        self.columns = columns;
 
-        self.columns.truncate(retained);
         Ok(())
     }
 
@@ -803,11 +1403,9 @@ impl PolicyGuardedDataFrame {
         #[cfg(feature = "trace")]
         tracing::debug!("finalizing\n{self}");
 
-        for c in self.columns.iter() {
+        for c in self.columns().iter() {
             picachv_ensure!(
-                c.policies.par_iter().all(
-                    |(_, v)| matches!(v.deref(), Policy::PolicyClean),
-                ) && matches!(c.base_policy.deref(), Policy::PolicyClean),
+                c.chunks.par_iter().all(|chunk| chunk.is_clean()),
                 ComputeError: "Possible policy breach detected; abort early.\n\nThe required policy is\n{self}",
             );
         }
@@ -817,9 +1415,12 @@ impl PolicyGuardedDataFrame {
 
     /// Get (height, width) of the [`DataFrame`].
     pub fn shape(&self) -> (usize, usize) {
-        match self.columns.as_slice() {
+        match self.columns.as_ref() {
             &[] => (0, 0),
-            v => (v[0].len(), v.len()),
+            v => (
+                self.row_map.as_ref().map_or(v[0].len(), |m| m.len()),
+                v.len(),
+            ),
         }
     }
 
@@ -830,17 +1431,76 @@ impl PolicyGuardedDataFrame {
             ComputeError: "The length of the predicate does not match the dataframe: {} != {}", pred.len(), self.shape().0,
         );
 
-        self.columns = THREAD_POOL.install(|| {
-            self.columns
-                .par_iter()
-                .map(|c| Ok(Arc::new(c.filter(pred)?)))
-                .collect::<PicachvResult<Vec<_>>>()
-        })?;
+        self.filter_selection(&Selection::from_bools(pred))
+    }
+
+    /// Keeps the rows selected by `selection`.
+    ///
+    /// Without a pending row map the columns are filtered directly, sharing `selection` among
+    /// them; otherwise `selection` is composed into the row map.
+    pub fn filter_selection(&mut self, selection: &Selection) -> PicachvResult<()> {
+        picachv_ensure!(
+            selection.len() == self.shape().0,
+            ComputeError: "The length of the predicate does not match the dataframe: {} != {}", selection.len(), self.shape().0,
+        );
+
+        self.settle();
+        match &self.row_map {
+            Some(row_map) => {
+                let row_map = THREAD_POOL.install(|| {
+                    selection
+                        .indices()
+                        .into_par_iter()
+                        .map(|i| row_map[i])
+                        .collect::<Vec<_>>()
+                });
+                self.row_map = Some(row_map.into());
+            },
+            None => {
+                self.columns = THREAD_POOL
+                    .install(|| {
+                        self.columns
+                            .par_iter()
+                            .map(|c| Ok(Arc::new(c.filter_selection(selection)?)))
+                            .collect::<PicachvResult<Vec<_>>>()
+                    })?
+                    .into();
+            },
+        }
 
         Ok(())
     }
 }
 
+/// Filters the dataframe `df_uuid` in the arena and returns the UUID of the result.
+pub fn filter_df(
+    df_arena: &RwLock<DfArena>,
+    df_uuid: Uuid,
+    selection: &Selection,
+) -> PicachvResult<Uuid> {
+    let mut df_arena = df_arena.write();
+    let df = df_arena.get_mut(&df_uuid)?;
+    counters::add(Counter::RowsFiltered, df.shape().0 as u64);
+
+    // We first check if we are holding a strong reference to the dataframe, if so
+    // we can directly apply the transformation on the dataframe, otherwise we need
+    // to clone the dataframe and apply the transformation on the cloned dataframe.
+    // By doing so we can save the memory usage.
+    match Arc::get_mut(df) {
+        Some(df) => {
+            df.filter_selection(selection)?;
+            // We just re-use the UUID.
+            Ok(df_uuid)
+        },
+        None => {
+            let mut df = (**df).clone();
+            df.filter_selection(selection)?;
+            // We insert the new dataframe and this methods returns a new UUID.
+            df_arena.insert(df)
+        },
+    }
+}
+
 /// Apply the transformation on the involved dataframes.
 ///
 /// This function is important for keeping synchronization between the policy and the data.
@@ -866,30 +1526,11 @@ pub fn apply_transform(
     let f = || match transform.information {
         Some(ti) => match ti {
             Information::Filter(pred) => {
-                let mut df_arena = df_arena.write();
-                let df = df_arena.get_mut(&df_uuid)?;
+                // The selection is built once, without holding the lock.
+                let num_rows = df_arena.read().get(&df_uuid)?.shape().0;
+                let selection = Selection::from_filter_info(&pred, num_rows)?;
 
-                // We then apply the transformation.
-                //
-                // We first check if we are holding a strong reference to the dataframe, if so
-                // we can directly apply the transformation on the dataframe, otherwise we need
-                // to clone the dataframe and apply the transformation on the cloned dataframe.
-                // By doing so we can save the memory usage.
-                let new_uuid = match Arc::get_mut(df) {
-                    Some(df) => {
-                        df.filter(&pred.filter)?;
-                        // We just re-use the UUID.
-                        df_uuid
-                    },
-                    None => {
-                        let mut df = (**df).clone();
-                        df.filter(&pred.filter)?;
-                        // We insert the new dataframe and this methods returns a new UUID.
-                        df_arena.insert(df)?
-                    },
-                };
-
-                Ok(new_uuid)
+                filter_df(df_arena, df_uuid, &selection)
             },
 
             Information::Union(union_info) => {
@@ -913,26 +1554,27 @@ pub fn apply_transform(
             },
 
             Information::Join(join) => {
-                let mut df_arena = df_arena.write();
-
                 let lhs = Uuid::from_slice_le(&join.lhs_df_uuid)
                     .map_err(|_| PicachvError::InvalidOperation("Invalid UUID.".into()))?;
                 let rhs = Uuid::from_slice_le(&join.rhs_df_uuid)
                     .map_err(|_| PicachvError::InvalidOperation("Invalid UUID.".into()))?;
 
-                let lhs_df = df_arena.get(&lhs)?;
-                let rhs_df = df_arena.get(&rhs)?;
+                // The inputs are shared, so the arena need not be locked while joining.
+                let (lhs_df, rhs_df) = {
+                    let df_arena = df_arena.read();
+                    (df_arena.get(&lhs)?.clone(), df_arena.get(&rhs)?.clone())
+                };
 
                 let new_df = if options.enable_profiling {
-                    PROFILER.profile(
-                        || PolicyGuardedDataFrame::join(lhs_df, rhs_df, &join, options),
+                    profile(
+                        || PolicyGuardedDataFrame::join(&lhs_df, &rhs_df, &join, options),
                         "join".into(),
                     )
                 } else {
-                    PolicyGuardedDataFrame::join(lhs_df, rhs_df, &join, options)
+                    PolicyGuardedDataFrame::join(&lhs_df, &rhs_df, &join, options)
                 }?;
 
-                df_arena.insert(new_df)
+                df_arena.write().insert(new_df)
             },
 
             Information::Reorder(reorder_info) => {
@@ -945,17 +1587,21 @@ pub fn apply_transform(
                     .par_iter()
                     .map(|e| *e as usize)
                     .collect::<Vec<_>>();
+                let reorder = |df: &mut PolicyGuardedDataFrame| match reorder_info.limit {
+                    Some(limit) => df.top_k(&perm, limit as usize),
+                    None => df.reorder(&perm),
+                };
 
                 // We then apply the transformation.
                 match Arc::get_mut(df) {
                     Some(df) => {
-                        df.reorder(&perm)?;
+                        reorder(df)?;
                         // We just re-use the UUID.
                         Ok(df_uuid)
                     },
                     None => {
                         let mut df = (**df).clone();
-                        df.reorder(&perm)?;
+                        reorder(&mut df)?;
                         // We insert the new dataframe and this methods returns a new UUID.
                         df_arena.insert(df)
                     },
@@ -968,8 +1614,597 @@ pub fn apply_transform(
     };
 
     if options.enable_profiling {
-        PROFILER.profile(f, name.into())
+        profile(f, name.into())
     } else {
         f()
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::policy::PolicyLabel;
+
+    fn clean() -> PolicyRef {
+        Arc::new(Policy::PolicyClean)
+    }
+
+    fn declassify(label: PolicyLabel) -> PolicyRef {
+        Arc::new(Policy::PolicyDeclassify {
+            label: label.into(),
+            next: Policy::PolicyClean.into(),
+        })
+    }
+
+    fn top() -> PolicyRef {
+        declassify(PolicyLabel::PolicyTop)
+    }
+
+    fn bot() -> PolicyRef {
+        declassify(PolicyLabel::PolicyBot)
+    }
+
+    fn policies(col: &PolicyGuardedColumn) -> Vec<PolicyRef> {
+        (0..col.len()).map(|i| col[i].clone()).collect()
+    }
+
+    /// A column of three chunks with different base policies and a few exceptions:
+    ///
+    /// `[clean, top, clean] [top, top] [bot, clean, bot, bot]`
+    fn chunked_column() -> PolicyGuardedColumn {
+        PolicyGuardedColumn::from_chunks(vec![
+            Arc::new(PolicyChunk::new(
+                clean(),
+                3,
+                [(1, top())].into_iter().collect(),
+            )),
+            Arc::new(PolicyChunk::new(top(), 2, HashMap::new())),
+            Arc::new(PolicyChunk::new(
+                bot(),
+                4,
+                [(1, clean())].into_iter().collect(),
+            )),
+        ])
+    }
+
+    fn chunked_policies() -> Vec<PolicyRef> {
+        vec![
+            clean(),
+            top(),
+            clean(),
+            top(),
+            top(),
+            bot(),
+            clean(),
+            bot(),
+            bot(),
+        ]
+    }
+
+    /// A dataframe of [`chunked_column`] and a column chunked at other rows:
+    ///
+    /// `[bot, bot, top, bot] [clean, clean, clean, clean, clean]`
+    fn test_df() -> PolicyGuardedDataFrame {
+        let other = PolicyGuardedColumn::from_chunks(vec![
+            Arc::new(PolicyChunk::new(
+                bot(),
+                4,
+                [(2, top())].into_iter().collect(),
+            )),
+            Arc::new(PolicyChunk::new(clean(), 5, HashMap::new())),
+        ]);
+
+        PolicyGuardedDataFrame::new(vec![Arc::new(chunked_column()), Arc::new(other)])
+    }
+
+    /// The policies of `df` row by row.
+    fn rows(df: &PolicyGuardedDataFrame) -> Vec<Vec<PolicyRef>> {
+        (0..df.shape().0)
+            .map(|i| df.columns().iter().map(|c| c[i].clone()).collect())
+            .collect()
+    }
+
+    #[test]
+    fn test_column_locate() {
+        let col = chunked_column();
+        assert_eq!(col.chunks().len(), 3);
+        assert_eq!(col.len(), 9);
+
+        let expected = [
+            (0, 0),
+            (0, 1),
+            (0, 2),
+            (1, 0),
+            (1, 1),
+            (2, 0),
+            (2, 1),
+            (2, 2),
+            (2, 3),
+        ];
+        for (i, &e) in expected.iter().enumerate() {
+            assert_eq!(col.locate(i), Some(e));
+        }
+        assert_eq!(col.locate(9), None);
+        assert_eq!(policies(&col), chunked_policies());
+
+        // Empty chunks are dropped, so a column can have no chunk at all.
+        let empty = PolicyGuardedColumn::from_chunks(vec![Arc::new(PolicyChunk::default())]);
+        assert!(empty.chunks().is_empty());
+        assert_eq!(empty.locate(0), None);
+        assert!(empty.new_from_slice(&[0]).is_err());
+        assert!(empty.new_from_slice(&[]).is_ok_and(|c| c.is_empty()));
+    }
+
+    #[test]
+    fn test_column_filter_selection() {
+        let col = chunked_column();
+        let filter = [true, false, true, true, true, false, true, true, false];
+        let res = col
+            .filter_selection(&Selection::from_bools(&filter))
+            .unwrap();
+
+        let expected = chunked_policies()
+            .into_iter()
+            .zip(filter)
+            .filter_map(|(p, f)| f.then_some(p))
+            .collect::<Vec<_>>();
+        assert_eq!(policies(&res), expected);
+
+        // The chunk whose rows are all kept is shared rather than copied.
+        assert_eq!(res.chunks().len(), 3);
+        assert!(Arc::ptr_eq(&res.chunks()[1], &col.chunks()[1]));
+        assert!(col.filter(&filter[1..]).is_err());
+    }
+
+    #[test]
+    fn test_column_gather() {
+        let col = chunked_column();
+        let expected = chunked_policies();
+
+        let slice = [8, 0, 4, 4, 1, 6, 3, 5];
+        let res = col.new_from_slice(&slice).unwrap();
+        assert_eq!(res.chunks().len(), 1);
+        assert_eq!(
+            policies(&res),
+            slice
+                .iter()
+                .map(|&i| expected[i].clone())
+                .collect::<Vec<_>>()
+        );
+
+        assert!(col.new_from_slice(&[0, 9]).is_err());
+    }
+
+    #[test]
+    fn test_df_reorder() {
+        let df = test_df();
+        let expected = rows(&df);
+
+        // Every row takes its policies along.
+        let perm = [8, 2, 5, 0, 7, 1, 4, 6, 3];
+        let mut reordered = df.clone();
+        reordered.reorder(&perm).unwrap();
+        let perm_rows = perm
+            .iter()
+            .map(|&i| expected[i].clone())
+            .collect::<Vec<_>>();
+        assert_eq!(rows(&reordered), perm_rows);
+
+        // Reordering again is composed with the first permutation.
+        let again = [1, 0, 8, 7, 6, 5, 4, 3, 2];
+        reordered.reorder(&again).unwrap();
+        assert_eq!(
+            rows(&reordered),
+            again
+                .iter()
+                .map(|&i| perm_rows[i].clone())
+                .collect::<Vec<_>>()
+        );
+
+        // Bad permutations are rejected and leave the dataframe as it was.
+        let mut bad = df.clone();
+        assert!(bad.reorder(&[0, 1, 2, 3, 4, 5, 6, 7, 9]).is_err());
+        assert!(bad.reorder(&[NULL_ROW, 1, 2, 3, 4, 5, 6, 7, 8]).is_err());
+        assert!(bad.reorder(&perm[1..]).is_err());
+        assert_eq!(rows(&bad), expected);
+    }
+
+    #[test]
+    fn test_df_top_k() {
+        let df = test_df();
+        let expected = rows(&df);
+        let perm = [8, 2, 5, 0, 7, 1, 4, 6, 3];
+        let perm_rows = perm
+            .iter()
+            .map(|&i| expected[i].clone())
+            .collect::<Vec<_>>();
+
+        let mut top = df.clone();
+        top.top_k(&perm, 3).unwrap();
+        assert_eq!(rows(&top), perm_rows[..3]);
+
+        // Asking for more rows than there are keeps all of them.
+        let mut top = df.clone();
+        top.top_k(&perm, 100).unwrap();
+        assert_eq!(rows(&top), perm_rows);
+
+        let mut top = df.clone();
+        top.top_k(&perm, 0).unwrap();
+        assert_eq!(top.shape(), (0, 2));
+        assert!(top.columns().iter().all(|c| c.is_empty()));
+
+        // The length of the permutation is checked, and so is every index in its head.
+        let mut top = df.clone();
+        assert!(top.top_k(&perm[..3], 3).is_err());
+        assert!(top.top_k(&[9, 0, 1, 2, 3, 4, 5, 6, 7], 3).is_err());
+    }
+
+    /// A single column of three rows: `[top, clean, bot]`.
+    fn right_df() -> PolicyGuardedDataFrame {
+        PolicyGuardedDataFrame::new(vec![Arc::new(PolicyGuardedColumn::from_chunks(vec![
+            Arc::new(PolicyChunk::new(
+                clean(),
+                3,
+                [(0, top()), (2, bot())].into_iter().collect(),
+            )),
+        ]))])
+    }
+
+    /// The rows that a join of `left_idx` and `right_idx` should produce: the cells of both
+    /// sides side by side, with those of the null-extended side clean.
+    fn joined_rows(
+        lhs: &PolicyGuardedDataFrame,
+        rhs: &PolicyGuardedDataFrame,
+        left_idx: &[usize],
+        right_idx: &[usize],
+    ) -> Vec<Vec<PolicyRef>> {
+        let side = |df: &PolicyGuardedDataFrame, i: usize| match i {
+            NULL_ROW => vec![clean(); df.shape().1],
+            i => rows(df)[i].clone(),
+        };
+
+        left_idx
+            .iter()
+            .zip(right_idx)
+            .map(|(&l, &r)| [side(lhs, l), side(rhs, r)].concat())
+            .collect()
+    }
+
+    #[test]
+    fn test_df_inner_join() {
+        let (lhs, rhs) = (test_df(), right_df());
+        let options = ContextOptions::default();
+        let (left_idx, right_idx) = ([0, 3, 5, 5, 8], [2, 0, 1, 2, 0]);
+
+        let joined = PolicyGuardedDataFrame::join_by_idx(
+            &lhs,
+            &rhs,
+            &[0, 1],
+            &[0],
+            &left_idx,
+            &right_idx,
+            JoinType::Inner,
+            &options,
+        )
+        .unwrap();
+        assert_eq!(joined.shape(), (5, 3));
+        assert_eq!(
+            rows(&joined),
+            joined_rows(&lhs, &rhs, &left_idx, &right_idx)
+        );
+
+        // Only the projected columns are gathered, and a pending row map is followed.
+        let mut reordered = lhs.clone();
+        reordered.reorder(&[8, 7, 6, 5, 4, 3, 2, 1, 0]).unwrap();
+        let joined = PolicyGuardedDataFrame::join_by_idx(
+            &reordered,
+            &rhs,
+            &[1],
+            &[0],
+            &left_idx,
+            &right_idx,
+            JoinType::Inner,
+            &options,
+        )
+        .unwrap();
+        let expected = joined_rows(&reordered, &rhs, &left_idx, &right_idx)
+            .into_iter()
+            .map(|row| row[1..].to_vec())
+            .collect::<Vec<_>>();
+        assert_eq!(rows(&joined), expected);
+
+        // Mismatched or out-of-bound indices are rejected. Inner joins have no null rows.
+        let join = |left_idx: &[usize], right_idx: &[usize]| {
+            PolicyGuardedDataFrame::join_by_idx(
+                &lhs,
+                &rhs,
+                &[0, 1],
+                &[0],
+                left_idx,
+                right_idx,
+                JoinType::Inner,
+                &options,
+            )
+        };
+        assert!(join(&[0, 1, 2], &[0, 1]).is_err());
+        assert!(join(&[0, 1], &[0, 1, 2]).is_err());
+        assert!(join(&[0, 9], &[0, 1]).is_err());
+        assert!(join(&[0, 1], &[0, 3]).is_err());
+        assert!(join(&[0, NULL_ROW], &[0, 1]).is_err());
+        assert!(join(&[], &[]).is_ok_and(|df| df.shape() == (0, 3)));
+    }
+
+    #[test]
+    fn test_df_outer_join() {
+        let lhs = test_df();
+        // A uniform side is gathered by the fast path unless null rows are involved.
+        let uniform = PolicyGuardedDataFrame::new(vec![Arc::new(PolicyGuardedColumn::new(
+            top(),
+            3,
+            HashMap::new(),
+        ))]);
+        let options = ContextOptions::default();
+
+        for rhs in [right_df(), uniform] {
+            let join = |left_idx: &[usize], right_idx: &[usize], join_type| {
+                PolicyGuardedDataFrame::join_by_idx(
+                    &lhs,
+                    &rhs,
+                    &[0, 1],
+                    &[0],
+                    left_idx,
+                    right_idx,
+                    join_type,
+                    &options,
+                )
+            };
+
+            // Only the missing side of a null-extended row is clean.
+            let (left_idx, right_idx) = ([1, 3, 5, 8], [0, NULL_ROW, 2, NULL_ROW]);
+            let joined = join(&left_idx, &right_idx, JoinType::Left).unwrap();
+            assert_eq!(
+                rows(&joined),
+                joined_rows(&lhs, &rhs, &left_idx, &right_idx)
+            );
+            // The side that is never null-extended rejects `NULL_ROW`.
+            assert!(join(&right_idx, &left_idx, JoinType::Left).is_err());
+
+            let (left_idx, right_idx) = ([NULL_ROW, 3, NULL_ROW], [0, 1, 2]);
+            let joined = join(&left_idx, &right_idx, JoinType::Right).unwrap();
+            assert_eq!(
+                rows(&joined),
+                joined_rows(&lhs, &rhs, &left_idx, &right_idx)
+            );
+            assert!(join(&[0, 1], &[0, NULL_ROW], JoinType::Right).is_err());
+
+            let (left_idx, right_idx) = ([0, NULL_ROW, 8], [NULL_ROW, 2, 0]);
+            let joined = join(&left_idx, &right_idx, JoinType::Outer).unwrap();
+            assert_eq!(
+                rows(&joined),
+                joined_rows(&lhs, &rhs, &left_idx, &right_idx)
+            );
+            assert!(join(&[0, 1], &[0], JoinType::Outer).is_err());
+        }
+    }
+
+    #[test]
+    fn test_df_semi_anti_join() {
+        let (lhs, rhs) = (test_df(), right_df());
+        let options = ContextOptions::default();
+        let expected = rows(&lhs);
+
+        for join_type in [JoinType::Semi, JoinType::Anti] {
+            let join = |left_idx: &[usize], right_idx: &[usize]| {
+                PolicyGuardedDataFrame::join_by_idx(
+                    &lhs,
+                    &rhs,
+                    &[0, 1],
+                    &[0],
+                    left_idx,
+                    right_idx,
+                    join_type,
+                    &options,
+                )
+            };
+
+            // Only the left columns are kept, with the policies of the left rows. The right
+            // indices are not used, so they need not match.
+            let left_idx = [2, 4, 5, 7];
+            let joined = join(&left_idx, &[]).unwrap();
+            assert_eq!(joined.shape(), (4, 2));
+            assert_eq!(
+                rows(&joined),
+                left_idx
+                    .iter()
+                    .map(|&i| expected[i].clone())
+                    .collect::<Vec<_>>()
+            );
+
+            assert!(join(&[0, 9], &[]).is_err());
+            assert!(join(&[0, NULL_ROW], &[]).is_err());
+        }
+    }
+
+    /// Builds a dataframe from its rows with every policy materialized, as a reference for
+    /// the dataframes that defer their row maps.
+    fn eager_df(rows: &[Vec<PolicyRef>], width: usize) -> PolicyGuardedDataFrame {
+        PolicyGuardedDataFrame::new(
+            (0..width)
+                .map(|c| {
+                    Arc::new(
+                        PolicyGuardedColumn::new_from_iter(rows.iter().map(|r| &r[c])).unwrap(),
+                    )
+                })
+                .collect(),
+        )
+    }
+
+    #[test]
+    fn test_df_row_map() {
+        let df = test_df();
+        let expected = rows(&df);
+        let filter = [true, true, false, true, false, true, true, true, false];
+        let kept = (0..9).filter(|&i| filter[i]).collect::<Vec<_>>();
+
+        // Filter, then reorder: the permutation is recorded on top of the filtered columns.
+        let mut lazy = df.clone();
+        lazy.filter(&filter).unwrap();
+        lazy.reorder(&[5, 0, 4, 1, 3, 2]).unwrap();
+        assert!(lazy.row_map.is_some() && lazy.materialized.get().is_none());
+        let order = [5, 0, 4, 1, 3, 2].map(|i| kept[i]);
+        let ordered = order.map(|i| expected[i].clone()).to_vec();
+        assert_eq!(lazy.shape(), (6, 2));
+        assert_eq!(lazy, eager_df(&ordered, 2));
+
+        // The policies were materialized once by reading them. Filtering now settles the row
+        // map so that it is not applied twice.
+        assert!(lazy.materialized.get().is_some());
+        lazy.filter(&[true, false, true, true, false, true])
+            .unwrap();
+        assert!(lazy.row_map.is_none());
+        let filtered = [0, 2, 3, 5].map(|i| ordered[i].clone()).to_vec();
+        assert_eq!(rows(&lazy), filtered);
+
+        // Reorder, then filter: the filter is composed into the pending row map.
+        let mut lazy = df.clone();
+        lazy.reorder(&[8, 7, 6, 5, 4, 3, 2, 1, 0]).unwrap();
+        lazy.filter(&filter).unwrap();
+        assert!(lazy.materialized.get().is_none());
+        assert_eq!(
+            rows(&lazy),
+            kept.iter()
+                .map(|&i| expected[8 - i].clone())
+                .collect::<Vec<_>>()
+        );
+
+        // Projecting keeps the row map and only applies it to the remaining column.
+        let mut lazy = df.clone();
+        lazy.reorder(&[1, 3, 5, 7, 0, 2, 4, 6, 8]).unwrap();
+        lazy.projection_by_id(&[1]).unwrap();
+        assert!(lazy.row_map.is_some());
+        assert_eq!(lazy.shape(), (9, 1));
+        assert_eq!(
+            rows(&lazy),
+            [1, 3, 5, 7, 0, 2, 4, 6, 8].map(|i| vec![expected[i][1].clone()])
+        );
+        // The source dataframe is left as it was.
+        assert_eq!(rows(&df), expected);
+    }
+
+    #[test]
+    fn test_df_row_map_resets_groups() {
+        let mut df = test_df();
+        df.additional_info = Arc::new(DfInformation {
+            group_index: GroupIndex::new([(7, 0), (9, 3)].into_iter()).unwrap(),
+        });
+
+        let mut reordered = df.clone();
+        reordered.reorder(&[8, 7, 6, 5, 4, 3, 2, 1, 0]).unwrap();
+        let mut top = df.clone();
+        top.top_k(&[8, 7, 6, 5, 4, 3, 2, 1, 0], 2).unwrap();
+        let sliced = df.new_from_slice(&[3, 0]).unwrap();
+
+        // The rows recorded for the groups no longer point at the same rows.
+        assert!(!df.additional_info.group_index.is_empty());
+        for df in [reordered, top, sliced] {
+            assert!(df.additional_info.group_index.is_empty());
+        }
+    }
+
+    #[test]
+    fn test_df_slice_view() {
+        let df = test_df();
+        let expected = rows(&df);
+
+        // A view shares the columns and only records the selection vector.
+        let view = df.slice_view(&[1, 2, 4, 6, 7, 8]).unwrap();
+        assert!(Arc::ptr_eq(&view.columns, &df.columns));
+        assert!(view.materialized.get().is_none());
+        let sliced = [1, 2, 4, 6, 7, 8].map(|i| expected[i].clone()).to_vec();
+        assert_eq!(view, eager_df(&sliced, 2));
+
+        // Slicing a view composes the two selection vectors.
+        let nested = df
+            .slice_view(&[1, 2, 4, 6, 7, 8])
+            .unwrap()
+            .slice_view(&[0, 3, 5])
+            .unwrap();
+        assert!(Arc::ptr_eq(&nested.columns, &df.columns));
+        assert_eq!(rows(&nested), [1, 6, 8].map(|i| expected[i].clone()));
+
+        // So does filtering a view that has not been read yet.
+        let mut filtered = df.slice_view(&[1, 2, 4, 6, 7, 8]).unwrap();
+        filtered
+            .filter(&[false, true, true, false, true, false])
+            .unwrap();
+        assert!(Arc::ptr_eq(&filtered.columns, &df.columns));
+        assert_eq!(rows(&filtered), [2, 4, 7].map(|i| expected[i].clone()));
+
+        // Projecting a view only applies the selection vector to the remaining column.
+        let mut projected = df.slice_view(&[8, 0]).unwrap();
+        projected.projection_by_id(&[0]).unwrap();
+        assert_eq!(
+            rows(&projected),
+            [vec![expected[8][0].clone()], vec![expected[0][0].clone()]]
+        );
+
+        // Selecting every row in order is the dataframe itself.
+        let all = (0..9).collect::<Vec<u32>>();
+        let view = df.slice_view(&all).unwrap();
+        assert!(view.row_map.is_none());
+        assert_eq!(rows(&view), expected);
+
+        assert!(df.slice_view(&[0, 9]).is_err());
+        assert!(df.slice_view(&[]).is_ok_and(|view| view.shape() == (0, 2)));
+    }
+
+    #[test]
+    fn test_column_concat() {
+        let uniform = |p: PolicyRef, len| Arc::new(PolicyChunk::new(p, len, HashMap::new()));
+        let a = chunked_column();
+        let b = PolicyGuardedColumn::from_chunks(vec![
+            uniform(top(), 2),
+            uniform(top(), 3),
+            uniform(clean(), 4),
+        ]);
+        let c = PolicyGuardedColumn::from_chunks(vec![uniform(clean(), 5)]);
+
+        let res = PolicyGuardedColumn::concat([&a, &b, &c]);
+        let expected = [policies(&a), policies(&b), policies(&c)].concat();
+        assert_eq!(res.len(), 23);
+        assert_eq!(policies(&res), expected);
+
+        // The chunks are shared, except that each run of uniform chunks with the same base
+        // policy becomes one chunk: `[a0] [a1] [a2] [b0 b1] [b2 c0]`.
+        let lens = res.chunks().iter().map(|c| c.len()).collect::<Vec<_>>();
+        assert_eq!(lens, [3, 2, 4, 5, 9]);
+        for i in 0..3 {
+            assert!(Arc::ptr_eq(&res.chunks()[i], &a.chunks()[i]));
+        }
+        assert!(res.chunks()[3].is_uniform() && res.chunks()[4].is_clean());
+
+        // Uniform chunks with different base policies are kept apart.
+        let res = PolicyGuardedColumn::concat([&c, &b]);
+        assert_eq!(res.chunks().len(), 3);
+        assert_eq!(policies(&res), [policies(&c), policies(&b)].concat());
+
+        let df = test_df();
+        let union = PolicyGuardedDataFrame::union(&[Arc::new(df.clone()), Arc::new(df.clone())]);
+        assert_eq!(rows(&union.unwrap()), [rows(&df), rows(&df)].concat());
+    }
+
+    #[test]
+    fn test_column_with_density() {
+        let top = top();
+        let col = PolicyGuardedColumn::new_with_density(10_000, 0, 0.1, &top).unwrap();
+        let tainted = policies(&col).iter().filter(|p| **p == top).count();
+        assert!((900..1100).contains(&tainted));
+
+        // The offset picks the same cells as a longer column would.
+        let tail = PolicyGuardedColumn::new_with_density(5_000, 5_000, 0.1, &top).unwrap();
+        assert_eq!(policies(&tail), policies(&col)[5_000..]);
+
+        let clean_col = PolicyGuardedColumn::new_with_density(100, 0, 0.0, &top).unwrap();
+        assert!(clean_col.chunks().iter().all(|c| c.is_clean()));
+    }
+}
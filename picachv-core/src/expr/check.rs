@@ -12,7 +12,6 @@ use super::{ColumnIdent, ExpressionEvalContext};
 use crate::dataframe::PolicyRef;
 use crate::policy::types::ValueArrayRef;
 use crate::policy::{policy_ok, BinaryTransformType, Policy, TransformType};
-use crate::profiler::PROFILER;
 use crate::thread_pool::THREAD_POOL;
 use crate::udf::Udf;
 use crate::{build_unary_expr, cast, policy_binary_transform_label, policy_unary_transform_label};
@@ -30,7 +29,8 @@ impl PExpr {
         ))?;
 
         let groups = if options.enable_profiling {
-            PROFILER.profile(|| ctx.df.groups(groups), "grouping".into())
+            ctx.profiler
+                .profile(|| ctx.df.groups(groups), "grouping".into())
         } else {
             ctx.df.groups(groups)
         }?;
@@ -47,7 +47,7 @@ impl PExpr {
                 Ok(THREAD_POOL.install(|| {
                     (0..groups.shape().0)
                         .into_par_iter()
-                        .map(|i| groups.columns[col][i].clone())
+                        .map(|i| groups.columns()[col][i].clone())
                         .collect::<Vec<_>>()
                 }))
             },
@@ -71,7 +71,7 @@ impl PExpr {
                             for (j, arg) in args.iter().enumerate() {
                                 let arg = arg.check_policy_in_row(ctx, i)?;
                                 p = check_policy_binary_udf(
-                                    &groups.columns[j][i],
+                                    &groups.columns()[j][i],
                                     &arg,
                                     &udf_desc.name,
                                     value,
@@ -237,10 +237,11 @@ impl AExpr {
         hasher.finish()
     }
 
-    /// Reifies the current expression with the provided `RecordBatch`.
+    /// Reifies the current expression with the provided `RecordBatch`es.
     ///
-    /// This operation prepares the expression for policy checking.
-    pub fn reify(&mut self, values: RecordBatch) -> PicachvResult<()> {
+    /// This operation prepares the expression for policy checking. The batches are converted
+    /// one after another so that they never need to be concatenated beforehand.
+    pub fn reify(&mut self, values: &[RecordBatch]) -> PicachvResult<()> {
         let values_mut = match self {
             AExpr::Apply { values, .. }
             | AExpr::BinaryExpr { values, .. }
@@ -248,14 +249,24 @@ impl AExpr {
             _ => picachv_bail!(ComputeError: "The expression does not need reification."),
         };
 
-        let values = convert_record_batch(values)?;
+        let values = match values {
+            [rb] => convert_record_batch(rb)?,
+            _ => {
+                let mut res = vec![];
+                for rb in values {
+                    res.extend(convert_record_batch(rb)?);
+                }
+                res
+            },
+        };
         values_mut.replace(values.into());
 
         Ok(())
     }
 }
 
-pub(crate) fn convert_record_batch(rb: RecordBatch) -> PicachvResult<Vec<ValueArrayRef>> {
+/// Converts the record batch into one array of values per row.
+pub fn convert_record_batch(rb: &RecordBatch) -> PicachvResult<Vec<ValueArrayRef>> {
     let columns = rb.columns();
 
     if columns.is_empty() {
@@ -425,7 +436,7 @@ impl fmt::Display for AExpr {
 /// This functons folds the policies on the groups to check this operation is allowed.
 ///
 /// See `eval_agg` in `expression.v`.
-pub(crate) fn fold_on_groups(groups: &[PolicyRef], how: GroupByMethod) -> PicachvResult<Policy> {
+pub fn fold_on_groups(groups: &[PolicyRef], how: GroupByMethod) -> PicachvResult<Policy> {
     // Construct the operator.
     #[cfg(feature = "trace")]
     tracing::debug!("{how:?} {}", groups.len());
@@ -0,0 +1,170 @@
+use picachv_error::{picachv_ensure, PicachvError, PicachvResult};
+use rayon::prelude::*;
+use serde::{Deserialize, Serialize};
+
+use crate::thread_pool::THREAD_POOL;
+
+/// Marks a slot that holds no group.
+const EMPTY: usize = usize::MAX;
+
+/// The number of lookups whose slots are prefetched together.
+const PROBE_BATCH: usize = 16;
+
+/// Maps the hash of each group of an aggregated dataframe to the row holding the group.
+///
+/// DuckDB finalizes a partitioned aggregate by asking for the groups of each partition by their
+/// hashes, so the lookups sit on the hot path. The index is a flat open-addressing table with
+/// linear probing and a load factor of at most one half. Each slot keeps the hash next to its
+/// row, so a lookup usually touches a single cache line, and [`GroupIndex::lookup`] prefetches
+/// the slots of a whole batch of hashes before comparing any of them.
+#[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
+pub struct GroupIndex {
+    /// `(hash, row)` pairs; `row` is [`EMPTY`] for a free slot.
+    slots: Vec<(u64, usize)>,
+    /// The table has `1 << (64 - shift)` slots.
+    shift: u32,
+    /// The number of groups.
+    len: usize,
+}
+
+impl GroupIndex {
+    /// Builds the index from `(hash, row)` pairs. The hashes must be distinct.
+    pub fn new(groups: impl ExactSizeIterator<Item = (u64, usize)>) -> PicachvResult<Self> {
+        let len = groups.len();
+        let capacity = (len * 2).next_power_of_two().max(2);
+        let mut index = Self {
+            slots: vec![(0, EMPTY); capacity],
+            shift: 64 - capacity.trailing_zeros(),
+            len,
+        };
+
+        let mask = capacity - 1;
+        for (hash, row) in groups {
+            let mut slot = index.home(hash);
+            while index.slots[slot].1 != EMPTY {
+                picachv_ensure!(
+                    index.slots[slot].0 != hash,
+                    ComputeError: "The hash {} is shared by two groups", hash,
+                );
+                slot = (slot + 1) & mask;
+            }
+            index.slots[slot] = (hash, row);
+        }
+
+        Ok(index)
+    }
+
+    /// The number of groups.
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Returns the row of the group with `hash`.
+    pub fn get(&self, hash: u64) -> Option<usize> {
+        match self.slots.is_empty() {
+            true => None,
+            false => self.probe(hash, self.home(hash)),
+        }
+    }
+
+    /// Returns the rows of the groups with `hashes`, in order.
+    pub fn lookup(&self, hashes: &[u64]) -> PicachvResult<Vec<usize>> {
+        picachv_ensure!(
+            !self.slots.is_empty() || hashes.is_empty(),
+            ComputeError: "The dataframe has no group index",
+        );
+
+        let mut rows = vec![EMPTY; hashes.len()];
+        THREAD_POOL.install(|| {
+            rows.par_chunks_mut(PROBE_BATCH)
+                .zip(hashes.par_chunks(PROBE_BATCH))
+                .try_for_each(|(rows, hashes)| {
+                    let mut slots = [0; PROBE_BATCH];
+                    for (slot, &hash) in slots.iter_mut().zip(hashes) {
+                        *slot = self.home(hash);
+                        prefetch(&self.slots[*slot]);
+                    }
+
+                    for ((row, &hash), &slot) in rows.iter_mut().zip(hashes).zip(slots.iter()) {
+                        *row = self.probe(hash, slot).ok_or_else(|| {
+                            PicachvError::ComputeError(
+                                format!("The group with hash {} does not exist", hash).into(),
+                            )
+                        })?;
+                    }
+
+                    Ok(())
+                })
+        })?;
+
+        Ok(rows)
+    }
+
+    /// The slot where the search for `hash` starts.
+    #[inline]
+    fn home(&self, hash: u64) -> usize {
+        // The hashes come from the query engine and their low bits may be poorly mixed.
+        (hash.wrapping_mul(0x9E37_79B9_7F4A_7C15) >> self.shift) as usize
+    }
+
+    #[inline]
+    fn probe(&self, hash: u64, mut slot: usize) -> Option<usize> {
+        let mask = self.slots.len() - 1;
+        loop {
+            match self.slots[slot] {
+                (_, EMPTY) => return None,
+                (h, row) if h == hash => return Some(row),
+                _ => slot = (slot + 1) & mask,
+            }
+        }
+    }
+}
+
+#[inline(always)]
+fn prefetch<T>(p: &T) {
+    #[cfg(target_arch = "x86_64")]
+    // SAFETY: Prefetching is a hint and never faults.
+    unsafe {
+        std::arch::x86_64::_mm_prefetch::<{ std::arch::x86_64::_MM_HINT_T0 }>(
+            p as *const T as *const i8,
+        );
+    }
+
+    #[cfg(not(target_arch = "x86_64"))]
+    let _ = p;
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_group_index() {
+        // Zero is a valid hash, and the multiples of a large power of two collide in the low bits.
+        let hashes = (0..1000u64).map(|i| i << 40).collect::<Vec<_>>();
+        let index = GroupIndex::new(hashes.iter().enumerate().map(|(row, &h)| (h, row))).unwrap();
+
+        assert_eq!(index.len(), 1000);
+        for (row, &h) in hashes.iter().enumerate() {
+            assert_eq!(index.get(h), Some(row));
+        }
+
+        let query = hashes.iter().rev().copied().collect::<Vec<_>>();
+        assert_eq!(
+            index.lookup(&query).unwrap(),
+            (0..1000).rev().collect::<Vec<_>>()
+        );
+
+        assert_eq!(index.get(1), None);
+        assert!(index.lookup(&[hashes[3], 1]).is_err());
+        assert!(GroupIndex::new([(7, 0), (7, 1)].into_iter()).is_err());
+        assert!(GroupIndex::default().lookup(&[0]).is_err());
+        assert!(GroupIndex::default().lookup(&[]).unwrap().is_empty());
+    }
+}
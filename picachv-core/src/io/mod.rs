@@ -10,6 +10,8 @@ use crate::dataframe::{PolicyGuardedDataFrame, PolicyGuardedDataFrameProxy};
 
 #[cfg(all(feature = "fast_bin", feature = "parquet"))]
 pub mod parquet;
+#[cfg(all(feature = "fast_bin", feature = "parquet"))]
+pub mod scan;
 
 #[cfg(feature = "json")]
 pub trait JsonIO: Sized {
@@ -192,6 +194,122 @@ mod tests {
         assert_eq!(df, df2);
     }
 
+    #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
+    fn test_parquet_policy_stats() {
+        let df = test_df();
+        let path = env::temp_dir().join("test_stats.parquet");
+        let res = df.to_parquet(&path);
+        assert!(res.is_ok());
+
+        let stats = crate::io::parquet::PolicyParquetStats::from_path(&path);
+        assert!(stats.as_ref().is_ok_and(|s| s.is_some()));
+        let stats = stats.unwrap().unwrap();
+        assert_eq!(stats.row_groups.len(), 1);
+        assert!(!stats.is_clean(0, &[0]));
+        assert_eq!(
+            stats.row_groups[0].columns[0]
+                .policies
+                .as_ref()
+                .map(|p| p.len()),
+            Some(2)
+        );
+    }
+
+    #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
+    fn test_parquet_clean_selection() {
+        let clean = PolicyGuardedColumnProxy::new(vec![Arc::new(Policy::PolicyClean); 3]);
+        let df: PolicyGuardedDataFrame = PolicyGuardedDataFrameProxy {
+            columns: vec![clean],
+        }
+        .into();
+        let path = env::temp_dir().join("test_clean.parquet");
+        let res = df.to_parquet(&path);
+        assert!(res.is_ok());
+
+        // The clean shortcut still checks the length of the selection.
+        let df2 = PolicyGuardedDataFrame::from_parquet(&path, &[0], Some(&[true, false, true]));
+        assert!(df2.is_ok_and(|df2| df2.shape().0 == 2));
+        let df2 = PolicyGuardedDataFrame::from_parquet(&path, &[0], Some(&[true, false]));
+        assert!(df2.is_err());
+    }
+
+    #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
+    fn test_parquet_scan() {
+        let df = test_df();
+        let path = env::temp_dir().join("test_scan.parquet");
+        let res = df.to_parquet(&path);
+        assert!(res.is_ok());
+
+        let scan = crate::io::scan::PolicyScan::open(&path, &[0]);
+        assert!(scan.is_ok());
+        let scan = scan.unwrap();
+        assert_eq!(scan.num_row_groups(), 1);
+
+        let df2 = scan.read_row_group(0, None);
+        assert!(df2.as_ref().is_ok_and(|df2| df2 == &df));
+        let df2 = scan.read_row_group(0, Some(&[false, true]));
+        assert!(df2.is_ok_and(|df2| df2.shape().0 == 1));
+    }
+
+    #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
+    fn test_parquet_check_downgrade() {
+        let df = test_df();
+        let path = env::temp_dir().join("test_downgrade.parquet");
+        let res = df.to_parquet(&path);
+        assert!(res.is_ok());
+
+        // `PolicyTop ⇝ ∅` can be downgraded by `PolicyTop` but not by `PolicyBot`.
+        let allowed = Arc::new(PolicyLabel::PolicyTop);
+        let denied = Arc::new(PolicyLabel::PolicyBot);
+
+        let scan = crate::io::scan::PolicyScan::open(&path, &[0]).unwrap();
+        assert!(scan.check_downgrade(&allowed).is_ok());
+        assert!(scan.check_downgrade(&denied).is_err());
+        // The check only looked at the footer: no policy has been decoded yet.
+        assert!(scan.interned.read().is_empty());
+
+        let df2 = PolicyGuardedDataFrame::from_parquet_checked(&path, &[0], None, &allowed);
+        assert!(df2.is_ok_and(|df2| df2 == df));
+        let df2 = PolicyGuardedDataFrame::from_parquet_checked(&path, &[0], None, &denied);
+        assert!(df2.is_err());
+    }
+
+    #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
+    fn test_parquet_read_rows() {
+        let policy = Arc::new(Policy::PolicyDeclassify {
+            label: PolicyLabel::PolicyTop.into(),
+            next: Policy::PolicyClean.into(),
+        });
+        let policies = (0..10)
+            .map(|i| match i % 3 {
+                0 => policy.clone(),
+                _ => Arc::new(Policy::PolicyClean),
+            })
+            .collect::<Vec<_>>();
+        let df: PolicyGuardedDataFrame = PolicyGuardedDataFrameProxy {
+            columns: vec![PolicyGuardedColumnProxy::new(policies)],
+        }
+        .into();
+
+        let path = env::temp_dir().join("test_rows.parquet");
+        let options = crate::io::parquet::PolicyParquetOptions {
+            row_group_size: 4,
+            data_page_row_count_limit: 2,
+            ..Default::default()
+        };
+        let res = df.to_parquet_with_options(&path, &options);
+        assert!(res.is_ok());
+
+        let expected = df.new_from_slice(&[3, 4, 5, 6, 7]).unwrap();
+        let df2 = PolicyGuardedDataFrame::read_policy_rows(&path, &[0], 3, 5, None);
+        assert!(df2.is_ok_and(|df2| df2 == expected));
+
+        let expected = df.new_from_slice(&[3, 6]).unwrap();
+        let selection = [true, false, false, true, false];
+        let df2 = PolicyGuardedDataFrame::read_policy_rows(&path, &[0], 3, 5, Some(&selection));
+        assert!(df2.is_ok_and(|df2| df2 == expected));
+    }
+
     #[cfg_attr(all(feature = "fast_bin", feature = "parquet"), test)]
     fn test_parquet_read_row_group() {
         let path = "../data/policies/lineitem.parquet.policy.parquet";
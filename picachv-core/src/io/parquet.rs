@@ -3,15 +3,24 @@ use std::ops::Deref;
 use std::path::Path;
 use std::sync::Arc;
 
+use ahash::{HashMap, HashMapExt, HashSet, HashSetExt};
 use arrow_array::{BooleanArray, LargeBinaryArray, RecordBatch};
-use parquet::arrow::arrow_reader::{ArrowReaderBuilder, RowSelection, SyncReader};
+use parquet::arrow::arrow_reader::{
+    ArrowReaderBuilder, ArrowReaderOptions, RowSelection, RowSelector, SyncReader,
+};
 use parquet::arrow::{ArrowWriter, ProjectionMask};
+use parquet::basic::{Compression, ZstdLevel};
+use parquet::file::metadata::{KeyValue, ParquetMetaData};
 use parquet::file::properties::WriterProperties;
 use picachv_error::{picachv_bail, picachv_ensure, PicachvError, PicachvResult};
 use rayon::prelude::*;
+use serde::{Deserialize, Serialize};
 
-use crate::dataframe::{PolicyGuardedColumnProxy, PolicyGuardedDataFrame};
+use crate::dataframe::{
+    PolicyGuardedColumn, PolicyGuardedColumnProxy, PolicyGuardedDataFrame, PolicyRef,
+};
 use crate::io::BinIo;
+use crate::policy::{Policy, PolicyLabel};
 use crate::thread_pool::THREAD_POOL;
 
 /// This constant defines the default size of a row group in a Parquet file.
@@ -19,6 +28,194 @@ use crate::thread_pool::THREAD_POOL;
 /// is an efficient size for the row group.
 pub const DEFAULT_ROW_GROUP_SIZE: usize = 2048;
 
+/// The default number of rows in a data page. Pages are the unit that the offset index lets
+/// a reader skip, so keeping them as small as a DuckDB vector allows row-range reads to be
+/// served from large row groups without decoding the whole row group.
+pub const DEFAULT_PAGE_ROW_COUNT: usize = 2048;
+
+/// The key of the footer metadata entry that stores the [`PolicyParquetStats`].
+pub const ROW_GROUP_STATS_KEY: &str = "picachv.row_group_stats";
+
+/// The maximum number of distinct policies recorded for a column in a row group. Beyond
+/// this only the `clean` flag is kept so that the footer stays small.
+pub const MAX_STATS_POLICIES: usize = 16;
+
+/// The codec used to compress the policy columns.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum PolicyCompression {
+    #[default]
+    None,
+    Snappy,
+    Lz4,
+    /// Zstandard with the given level (1 to 22).
+    Zstd(i32),
+}
+
+impl PolicyCompression {
+    fn to_parquet(self) -> PicachvResult<Compression> {
+        Ok(match self {
+            PolicyCompression::None => Compression::UNCOMPRESSED,
+            PolicyCompression::Snappy => Compression::SNAPPY,
+            PolicyCompression::Lz4 => Compression::LZ4_RAW,
+            PolicyCompression::Zstd(level) => {
+                Compression::ZSTD(ZstdLevel::try_new(level).map_err(|e| {
+                    PicachvError::InvalidOperation(format!("Invalid zstd level. {e}").into())
+                })?)
+            },
+        })
+    }
+}
+
+/// Options for writing the policy Parquet file.
+#[derive(Clone, Debug)]
+pub struct PolicyParquetOptions {
+    pub compression: PolicyCompression,
+    /// The maximum number of rows in a row group. This need not match the data file if the
+    /// file is read with [`PolicyGuardedDataFrame::read_policy_rows`].
+    pub row_group_size: usize,
+    /// The maximum number of rows in a data page.
+    pub data_page_row_count_limit: usize,
+}
+
+impl Default for PolicyParquetOptions {
+    fn default() -> Self {
+        Self {
+            compression: Default::default(),
+            row_group_size: DEFAULT_ROW_GROUP_SIZE,
+            data_page_row_count_limit: DEFAULT_PAGE_ROW_COUNT,
+        }
+    }
+}
+
+/// Policy statistics of a column within a row group.
+#[derive(Clone, Debug, Serialize, Deserialize, PartialEq)]
+pub struct ColumnPolicyStats {
+    /// Whether every cell carries [`Policy::PolicyClean`].
+    pub clean: bool,
+    /// The distinct policies, or `None` if there are more than [`MAX_STATS_POLICIES`] of them.
+    pub policies: Option<Vec<PolicyRef>>,
+}
+
+/// Policy statistics of a row group.
+#[derive(Clone, Debug, Serialize, Deserialize, PartialEq)]
+pub struct RowGroupPolicyStats {
+    pub num_rows: usize,
+    pub columns: Vec<ColumnPolicyStats>,
+}
+
+/// The per-row-group policy statistics written by [`PolicyGuardedDataFrame::to_parquet`].
+///
+/// This is the policy-side counterpart of Parquet's min/max statistics: it allows the reader
+/// to skip decoding row groups that carry no policy at all, and to reject an operation before
+/// any policy is read if some policy present in the file can never be downgraded by it.
+#[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
+pub struct PolicyParquetStats {
+    pub row_groups: Vec<RowGroupPolicyStats>,
+}
+
+impl ColumnPolicyStats {
+    fn new(policies: &[PolicyRef]) -> Self {
+        let clean = policies
+            .iter()
+            .all(|p| matches!(p.deref(), Policy::PolicyClean));
+
+        let mut distinct = HashSet::new();
+        for p in policies.iter() {
+            distinct.insert(p);
+            if distinct.len() > MAX_STATS_POLICIES {
+                break;
+            }
+        }
+
+        let policies =
+            (distinct.len() <= MAX_STATS_POLICIES).then(|| distinct.into_iter().cloned().collect());
+
+        ColumnPolicyStats { clean, policies }
+    }
+}
+
+impl PolicyParquetStats {
+    /// Reads the statistics from the footer of the Parquet file at `path`.
+    ///
+    /// Returns `None` if the file was written without statistics.
+    pub fn from_path<P: AsRef<Path>>(path: P) -> PicachvResult<Option<Self>> {
+        let builder = get_initial_builder(path, &[])?;
+        Self::from_metadata(builder.metadata())
+    }
+
+    /// Extracts the statistics from the parsed Parquet metadata.
+    pub fn from_metadata(metadata: &ParquetMetaData) -> PicachvResult<Option<Self>> {
+        let value = metadata
+            .file_metadata()
+            .key_value_metadata()
+            .and_then(|kv| kv.iter().find(|kv| kv.key == ROW_GROUP_STATS_KEY))
+            .and_then(|kv| kv.value.as_ref());
+
+        let stats = match value {
+            Some(value) => serde_json::from_str::<Self>(value).map_err(|e| {
+                PicachvError::InvalidOperation(
+                    format!("Failed to parse the policy statistics: {e}").into(),
+                )
+            })?,
+            None => return Ok(None),
+        };
+
+        picachv_ensure!(
+            stats.row_groups.len() == metadata.num_row_groups(),
+            InvalidOperation: "The policy statistics cover {} row groups but the file has {}",
+            stats.row_groups.len(),
+            metadata.num_row_groups(),
+        );
+        // Stale statistics would mark rows that carry policies as clean.
+        for (i, rg) in stats.row_groups.iter().enumerate() {
+            picachv_ensure!(
+                rg.num_rows == metadata.row_group(i).num_rows() as usize,
+                InvalidOperation: "The policy statistics cover {} rows in row group {} but the file has {}",
+                rg.num_rows,
+                i,
+                metadata.row_group(i).num_rows(),
+            );
+        }
+
+        Ok(Some(stats))
+    }
+
+    /// Checks if the projected columns of a row group are entirely clean.
+    pub fn is_clean(&self, row_group_index: usize, projection: &[usize]) -> bool {
+        self.row_groups.get(row_group_index).is_some_and(|rg| {
+            projection
+                .iter()
+                .all(|&col| rg.columns.get(col).is_some_and(|c| c.clean))
+        })
+    }
+
+    /// Checks before any policy is read that every policy present in the projected columns
+    /// can be downgraded by `by`.
+    ///
+    /// Columns whose distinct policies were not recorded are assumed to be fine; they will be
+    /// checked as usual once they are read.
+    pub fn check_downgrade(
+        &self,
+        projection: &[usize],
+        by: &Arc<PolicyLabel>,
+    ) -> PicachvResult<()> {
+        let columns = self
+            .row_groups
+            .iter()
+            .flat_map(|rg| projection.iter().filter_map(|&col| rg.columns.get(col)))
+            .filter(|c| !c.clean)
+            .filter_map(|c| c.policies.as_ref())
+            .collect::<Vec<_>>();
+
+        THREAD_POOL.install(|| {
+            columns
+                .into_par_iter()
+                .flatten()
+                .try_for_each(|p| p.downgrade(by).map(|_| ()))
+        })
+    }
+}
+
 impl PolicyGuardedDataFrame {
     /// Reads policies from the parquet file.
     ///
@@ -47,16 +244,53 @@ impl PolicyGuardedDataFrame {
         path: P,
         projection: &[usize],
         selection: Option<&[bool]>,
+    ) -> PicachvResult<Self> {
+        Self::read_parquet(path, projection, selection, None)
+    }
+
+    /// Same as [`PolicyGuardedDataFrame::from_parquet`], but fails before any row group is
+    /// decoded if the policy statistics show a policy that cannot be downgraded by `by`.
+    pub fn from_parquet_checked<P: AsRef<Path>>(
+        path: P,
+        projection: &[usize],
+        selection: Option<&[bool]>,
+        by: &Arc<PolicyLabel>,
+    ) -> PicachvResult<Self> {
+        Self::read_parquet(path, projection, selection, Some(by))
+    }
+
+    fn read_parquet<P: AsRef<Path>>(
+        path: P,
+        projection: &[usize],
+        selection: Option<&[bool]>,
+        downgrade: Option<&Arc<PolicyLabel>>,
     ) -> PicachvResult<Self> {
         let mut builder = get_initial_builder(path, projection)?;
-        let file_metadata = builder.metadata().file_metadata();
 
-        // Do a predicate pushdown.
+        let num_rows = builder.metadata().file_metadata().num_rows() as usize;
         if let Some(selection) = selection {
-            picachv_ensure!(selection.len() == file_metadata.num_rows() as usize,
+            picachv_ensure!(selection.len() == num_rows,
                 InvalidOperation: "The selection array is not equal to the number of rows in the file"
             );
+        }
+
+        if let Some(stats) = PolicyParquetStats::from_metadata(builder.metadata())? {
+            if let Some(by) = downgrade {
+                stats.check_downgrade(projection, by)?;
+            }
+
+            if (0..stats.row_groups.len()).all(|rg| stats.is_clean(rg, projection)) {
+                let num_rows = match selection {
+                    Some(selection) => selection.iter().filter(|&&b| b).count(),
+                    None => num_rows,
+                };
+
+                return Ok(clean_df(projection.len(), num_rows));
+            }
+        }
 
+        // Do a predicate pushdown.
+        if let Some(selection) = selection {
             // Make selection array as an array of boolean arrays.
             let row_groups = builder.metadata().row_groups();
             let row_groups = THREAD_POOL.install(|| {
@@ -84,15 +318,17 @@ impl PolicyGuardedDataFrame {
         collect_reader(builder)
     }
 
-    /// Reads the policy dataframe from a specific row group with a specified number of rows.
+    /// Reads the policy dataframe from a specific row group.
     ///
     /// # Warnings
     ///
-    /// Use of this method requires the size of the row group to be [`DEFAULT_ROW_GROUP_SIZE`]
-    /// for both the data side and the policy side.
+    /// The row group refers to the *policy* file. Use of this method thus requires the data file
+    /// and the policy file to have the same row group layout; otherwise use
+    /// [`PolicyGuardedDataFrame::read_policy_rows`] which addresses logical rows.
     ///
-    /// By default the argument `num_row_read` should be set to this value. However, this value
-    /// might be *smaller* than this value which occurs when the last row group num < 2048.
+    /// The policy statistics are not consulted here since parsing them on every call would
+    /// cost more the more row groups the file has; a [`crate::io::scan::PolicyScan`] parses
+    /// them once and skips the clean row groups.
     pub fn from_parquet_row_group<P: AsRef<Path>>(
         path: P,
         projection: &[usize],
@@ -110,10 +346,6 @@ impl PolicyGuardedDataFrame {
         );
 
         let row_group_meta = metadata.row_group(row_group_index);
-        picachv_ensure!(
-            row_group_meta.num_rows() as usize <= DEFAULT_ROW_GROUP_SIZE,
-            InvalidOperation: "The number of rows in the row group is greater than the default row group size"
-        );
 
         builder = builder.with_row_groups(vec![row_group_index]);
         if let Some(selection) = selection {
@@ -133,13 +365,79 @@ impl PolicyGuardedDataFrame {
         collect_reader(builder)
     }
 
+    /// Reads the policies of the logical rows `start_row..start_row + len`, independently of
+    /// how the policy file is split into row groups.
+    ///
+    /// Only the row groups overlapping the range are visited, and within them the offset index
+    /// is used to skip the pages outside the range, so large row groups cost little more than
+    /// small ones. `selection`, if given, has `len` entries and further filters the range.
+    pub fn read_policy_rows<P: AsRef<Path>>(
+        path: P,
+        projection: &[usize],
+        start_row: usize,
+        len: usize,
+        selection: Option<&[bool]>,
+    ) -> PicachvResult<Self> {
+        let file = File::open(path).map_err(|e| {
+            PicachvError::InvalidOperation(format!("Failed to open file: {}", e).into())
+        })?;
+        let builder = ArrowReaderBuilder::try_new_with_options(
+            file,
+            ArrowReaderOptions::new().with_page_index(true),
+        )
+        .map_err(|e| {
+            PicachvError::InvalidOperation(format!("Failed to create Parquet reader: {}", e).into())
+        })?
+        .with_batch_size(DEFAULT_ROW_GROUP_SIZE);
+
+        let metadata = builder.metadata().clone();
+        let stats = PolicyParquetStats::from_metadata(&metadata)?;
+        let range = RowRange::new(&metadata, start_row, len, selection)?;
+        if let Some(df) = range.try_clean(stats.as_ref(), projection) {
+            return Ok(df);
+        }
+
+        let proj_mask =
+            ProjectionMask::roots(metadata.file_metadata().schema_descr(), projection.to_vec());
+        let builder = builder
+            .with_projection(proj_mask)
+            .with_row_groups(range.row_groups.clone())
+            .with_row_selection(range.row_selection());
+
+        collect_reader(builder)
+    }
+
+    /// Writes the policies to an uncompressed Parquet file.
+    #[inline]
     pub fn to_parquet<P: AsRef<Path>>(&self, path: P) -> PicachvResult<()> {
-        let bin: Vec<(String, Arc<dyn arrow_array::Array>)> = THREAD_POOL.install(|| {
-            self.columns
+        self.to_parquet_with_options(path, &Default::default())
+    }
+
+    /// Writes the policies to a Parquet file with the given `options`.
+    pub fn to_parquet_with_options<P: AsRef<Path>>(
+        &self,
+        path: P,
+        options: &PolicyParquetOptions,
+    ) -> PicachvResult<()> {
+        let compression = options.compression.to_parquet()?;
+        picachv_ensure!(
+            options.row_group_size > 0 && options.data_page_row_count_limit > 0,
+            InvalidOperation: "The row group size and the page size must be positive",
+        );
+        let bin: Vec<(
+            (String, Arc<dyn arrow_array::Array>),
+            Vec<ColumnPolicyStats>,
+        )> = THREAD_POOL.install(|| {
+            self.columns()
                 .par_iter()
                 .enumerate()
                 .map(|(idx, col)| {
                     let col = PolicyGuardedColumnProxy::from(col.deref());
+                    let stats = col
+                        .policies
+                        .par_chunks(options.row_group_size)
+                        .map(ColumnPolicyStats::new)
+                        .collect::<Vec<_>>();
                     let policies = col
                         .policies
                         .into_par_iter()
@@ -151,13 +449,14 @@ impl PolicyGuardedDataFrame {
                     let policies = Arc::new(LargeBinaryArray::from_vec(
                         policies.iter().map(|e| e.as_ref()).collect(),
                     )) as _;
-                    Ok((format!("col_{idx}"), policies))
+                    Ok(((format!("col_{idx}"), policies), stats))
                 })
                 .collect::<PicachvResult<Vec<_>>>()
         })?;
+        let (bin, stats): (Vec<_>, Vec<_>) = bin.into_iter().unzip();
 
         picachv_ensure!(
-            bin.len() == self.columns.len(),
+            bin.len() == self.columns().len(),
             ComputeError: "The number of columns and the number of binary data are not equal"
         );
 
@@ -166,9 +465,21 @@ impl PolicyGuardedDataFrame {
         })?;
         let file = File::create(path)?;
 
+        let stats = row_group_stats(stats, self.shape().0, options.row_group_size);
+        let stats = serde_json::to_string(&stats).map_err(|e| {
+            PicachvError::InvalidOperation(
+                format!("Failed to serialize the policy statistics. {e}").into(),
+            )
+        })?;
+
         let writer_prop = WriterProperties::builder()
-            .set_max_row_group_size(DEFAULT_ROW_GROUP_SIZE)
-            // .set_compression(Compression::ZSTD(ZstdLevel::try_new(1).unwrap()))
+            .set_max_row_group_size(options.row_group_size)
+            .set_data_page_row_count_limit(options.data_page_row_count_limit)
+            .set_key_value_metadata(Some(vec![KeyValue::new(
+                ROW_GROUP_STATS_KEY.to_string(),
+                stats,
+            )]))
+            .set_compression(compression)
             .build();
         let mut writer =
             ArrowWriter::try_new(file, rb.schema(), Some(writer_prop)).map_err(|e| {
@@ -186,6 +497,138 @@ impl PolicyGuardedDataFrame {
     }
 }
 
+/// Transposes the per-column statistics into per-row-group statistics.
+fn row_group_stats(
+    columns: Vec<Vec<ColumnPolicyStats>>,
+    num_rows: usize,
+    row_group_size: usize,
+) -> PolicyParquetStats {
+    let num_row_groups = num_rows.div_ceil(row_group_size);
+    let mut row_groups = (0..num_row_groups)
+        .map(|i| RowGroupPolicyStats {
+            num_rows: row_group_size.min(num_rows - i * row_group_size),
+            columns: Vec::with_capacity(columns.len()),
+        })
+        .collect::<Vec<_>>();
+
+    for column in columns {
+        for (rg, stats) in row_groups.iter_mut().zip(column) {
+            rg.columns.push(stats);
+        }
+    }
+
+    PolicyParquetStats { row_groups }
+}
+
+/// A range of logical rows mapped onto the row groups of a Parquet file.
+pub(crate) struct RowRange<'a> {
+    /// The row groups overlapping the range.
+    pub(crate) row_groups: Vec<usize>,
+    /// The number of rows to skip in the first row group.
+    skip: usize,
+    /// The number of rows left in the last row group after the range.
+    trailing: usize,
+    len: usize,
+    selection: Option<&'a [bool]>,
+}
+
+impl<'a> RowRange<'a> {
+    pub(crate) fn new(
+        metadata: &ParquetMetaData,
+        start_row: usize,
+        len: usize,
+        selection: Option<&'a [bool]>,
+    ) -> PicachvResult<Self> {
+        let num_rows = metadata.file_metadata().num_rows() as usize;
+        picachv_ensure!(
+            start_row.checked_add(len).is_some_and(|end| end <= num_rows),
+            InvalidOperation: "The row range {}..{} is out of bound {}", start_row, start_row.saturating_add(len), num_rows,
+        );
+        if let Some(selection) = selection {
+            picachv_ensure!(
+                selection.len() == len,
+                InvalidOperation: "The selection array length {} is not equal to the range length {}",
+                selection.len(),
+                len,
+            );
+        }
+
+        let end_row = start_row + len;
+        let mut row_groups = vec![];
+        let mut skip = 0;
+        let mut trailing = 0;
+        let mut offset = 0;
+        for (idx, rg) in metadata.row_groups().iter().enumerate() {
+            let rg_end = offset + rg.num_rows() as usize;
+            if rg_end > start_row && offset < end_row {
+                if row_groups.is_empty() {
+                    skip = start_row - offset;
+                }
+                row_groups.push(idx);
+                trailing = rg_end.saturating_sub(end_row);
+            }
+            offset = rg_end;
+        }
+
+        Ok(Self {
+            row_groups,
+            skip,
+            trailing,
+            len,
+            selection,
+        })
+    }
+
+    /// The number of rows that are eventually read.
+    fn num_selected(&self) -> usize {
+        match self.selection {
+            Some(selection) => selection.iter().filter(|&&b| b).count(),
+            None => self.len,
+        }
+    }
+
+    /// Returns a clean dataframe if the statistics say the range carries no policy.
+    pub(crate) fn try_clean(
+        &self,
+        stats: Option<&PolicyParquetStats>,
+        projection: &[usize],
+    ) -> Option<PolicyGuardedDataFrame> {
+        let stats = stats?;
+
+        self.row_groups
+            .iter()
+            .all(|&rg| stats.is_clean(rg, projection))
+            .then(|| clean_df(projection.len(), self.num_selected()))
+    }
+
+    /// The selection relative to the first row of the first selected row group.
+    pub(crate) fn row_selection(&self) -> RowSelection {
+        let mut selectors = vec![RowSelector::skip(self.skip)];
+        match self.selection {
+            Some(selection) => {
+                selectors.extend(Vec::<RowSelector>::from(RowSelection::from_filters(&[
+                    BooleanArray::from(selection.to_vec()),
+                ])))
+            },
+            None => selectors.push(RowSelector::select(self.len)),
+        }
+        selectors.push(RowSelector::skip(self.trailing));
+
+        selectors.into()
+    }
+}
+
+/// Constructs a dataframe whose columns carry no policy.
+pub(crate) fn clean_df(num_columns: usize, num_rows: usize) -> PolicyGuardedDataFrame {
+    let column = Arc::new(PolicyGuardedColumn::new(
+        Arc::new(Policy::PolicyClean),
+        num_rows,
+        HashMap::new(),
+    ));
+
+    PolicyGuardedDataFrame::new(vec![column; num_columns])
+}
+
 fn collect_reader(
     builder: ArrowReaderBuilder<SyncReader<File>>,
 ) -> Result<PolicyGuardedDataFrame, PicachvError> {
@@ -201,11 +644,8 @@ fn collect_reader(
         return Ok(PolicyGuardedDataFrame::new(vec![]));
     }
 
-    let rb = arrow_select::concat::concat_batches(&rb[0].schema(), &rb).map_err(|e| {
-        PicachvError::InvalidOperation(format!("Failed to concat batches: {}", e).into())
-    })?;
-
-    PolicyGuardedDataFrame::new_from_record_batch(rb)
+    // Each batch is kept as a chunk of its own; there is no need to concatenate them.
+    PolicyGuardedDataFrame::new_from_record_batches(rb)
 }
 
 /// Gets the initial builder for the Parquet reader with columns projected.
@@ -0,0 +1,349 @@
+use std::fs::File;
+use std::io::Read;
+use std::path::Path;
+use std::sync::Arc;
+
+use ahash::{HashMap, HashMapExt};
+use arrow_array::{BooleanArray, LargeBinaryArray, RecordBatch};
+use bytes::Bytes;
+use parquet::arrow::arrow_reader::{
+    ArrowReaderMetadata, ArrowReaderOptions, ParquetRecordBatchReaderBuilder, RowSelection,
+};
+use parquet::arrow::ProjectionMask;
+use parquet::errors::ParquetError;
+use parquet::file::reader::{ChunkReader, Length};
+use picachv_error::{picachv_ensure, PicachvError, PicachvResult};
+use rayon::prelude::*;
+use spin::RwLock;
+
+use super::parquet::{clean_df, PolicyParquetStats, RowRange};
+use crate::dataframe::{PolicyChunk, PolicyGuardedColumn, PolicyGuardedDataFrame, PolicyRef};
+use crate::io::BinIo;
+use crate::policy::{Policy, PolicyLabel};
+use crate::thread_pool::THREAD_POOL;
+
+/// A file that is read with positional reads only.
+///
+/// Unlike [`File`], reading from it never moves a shared cursor, so the same handle can
+/// serve row groups to any number of threads at the same time.
+#[derive(Clone, Debug)]
+struct PositionalFile {
+    file: Arc<File>,
+    len: u64,
+}
+
+/// A [`Read`] over a [`PositionalFile`] that keeps its own cursor.
+struct PositionalReader {
+    file: PositionalFile,
+    offset: u64,
+}
+
+impl PositionalFile {
+    fn open<P: AsRef<Path>>(path: P) -> PicachvResult<Self> {
+        let file = File::open(path).map_err(|e| {
+            PicachvError::InvalidOperation(format!("Failed to open file: {}", e).into())
+        })?;
+        let len = file.metadata()?.len();
+
+        Ok(Self {
+            file: Arc::new(file),
+            len,
+        })
+    }
+
+    #[cfg(unix)]
+    fn read_at(&self, buf: &mut [u8], offset: u64) -> std::io::Result<usize> {
+        std::os::unix::fs::FileExt::read_at(self.file.as_ref(), buf, offset)
+    }
+
+    #[cfg(windows)]
+    fn read_at(&self, buf: &mut [u8], offset: u64) -> std::io::Result<usize> {
+        std::os::windows::fs::FileExt::seek_read(self.file.as_ref(), buf, offset)
+    }
+
+    fn read_exact_at(&self, mut buf: &mut [u8], mut offset: u64) -> std::io::Result<()> {
+        while !buf.is_empty() {
+            match self.read_at(buf, offset)? {
+                0 => return Err(std::io::ErrorKind::UnexpectedEof.into()),
+                n => {
+                    buf = &mut buf[n..];
+                    offset += n as u64;
+                },
+            }
+        }
+
+        Ok(())
+    }
+}
+
+impl Read for PositionalReader {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        let n = self.file.read_at(buf, self.offset)?;
+        self.offset += n as u64;
+        Ok(n)
+    }
+}
+
+impl Length for PositionalFile {
+    fn len(&self) -> u64 {
+        self.len
+    }
+}
+
+impl ChunkReader for PositionalFile {
+    type T = PositionalReader;
+
+    fn get_read(&self, start: u64) -> parquet::errors::Result<Self::T> {
+        Ok(PositionalReader {
+            file: self.clone(),
+            offset: start,
+        })
+    }
+
+    fn get_bytes(&self, start: u64, length: usize) -> parquet::errors::Result<Bytes> {
+        let mut buf = vec![0u8; length];
+        self.read_exact_at(&mut buf, start)
+            .map_err(|e| ParquetError::External(Box::new(e)))?;
+
+        Ok(buf.into())
+    }
+}
+
+/// A persistent scan over a policy Parquet file.
+///
+/// [`PolicyGuardedDataFrame::from_parquet_row_group`] opens the file and parses the footer on
+/// every call, which adds up when the query engine asks for the file row group by row group
+/// from many threads. A [`PolicyScan`] does this once: the footer, the projection mask and the
+/// policy statistics are kept, and each call to [`PolicyScan::read_row_group`] only reads the
+/// column chunks of that row group. Decoded policies are interned so that identical byte
+/// strings are deserialized once per scan and share the same [`PolicyRef`].
+pub struct PolicyScan {
+    file: PositionalFile,
+    metadata: ArrowReaderMetadata,
+    projection: Vec<usize>,
+    stats: Option<PolicyParquetStats>,
+    pub(crate) interned: RwLock<HashMap<Vec<u8>, PolicyRef>>,
+}
+
+impl PolicyScan {
+    /// Opens the policy file at `path` and prepares a scan on the `projection` columns.
+    pub fn open<P: AsRef<Path>>(path: P, projection: &[usize]) -> PicachvResult<Self> {
+        let file = PositionalFile::open(path)?;
+        let metadata =
+            ArrowReaderMetadata::load(&file, ArrowReaderOptions::new().with_page_index(true))
+                .map_err(|e| {
+                    PicachvError::InvalidOperation(
+                        format!("Failed to create Parquet reader: {}", e).into(),
+                    )
+                })?;
+
+        let num_columns = metadata.parquet_schema().root_schema().get_fields().len();
+        picachv_ensure!(
+            projection.iter().all(|&col| col < num_columns),
+            InvalidOperation: "The projection {:?} is out of bound {}", projection, num_columns,
+        );
+
+        let stats = PolicyParquetStats::from_metadata(metadata.metadata())?;
+
+        Ok(Self {
+            file,
+            metadata,
+            projection: projection.to_vec(),
+            stats,
+            interned: RwLock::new(HashMap::new()),
+        })
+    }
+
+    #[inline]
+    pub fn num_row_groups(&self) -> usize {
+        self.metadata.metadata().num_row_groups()
+    }
+
+    #[inline]
+    pub fn stats(&self) -> Option<&PolicyParquetStats> {
+        self.stats.as_ref()
+    }
+
+    /// Checks with the policy statistics in the footer that every policy of the projected
+    /// columns can be downgraded by `by`, so that a query doomed to fail does so before any
+    /// row group is read. Files without statistics pass and are checked as they are read.
+    pub fn check_downgrade(&self, by: &Arc<PolicyLabel>) -> PicachvResult<()> {
+        match self.stats.as_ref() {
+            Some(stats) => stats.check_downgrade(&self.projection, by),
+            None => Ok(()),
+        }
+    }
+
+    /// Reads the policies of a row group. This can be called concurrently.
+    pub fn read_row_group(
+        &self,
+        row_group_index: usize,
+        selection: Option<&[bool]>,
+    ) -> PicachvResult<PolicyGuardedDataFrame> {
+        picachv_ensure!(
+            row_group_index < self.num_row_groups(),
+            InvalidOperation: "The row group index {} is out of bound {}",
+            row_group_index,
+            self.num_row_groups(),
+        );
+
+        let num_rows = self
+            .metadata
+            .metadata()
+            .row_group(row_group_index)
+            .num_rows() as usize;
+        if let Some(selection) = selection {
+            picachv_ensure!(
+                selection.len() == num_rows,
+                InvalidOperation: "The selection array length {} is not equal to `num_rows` {}",
+                selection.len(),
+                num_rows,
+            );
+        }
+
+        if self
+            .stats
+            .as_ref()
+            .is_some_and(|stats| stats.is_clean(row_group_index, &self.projection))
+        {
+            let num_rows = match selection {
+                Some(selection) => selection.iter().filter(|&&b| b).count(),
+                None => num_rows,
+            };
+
+            return Ok(clean_df(self.projection.len(), num_rows));
+        }
+
+        let proj_mask =
+            ProjectionMask::roots(self.metadata.parquet_schema(), self.projection.clone());
+        let mut builder = ParquetRecordBatchReaderBuilder::new_with_metadata(
+            self.file.clone(),
+            self.metadata.clone(),
+        )
+        .with_projection(proj_mask)
+        .with_row_groups(vec![row_group_index])
+        .with_batch_size(num_rows.max(1));
+
+        if let Some(selection) = selection {
+            builder =
+                builder.with_row_selection(RowSelection::from_filters(&[BooleanArray::from(
+                    selection.to_vec(),
+                )]));
+        }
+
+        self.collect(builder)
+    }
+
+    /// Reads the policies of the logical rows `start_row..start_row + len`. Pages outside of
+    /// the range are skipped with the offset index. This can be called concurrently.
+    pub fn read_rows(
+        &self,
+        start_row: usize,
+        len: usize,
+        selection: Option<&[bool]>,
+    ) -> PicachvResult<PolicyGuardedDataFrame> {
+        let range = RowRange::new(self.metadata.metadata(), start_row, len, selection)?;
+        if let Some(df) = range.try_clean(self.stats.as_ref(), &self.projection) {
+            return Ok(df);
+        }
+
+        let proj_mask =
+            ProjectionMask::roots(self.metadata.parquet_schema(), self.projection.clone());
+        let builder = ParquetRecordBatchReaderBuilder::new_with_metadata(
+            self.file.clone(),
+            self.metadata.clone(),
+        )
+        .with_projection(proj_mask)
+        .with_row_groups(range.row_groups.clone())
+        .with_row_selection(range.row_selection())
+        .with_batch_size(len.max(1));
+
+        self.collect(builder)
+    }
+
+    fn collect(
+        &self,
+        builder: ParquetRecordBatchReaderBuilder<PositionalFile>,
+    ) -> PicachvResult<PolicyGuardedDataFrame> {
+        let mut reader = builder.build().map_err(|e| {
+            PicachvError::InvalidOperation(format!("Failed to build Parquet reader: {}", e).into())
+        })?;
+        let rb = reader.try_collect::<Vec<_>>().map_err(|e| {
+            PicachvError::InvalidOperation(format!("Failed to read Parquet file: {}", e).into())
+        })?;
+
+        let dfs = rb
+            .iter()
+            .map(|rb| self.decode(rb))
+            .collect::<PicachvResult<Vec<_>>>()?;
+
+        match dfs.len() {
+            0 => Ok(PolicyGuardedDataFrame::new(vec![])),
+            1 => Ok(dfs.into_iter().next().unwrap()),
+            _ => PolicyGuardedDataFrame::union(&dfs.into_iter().map(Arc::new).collect::<Vec<_>>()),
+        }
+    }
+
+    /// Decodes a record batch into a dataframe with one chunk per column.
+    fn decode(&self, rb: &RecordBatch) -> PicachvResult<PolicyGuardedDataFrame> {
+        let columns = THREAD_POOL.install(|| {
+            rb.columns()
+                .par_iter()
+                .map(|c| {
+                    let array = c.as_any().downcast_ref::<LargeBinaryArray>().ok_or(
+                        PicachvError::InvalidOperation(
+                            "Failed to downcast to LargeBinaryArray.".into(),
+                        ),
+                    )?;
+                    let policies = self.intern(array)?;
+                    let chunk = PolicyChunk::new_from_iter(&policies)?;
+
+                    Ok(Arc::new(PolicyGuardedColumn::from_chunks(vec![Arc::new(
+                        chunk,
+                    )])))
+                })
+                .collect::<PicachvResult<Vec<_>>>()
+        })?;
+
+        Ok(PolicyGuardedDataFrame::new(columns))
+    }
+
+    /// Deserializes the policies of `array`, decoding each distinct byte string only once.
+    fn intern(&self, array: &LargeBinaryArray) -> PicachvResult<Vec<PolicyRef>> {
+        let mut local: HashMap<&[u8], PolicyRef> = HashMap::new();
+        let mut res = Vec::with_capacity(array.len());
+
+        for bytes in array.iter() {
+            let bytes = bytes.ok_or(PicachvError::InvalidOperation(
+                "The policy must not be null.".into(),
+            ))?;
+
+            let policy = match local.get(bytes) {
+                Some(p) => p.clone(),
+                None => {
+                    let p = self.intern_one(bytes)?;
+                    local.insert(bytes, p.clone());
+                    p
+                },
+            };
+            res.push(policy);
+        }
+
+        Ok(res)
+    }
+
+    fn intern_one(&self, bytes: &[u8]) -> PicachvResult<PolicyRef> {
+        if let Some(p) = self.interned.read().get(bytes) {
+            return Ok(p.clone());
+        }
+
+        let p = Arc::new(Policy::from_byte_array(bytes)?);
+
+        Ok(self
+            .interned
+            .write()
+            .entry(bytes.to_vec())
+            .or_insert(p)
+            .clone())
+    }
+}
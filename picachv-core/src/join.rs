@@ -0,0 +1,135 @@
+use std::sync::Arc;
+
+use picachv_error::{picachv_ensure, PicachvError, PicachvResult};
+use picachv_message::{ContextOptions, JoinType};
+use rayon::prelude::*;
+
+use crate::counters::{self, Counter};
+use crate::dataframe::{
+    nullable_sides, GatherPlan, PolicyGuardedColumn, PolicyGuardedColumnRef,
+    PolicyGuardedDataFrame, NULL_ROW,
+};
+use crate::profiler::profile;
+use crate::thread_pool::THREAD_POOL;
+
+/// A join whose build side is fixed while the probe side is streamed in vectors.
+///
+/// Hash joins (e.g., the one in DuckDB) build a hash table on one input and then probe it
+/// with the other input one vector at a time. Checking each vector with
+/// [`PolicyGuardedDataFrame::join_by_idx`] would look up and project the build side for
+/// every vector. A [`JoinSession`] pins the projected build-side columns together with their
+/// gather plans once, so that each probe only gathers the rows it needs.
+#[derive(Debug)]
+pub struct JoinSession {
+    /// The projected columns of the build side and how to gather from them.
+    left: Vec<(PolicyGuardedColumnRef, GatherPlan)>,
+    /// The number of rows on the build side.
+    left_rows: usize,
+    /// The columns of the probe side to keep.
+    right_columns: Vec<usize>,
+    join_type: JoinType,
+}
+
+impl JoinSession {
+    /// Pins the `left_columns` of the build side `lhs`.
+    ///
+    /// The indices of the probes follow [`PolicyGuardedDataFrame::join_by_idx`] for the given
+    /// `join_type`.
+    pub fn new(
+        lhs: &PolicyGuardedDataFrame,
+        left_columns: &[usize],
+        right_columns: &[usize],
+        join_type: JoinType,
+    ) -> PicachvResult<Self> {
+        let left = THREAD_POOL.install(|| {
+            lhs.projected_columns(left_columns)?
+                .into_par_iter()
+                .map(|c| Ok((c.clone(), c.gather_plan())))
+                .collect::<PicachvResult<Vec<_>>>()
+        })?;
+
+        Ok(Self {
+            left,
+            left_rows: lhs.shape().0,
+            right_columns: right_columns.to_vec(),
+            join_type,
+        })
+    }
+
+    /// Joins a probe vector `rhs` with the build side. The `i`-th joined row consists of the
+    /// `left_idx[i]`-th row of the build side and the `right_idx[i]`-th row of `rhs`.
+    ///
+    /// This only reads the session, so it can be called concurrently.
+    pub fn probe(
+        &self,
+        rhs: &PolicyGuardedDataFrame,
+        left_idx: &[usize],
+        right_idx: &[usize],
+        options: &ContextOptions,
+    ) -> PicachvResult<PolicyGuardedDataFrame> {
+        counters::add(Counter::RowsJoined, left_idx.len() as u64);
+
+        if matches!(self.join_type, JoinType::Semi | JoinType::Anti) {
+            let f = || THREAD_POOL.install(|| self.gather_left(left_idx, false));
+            let columns = if options.enable_profiling {
+                profile(f, "join_filter".into())
+            } else {
+                f()
+            }?;
+
+            return Ok(PolicyGuardedDataFrame::new(columns));
+        }
+
+        picachv_ensure!(
+            left_idx.len() == right_idx.len(),
+            ComputeError: "The number of rows must be the same: {} != {}", left_idx.len(), right_idx.len(),
+        );
+
+        let (left_nullable, right_nullable) = nullable_sides(self.join_type);
+        let f = || {
+            THREAD_POOL.install(|| {
+                rayon::join(
+                    || self.gather_left(left_idx, left_nullable),
+                    || rhs.gather_projected(&self.right_columns, right_idx, right_nullable),
+                )
+            })
+        };
+        let (lhs, rhs) = if options.enable_profiling {
+            profile(f, "join_gather".into())
+        } else {
+            f()
+        };
+
+        let mut columns = lhs?;
+        columns.extend(rhs?);
+
+        Ok(PolicyGuardedDataFrame::new(columns))
+    }
+
+    fn gather_left(
+        &self,
+        indices: &[usize],
+        nullable: bool,
+    ) -> PicachvResult<Vec<PolicyGuardedColumnRef>> {
+        if self.left.is_empty() {
+            return Ok(vec![]);
+        }
+
+        picachv_ensure!(
+            indices
+                .par_iter()
+                .all(|&i| i < self.left_rows || (nullable && i == NULL_ROW)),
+            ComputeError: "The index is out of bound: the build side has {} rows", self.left_rows,
+        );
+
+        Ok(self
+            .left
+            .par_iter()
+            .map(|(c, plan)| {
+                Arc::new(PolicyGuardedColumn::from_chunks(vec![Arc::new(
+                    c.gather_with(plan, indices, nullable),
+                )]))
+            })
+            .collect())
+    }
+}
@@ -9,6 +9,8 @@ use arena::Arena;
 pub use arrow_array::{Array, RecordBatch};
 use arrow_ipc::reader::StreamReader;
 use arrow_ipc::writer::StreamWriter;
+use arrow_schema::SchemaRef;
+use counters::Counter;
 use dataframe::DfArena;
 use expr::{AExpr, ExprArena};
 use picachv_error::{PicachvError, PicachvResult};
@@ -19,17 +21,25 @@ use uuid::Uuid;
 pub mod arena;
 pub mod cast;
 pub mod constants;
+pub mod counters;
 pub mod dataframe;
 pub mod expr;
+pub mod group_index;
 pub mod io;
+pub mod join;
 pub mod macros;
+pub mod memory;
 pub mod plan;
 pub mod policy;
 pub mod profiler;
+pub mod selection;
 pub mod thread_pool;
 pub mod udf;
 
-#[cfg(not(target_arch = "wasm32"))]
+/// Libraries should leave the choice of the allocator to the application, so jemalloc is only
+/// installed when the `jemalloc` feature is enabled, e.g., by the benchmarks.
+#[cfg(all(unix, feature = "jemalloc"))]
+#[global_allocator]
 static ALLOC: jemallocator::Jemalloc = jemallocator::Jemalloc;
 
 /// A unified group information that is used to tell Picachv how groups are formed.
@@ -59,7 +69,7 @@ static ALLOC: jemallocator::Jemalloc = jemallocator::Jemalloc;
 ///   groups: vec![3],
 /// }
 /// ```
-/// 
+///
 /// Conceptually, this struct is just a group.
 #[derive(Debug, Clone)]
 pub struct GroupInformation {
@@ -127,8 +137,27 @@ pub fn arrays_into_bytes(arrays: Vec<Arc<dyn Array>>) -> PicachvResult<Vec<u8>>
     Ok(ipc_writer.get_ref().to_vec())
 }
 
+/// Decode the bytes into the record batches as they were written, without concatenating them.
+pub fn record_batches_from_bytes(value: &[u8]) -> PicachvResult<Vec<RecordBatch>> {
+    decode_record_batches(value).map(|(_, rb)| rb)
+}
+
 /// Decode the bytes into the record batch.
 pub fn record_batch_from_bytes(value: &[u8]) -> PicachvResult<RecordBatch> {
+    let (schema, mut rb) = decode_record_batches(value)?;
+
+    // The common case is a single batch which needs no copy at all.
+    if rb.len() == 1 {
+        return Ok(rb.pop().unwrap());
+    }
+
+    arrow_select::concat::concat_batches(&schema, &rb)
+        .map_err(|e| PicachvError::ComputeError(format!("Failed to concat batches. {e}").into()))
+}
+
+fn decode_record_batches(value: &[u8]) -> PicachvResult<(SchemaRef, Vec<RecordBatch>)> {
+    counters::add(Counter::IpcBytesDecoded, value.len() as u64);
+
     let ipc_reader = StreamReader::try_new(value, None).map_err(|e| {
         PicachvError::InvalidOperation(format!("Failed to create IPC reader. {e}").into())
     })?;
@@ -139,8 +168,7 @@ pub fn record_batch_from_bytes(value: &[u8]) -> PicachvResult<RecordBatch> {
         .map(|e| e.map_err(|e| PicachvError::ComputeError(e.to_string().into())))
         .collect::<PicachvResult<Vec<_>>>()?;
 
-    arrow_select::concat::concat_batches(&schema, &rb)
-        .map_err(|e| PicachvError::ComputeError(format!("Failed to concat batches. {e}").into()))
+    Ok((schema, rb))
 }
 
 #[cfg(test)]
@@ -0,0 +1,258 @@
+//! Memory statistics of the process.
+//!
+//! Built with the `jemalloc` feature on Unix, jemalloc is the global allocator and the allocator
+//! statistics cover everything allocated by Picachv but not the memory of the host framework
+//! unless it is written in Rust and linked into the same binary. Otherwise Picachv does not know
+//! what the allocator is doing, so `allocated`, `active` and `resident` are absent (`null` in
+//! JSON). The peak resident set size always covers the whole process.
+//!
+//! Built with the `heap_profiling` feature, which implies `jemalloc`, jemalloc samples the stack
+//! traces of allocations so that they can be attributed to the code that makes them, e.g.,
+//! `convert_record_batch` or the hash maps of `PolicyChunk::new_from_iter`, including the parts
+//! running on the thread pool. Sampling has to be enabled when the process starts, e.g., with
+//! `_RJEM_MALLOC_CONF=prof:true,prof_active:false,lg_prof_sample:19`. It can then be switched
+//! on around the code of interest with [`set_heap_profiling`], and the profile written with
+//! [`dump_heap_profile`] is read by `jeprof`.
+
+use std::path::Path;
+
+use picachv_error::{picachv_bail, PicachvError, PicachvResult};
+use serde::{Deserialize, Serialize};
+
+/// A snapshot of the memory used by the process, in bytes.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Serialize, Deserialize)]
+pub struct MemoryStats {
+    /// Bytes allocated by the application (jemalloc's `stats.allocated`).
+    pub allocated: Option<usize>,
+    /// Bytes in the pages that the allocator has handed out (`stats.active`).
+    pub active: Option<usize>,
+    /// Bytes in the pages that the allocator keeps resident (`stats.resident`).
+    pub resident: Option<usize>,
+    /// The peak resident set size of the process (`VmHWM`), or zero if it is not known.
+    pub peak_rss: usize,
+}
+
+impl MemoryStats {
+    pub fn to_json(&self) -> String {
+        // The fields are plain integers, so this cannot fail.
+        serde_json::to_string(self).unwrap()
+    }
+}
+
+/// The memory used by a context along with that of the process.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Serialize, Deserialize)]
+pub struct ContextMemoryStats {
+    #[serde(flatten)]
+    pub process: MemoryStats,
+    /// The number of dataframes in the arena of the context.
+    pub dataframes: usize,
+    /// The number of expressions in the arena of the context.
+    pub expressions: usize,
+}
+
+impl ContextMemoryStats {
+    pub fn to_json(&self) -> String {
+        serde_json::to_string(self).unwrap()
+    }
+}
+
+/// Returns the current memory statistics. The allocator statistics are refreshed first, which
+/// takes a lock inside jemalloc or reads `/proc`, so this is not meant for hot paths.
+pub fn stats() -> PicachvResult<MemoryStats> {
+    let (allocated, active, resident) = match allocator_stats()? {
+        Some((allocated, active, resident)) => (Some(allocated), Some(active), Some(resident)),
+        None => (None, None, None),
+    };
+
+    Ok(MemoryStats {
+        allocated,
+        active,
+        resident,
+        peak_rss: proc_status("VmHWM:"),
+    })
+}
+
+/// Returns jemalloc's `allocated`, `active` and `resident` bytes, or `None` if jemalloc is not
+/// the global allocator.
+#[cfg(all(unix, feature = "jemalloc"))]
+fn allocator_stats() -> PicachvResult<Option<(usize, usize, usize)>> {
+    use jemalloc_ctl::{epoch, stats};
+
+    let err = |e: jemalloc_ctl::Error| {
+        PicachvError::ComputeError(format!("Failed to read the allocator statistics: {e}").into())
+    };
+
+    // The statistics are cached by jemalloc until the epoch is advanced.
+    epoch::advance().map_err(err)?;
+
+    Ok(Some((
+        stats::allocated::read().map_err(err)?,
+        stats::active::read().map_err(err)?,
+        stats::resident::read().map_err(err)?,
+    )))
+}
+
+#[cfg(not(all(unix, feature = "jemalloc")))]
+fn allocator_stats() -> PicachvResult<Option<(usize, usize, usize)>> {
+    Ok(None)
+}
+
+/// Whether allocations are being sampled.
+pub fn heap_profiling_active() -> PicachvResult<bool> {
+    heap::ensure_enabled()?;
+    heap::read::<bool>(b"prof.active\0")
+}
+
+/// Starts or stops sampling allocations.
+pub fn set_heap_profiling(active: bool) -> PicachvResult<()> {
+    heap::ensure_enabled()?;
+    heap::write(b"prof.active\0", active)
+}
+
+/// Drops the allocations sampled so far, e.g., before running the code to be profiled.
+pub fn reset_heap_profile() -> PicachvResult<()> {
+    heap::ensure_enabled()?;
+    // Writing the current sample rate keeps it.
+    let lg_sample = heap::read::<usize>(b"prof.lg_sample\0")?;
+    heap::write(b"prof.reset\0", lg_sample)
+}
+
+/// Writes the allocations sampled so far to `path` in the format of `jeprof`.
+pub fn dump_heap_profile<P: AsRef<Path>>(path: P) -> PicachvResult<()> {
+    heap::ensure_enabled()?;
+    heap::dump(path.as_ref())
+}
+
+#[cfg(all(unix, feature = "heap_profiling"))]
+mod heap {
+    use std::ffi::CString;
+    use std::os::unix::ffi::OsStrExt;
+    use std::path::Path;
+
+    use jemalloc_ctl::raw;
+
+    use super::*;
+
+    fn err(e: jemalloc_ctl::Error) -> PicachvError {
+        PicachvError::ComputeError(format!("Failed to control the heap profiler: {e}").into())
+    }
+
+    pub(super) fn read<T: Copy>(name: &[u8]) -> PicachvResult<T> {
+        // SAFETY: the names used in this module are NUL-terminated and `T` matches their types.
+        unsafe { raw::read(name) }.map_err(err)
+    }
+
+    pub(super) fn write<T>(name: &[u8], value: T) -> PicachvResult<()> {
+        // SAFETY: see `read`.
+        unsafe { raw::write(name, value) }.map_err(err)
+    }
+
+    pub(super) fn ensure_enabled() -> PicachvResult<()> {
+        if !read::<bool>(b"opt.prof\0")? {
+            picachv_bail!(
+                InvalidOperation: "The heap profiler is off; start the process with \
+                 `_RJEM_MALLOC_CONF=prof:true`."
+            );
+        }
+
+        Ok(())
+    }
+
+    pub(super) fn dump(path: &Path) -> PicachvResult<()> {
+        let path = CString::new(path.as_os_str().as_bytes())
+            .map_err(|e| PicachvError::InvalidOperation(e.to_string().into()))?;
+
+        // jemalloc copies the path before returning.
+        write(b"prof.dump\0", path.as_ptr())
+    }
+}
+
+#[cfg(not(all(unix, feature = "heap_profiling")))]
+mod heap {
+    use std::path::Path;
+
+    use super::*;
+
+    pub(super) fn read<T>(_: &[u8]) -> PicachvResult<T> {
+        unreachable!("`ensure_enabled` fails first")
+    }
+
+    pub(super) fn write<T>(_: &[u8], _: T) -> PicachvResult<()> {
+        unreachable!("`ensure_enabled` fails first")
+    }
+
+    pub(super) fn ensure_enabled() -> PicachvResult<()> {
+        picachv_bail!(InvalidOperation: "Picachv is built without `heap_profiling`.")
+    }
+
+    pub(super) fn dump(_: &Path) -> PicachvResult<()> {
+        unreachable!("`ensure_enabled` fails first")
+    }
+}
+
+/// Reads a size in kB such as `VmHWM:` from `/proc/self/status`, or zero if it is not known.
+fn proc_status(key: &str) -> usize {
+    std::fs::read_to_string("/proc/self/status")
+        .ok()
+        .and_then(|status| {
+            status
+                .lines()
+                .find_map(|line| line.strip_prefix(key))
+                .and_then(|kb| {
+                    kb.trim()
+                        .trim_end_matches("kB")
+                        .trim()
+                        .parse::<usize>()
+                        .ok()
+                })
+        })
+        .map_or(0, |kb| kb * 1024)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_memory_stats() {
+        let v = vec![1u8; 64 << 20];
+        let after = stats().unwrap();
+
+        #[cfg(all(unix, feature = "jemalloc"))]
+        assert!(after
+            .allocated
+            .zip(after.active)
+            .is_some_and(|(allocated, active)| allocated >= v.len() && active >= allocated));
+        #[cfg(not(all(unix, feature = "jemalloc")))]
+        assert_eq!(
+            (after.allocated, after.active, after.resident),
+            (None, None, None)
+        );
+        // The peak counts the pages that have been touched, which `vec!` does.
+        #[cfg(target_os = "linux")]
+        assert!(after.peak_rss >= v.len());
+
+        let json: serde_json::Value = serde_json::from_str(&after.to_json()).unwrap();
+        assert_eq!(
+            json["allocated"].as_u64(),
+            after.allocated.map(|a| a as u64)
+        );
+        drop(v);
+
+        let ctx = ContextMemoryStats {
+            process: after,
+            dataframes: 3,
+            ..Default::default()
+        };
+        let json: serde_json::Value = serde_json::from_str(&ctx.to_json()).unwrap();
+        assert_eq!(
+            (json["dataframes"].as_u64(), json["allocated"].as_u64()),
+            (Some(3), after.allocated.map(|a| a as u64))
+        );
+
+        // Without `prof:true` in the allocator options, the profiler cannot be switched on.
+        if std::env::var_os("_RJEM_MALLOC_CONF").is_none() {
+            assert!(set_heap_profiling(true).is_err());
+        }
+    }
+}
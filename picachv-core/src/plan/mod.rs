@@ -12,6 +12,7 @@ use picachv_message::{ContextOptions, GroupByIdx, GroupByIdxMultiple, GroupByPro
 use rayon::prelude::*;
 use uuid::Uuid;
 
+use crate::counters::{self, Counter};
 use crate::dataframe::{
     idx_to_group_info_vec, Chunks, PolicyGuardedColumn, PolicyGuardedDataFrame,
 };
@@ -19,7 +20,7 @@ use crate::expr::pexpr::PExpr;
 use crate::expr::{fold_on_groups, AExpr};
 use crate::policy::context::ExpressionEvalContext;
 use crate::policy::Policy;
-use crate::profiler::PROFILER;
+use crate::profiler::{current, profile};
 use crate::thread_pool::THREAD_POOL;
 use crate::udf::Udf;
 use crate::{Arenas, GroupInformation};
@@ -194,6 +195,18 @@ impl Plan {
             self
         );
 
+        // A multi-chunk aggregation does not read the active dataframe.
+        if let Ok(df) = arena.df_arena.read().get(&active_df_uuid) {
+            let counter = match self {
+                Plan::Select { .. } => Counter::RowsSelected,
+                Plan::Projection { .. } => Counter::RowsProjected,
+                Plan::Aggregation { .. } => Counter::RowsAggregated,
+                Plan::DataFrameScan { .. } => Counter::RowsScanned,
+                Plan::Hstack { .. } => Counter::RowsHstacked,
+            };
+            counters::add(counter, df.shape().0 as u64);
+        }
+
         let f = || match self {
             // See the semantics for `apply_proj_in_relation`.
             Plan::Projection {
@@ -303,7 +316,7 @@ impl Plan {
         };
 
         if options.enable_profiling {
-            PROFILER.profile(f, self.name().to_string().into())
+            profile(f, self.name().to_string().into())
         } else {
             f()
         }
@@ -342,7 +355,7 @@ pub(crate) fn groupby_single(
     let second_part = df_arena.get(&second_part)?;
 
     if options.enable_profiling {
-        PROFILER.profile(
+        profile(
             || PolicyGuardedDataFrame::stitch(&first_part, &second_part),
             "groupby_single: stitch".into(),
         )
@@ -398,7 +411,7 @@ fn do_hstack(
     };
 
     let new_df = if options.enable_profiling {
-        PROFILER.profile(f, "do_hstack".into())
+        profile(f, "do_hstack".into())
     } else {
         f()
     }?;
@@ -456,6 +469,7 @@ fn aggregate_keys(
     gi: &[GroupInformation],
     options: &ContextOptions,
 ) -> PicachvResult<PolicyGuardedDataFrame> {
+    let profiler = current();
     let columns = THREAD_POOL.install(|| {
         (0..df.shape().1)
             .into_par_iter()
@@ -469,7 +483,7 @@ fn aggregate_keys(
                                 .fold(
                                     || Ok(Arc::new(Policy::PolicyClean)),
                                     |mut acc, idx| {
-                                        let p = &df.columns[col_idx][*idx as usize];
+                                        let p = &df.columns()[col_idx][*idx as usize];
                                         acc = Ok(Arc::new(acc?.join(p)?));
                                         acc
                                     },
@@ -486,7 +500,7 @@ fn aggregate_keys(
                 };
 
                 let cur = if options.enable_profiling {
-                    PROFILER.profile(cur, "aggregate: groupby".into())
+                    profiler.profile(cur, "aggregate: groupby".into())
                 } else {
                     cur()
                 }?;
@@ -495,7 +509,7 @@ fn aggregate_keys(
                     let f = || PolicyGuardedColumn::new_from_iter(cur.par_iter());
 
                     if options.enable_profiling {
-                        PROFILER.profile(f, "aggregate: process".into())
+                        profiler.profile(f, "aggregate: process".into())
                     } else {
                         f()
                     }
@@ -504,10 +518,7 @@ fn aggregate_keys(
             .collect::<PicachvResult<Vec<_>>>()
     })?;
 
-    Ok(PolicyGuardedDataFrame {
-        columns,
-        ..Default::default()
-    })
+    Ok(PolicyGuardedDataFrame::new(columns))
 }
 
 pub fn early_projection(
@@ -561,7 +572,8 @@ fn check_policy_agg(
     let f = || fold_on_groups(&inner, agg_expr.as_groupby_method());
 
     if options.enable_profiling {
-        PROFILER.profile(f, "check_policy_agg: fold_on_groups".into())
+        ctx.profiler
+            .profile(f, "check_policy_agg: fold_on_groups".into())
     } else {
         f()
     }
@@ -579,6 +591,10 @@ fn check_expressions_agg(
     udfs: &HashMap<String, Udf>,
     options: &ContextOptions,
 ) -> PicachvResult<Uuid> {
+    let cells = gi.iter().map(|g| g.groups.len()).sum::<usize>() * agg_list.len();
+    counters::add(Counter::PoliciesEvaluated, cells as u64);
+
+    let profiler = current();
     let f = || {
         THREAD_POOL.install(|| {
             agg_list
@@ -586,7 +602,8 @@ fn check_expressions_agg(
                 .map(|agg| {
                     gi.par_iter()
                         .map(|group| {
-                            let mut ctx = ExpressionEvalContext::new("agg", df, true, udfs, arena);
+                            let mut ctx =
+                                ExpressionEvalContext::new("agg", df, true, udfs, arena, &profiler);
                             ctx.gi = Some(group);
 
                             Ok(Arc::new(check_policy_agg(agg, &ctx, options)?))
@@ -598,7 +615,7 @@ fn check_expressions_agg(
     };
 
     let res = if options.enable_profiling {
-        PROFILER.profile(f, "aggregate: policy_eval".into())
+        profile(f, "aggregate: policy_eval".into())
     } else {
         f()
     }?;
@@ -620,15 +637,12 @@ fn check_expressions_agg(
     };
 
     let columns = if options.enable_profiling {
-        PROFILER.profile(columns, "aggregate: process".into())
+        profile(columns, "aggregate: process".into())
     } else {
         columns()
     }?;
 
-    let df = PolicyGuardedDataFrame {
-        columns,
-        ..Default::default()
-    };
+    let df = PolicyGuardedDataFrame::new(columns);
 
     arena.df_arena.write().insert(df)
 }
@@ -642,7 +656,9 @@ fn do_check_expressions(
     name: &str,
 ) -> PicachvResult<PolicyGuardedDataFrame> {
     let rows = df.shape().0;
-    let ctx = ExpressionEvalContext::new(name, df, false, udfs, arena);
+    counters::add(Counter::PoliciesEvaluated, (rows * expression.len()) as u64);
+    let profiler = current();
+    let ctx = ExpressionEvalContext::new(name, df, false, udfs, arena, &profiler);
 
     let physical_expressions = THREAD_POOL.install(|| {
         expression
@@ -664,7 +680,8 @@ fn do_check_expressions(
                         let f = || PolicyGuardedColumn::new_from_iter(cur.par_iter());
 
                         if options.enable_profiling {
-                            PROFILER.profile(f, format!("{name}: policy_eval").into())
+                            ctx.profiler
+                                .profile(f, format!("{name}: policy_eval").into())
                         } else {
                             f()
                         }?
@@ -675,15 +692,12 @@ fn do_check_expressions(
     };
 
     let columns = if options.enable_profiling {
-        PROFILER.profile(f, format!("{name}: process").into())
+        profile(f, format!("{name}: process").into())
     } else {
         f()
     }?;
 
-    Ok(PolicyGuardedDataFrame {
-        columns,
-        ..Default::default()
-    })
+    Ok(PolicyGuardedDataFrame::new(columns))
 }
 
 fn check_expressions(
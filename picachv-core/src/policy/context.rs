@@ -11,6 +11,7 @@ use ahash::{HashMap, HashMapExt};
 use spin::RwLock;
 
 use crate::dataframe::{PolicyGuardedDataFrame, PolicyRef};
+use crate::profiler::PicachvProfiler;
 use crate::udf::Udf;
 use crate::{Arenas, GroupInformation};
 
@@ -34,6 +35,9 @@ pub struct ExpressionEvalContext<'ctx> {
     pub(crate) arena: &'ctx Arenas,
     pub(crate) expr_cache: Arc<RwLock<HashMap<u64, PolicyRef>>>,
     pub(crate) group_expr_cache: Arc<RwLock<HashMap<u64, PolicyRef>>>,
+    /// The profiler of the context, which is kept here because the expressions are evaluated
+    /// on the thread pool.
+    pub(crate) profiler: &'ctx PicachvProfiler,
 }
 
 impl<'ctx> ExpressionEvalContext<'ctx> {
@@ -43,6 +47,7 @@ impl<'ctx> ExpressionEvalContext<'ctx> {
         in_agg: bool,
         udfs: &'ctx HashMap<String, Udf>,
         arena: &'ctx Arenas,
+        profiler: &'ctx PicachvProfiler,
     ) -> Self {
         ExpressionEvalContext {
             name,
@@ -53,6 +58,7 @@ impl<'ctx> ExpressionEvalContext<'ctx> {
             arena,
             expr_cache: Arc::new(RwLock::new(HashMap::new())),
             group_expr_cache: Arc::new(RwLock::new(HashMap::new())),
+            profiler,
         }
     }
 }
@@ -12,6 +12,7 @@ use super::lattice::Lattice;
 use super::types::{AnyValue, DpParam};
 use crate::build_policy;
 use crate::constants::GroupByMethod;
+use crate::counters::{self, Counter};
 
 pub const P_CLEAN: Policy = Policy::PolicyClean;
 
@@ -523,6 +524,13 @@ impl Policy {
 
     /// The implementation for the `policy_lt` inductive relation.
     pub fn le(&self, other: &Self) -> PicachvResult<bool> {
+        counters::incr(Counter::PolicyLe);
+        self.le_inner(other)
+    }
+
+    /// [`Policy::le`] without bumping [`Counter::PolicyLe`], for its own recursion and for the
+    /// comparisons that are not lattice operations, e.g., `==` on hash map keys.
+    fn le_inner(&self, other: &Self) -> PicachvResult<bool> {
         picachv_ensure!(self.valid() && other.valid(),
             ComputeError: "trying to compare invalid policies");
 
@@ -539,8 +547,8 @@ impl Policy {
                 },
             ) => {
                 #[cfg(feature = "trace")]
-                tracing::debug!("{} and {}", l1.flowsto(l2), n1.le(n2));
-                l1.flowsto(l2) && n1.le(n2)
+                tracing::debug!("{} and {}", l1.flowsto(l2), n1.le_inner(n2));
+                l1.flowsto(l2) && n1.le_inner(n2)
             },
             _ => false,
         };
@@ -571,6 +579,12 @@ impl Policy {
 
     /// The implementation for the `policy_join` inductive relation.
     pub fn join(&self, other: &Self) -> PicachvResult<Self> {
+        counters::incr(Counter::PolicyJoins);
+        self.join_inner(other)
+    }
+
+    /// [`Policy::join`] without bumping [`Counter::PolicyJoins`], for its own recursion.
+    fn join_inner(&self, other: &Self) -> PicachvResult<Self> {
         picachv_ensure!(self.valid() && other.valid(),
             ComputeError: "trying to join invalid policies");
 
@@ -590,13 +604,13 @@ impl Policy {
                 if label1.base_eq(label2) {
                     return Ok(Policy::PolicyDeclassify {
                         label: Arc::new(label1.join(label2)),
-                        next: Arc::new(next1.join(next2)?),
+                        next: Arc::new(next1.join_inner(next2)?),
                     });
                 }
 
                 let (lbl, p3) = match label1.flowsto(label2) {
-                    true => (label2, self.join(next2)?),
-                    false => (label1, next1.join(other)?),
+                    true => (label2, self.join_inner(next2)?),
+                    false => (label1, next1.join_inner(other)?),
                 };
 
                 Ok(Policy::PolicyDeclassify {
@@ -609,13 +623,14 @@ impl Policy {
 
     /// Checks and downgrades the policy by a given label.
     pub fn downgrade(&self, by: &Arc<PolicyLabel>) -> PicachvResult<Self> {
+        counters::incr(Counter::PolicyDowngrades);
         let p = build_policy!(by.clone())?;
         #[cfg(feature = "trace")]
         tracing::debug!("in downgrade: constructed policy: {p:?}");
         #[cfg(feature = "trace")]
         tracing::debug!("downgrading: {self:?} vs {p:?}");
 
-        match self.le(&p) {
+        match self.le_inner(&p) {
             Ok(b) => {
                 picachv_ensure!(b, PrivacyError: "trying to downgrade by an operation that is not allowed");
                 self.do_downgrade(by)
@@ -628,7 +643,10 @@ impl Policy {
 impl PartialEq for Policy {
     #[inline]
     fn eq(&self, other: &Self) -> bool {
-        matches!((self.le(other), other.le(self)), (Ok(true), Ok(true)))
+        matches!(
+            (self.le_inner(other), other.le_inner(self)),
+            (Ok(true), Ok(true))
+        )
     }
 }
 
@@ -636,7 +654,7 @@ impl Eq for Policy {}
 
 impl PartialOrd for Policy {
     fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
-        match (self.le(other), other.le(self)) {
+        match (self.le_inner(other), other.le_inner(self)) {
             (Ok(true), Ok(true)) => Some(std::cmp::Ordering::Equal),
             (Ok(true), Ok(false)) => Some(std::cmp::Ordering::Less),
             (Ok(false), Ok(true)) => Some(std::cmp::Ordering::Greater),
@@ -1,104 +1,1016 @@
 //! Profiler implementation
+//!
+//! Every call to [`PicachvProfiler::profile`] records a span. Spans are appended to a buffer
+//! owned by the thread that takes them without taking any lock, so profiling a parallel section
+//! does not make its tasks contend, and the buffers are only merged when the spans are read.
+//! Timestamps come from the time stamp counter where the kernel trusts it as its own clock
+//! source, which is cheaper to read than the monotonic clock, and from the monotonic clock
+//! otherwise; see [`now`].
+//!
+//! A span opened while another one is open on the same thread becomes its child. Children on
+//! the same thread are strictly nested in time, so the self time of a span (its total time
+//! minus that of its children) never double-counts. Work that a span hands over to other
+//! threads shows up as top-level spans on those threads and as waiting time in the span itself.
+//!
+//! Each context owns a profiler so that concurrent sessions do not mix their spans. The code
+//! shared by all contexts records through [`profile`], which uses the profiler installed on the
+//! current thread by [`PicachvProfiler::install`] and falls back to [`PROFILER`]. Work running
+//! on the thread pool should capture [`current`] before it is split.
+//!
+//! For a coarse breakdown, [`PicachvProfiler::phases`] attributes the time of the spans to the
+//! [`Phase`]s of a query by their names.
 
 use std::borrow::Cow;
-use std::sync::{Arc, LazyLock, RwLock};
-use std::time::{Duration, SystemTime};
+use std::cell::{Cell, RefCell, UnsafeCell};
+use std::marker::PhantomData;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, LazyLock};
+use std::time::{Duration, Instant};
 
 use ahash::{HashMap, HashMapExt};
 use serde::{Deserialize, Serialize};
+use serde_json::json;
+use spin::Mutex;
 
-pub type Tick = (u128, u128);
+/// The start and the end of a span in nanoseconds; see [`now`].
+pub type Tick = (u64, u64);
+
+/// The end of a span that is still open.
+const OPEN: u64 = u64::MAX;
+
+/// The number of spans in a segment of a [`ThreadBuffer`].
+const SEGMENT_LEN: usize = 1024;
+
+/// The profiler clock.
+static CLOCK: LazyLock<Clock> = LazyLock::new(Clock::new);
+
+static NEXT_PROFILER_ID: AtomicUsize = AtomicUsize::new(0);
+static NEXT_THREAD_ID: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    /// A small process-wide index of the current thread.
+    static THREAD_ID: usize = NEXT_THREAD_ID.fetch_add(1, Ordering::Relaxed);
+
+    /// The buffers of the current thread, keyed by the ID of the profiler they belong to.
+    static BUFFERS: RefCell<Vec<(usize, Arc<ThreadBuffer>)>> = const { RefCell::new(Vec::new()) };
+
+    /// The last buffer of the current thread that was looked up in [`BUFFERS`], with the ID of
+    /// its profiler. IDs are never reused, so an entry of a dropped profiler never matches.
+    static LAST_BUFFER: Cell<(usize, *const ThreadBuffer)> =
+        const { Cell::new((usize::MAX, std::ptr::null())) };
+
+    /// The profiler installed on the current thread, or null. [`PicachvProfiler::install`]
+    /// keeps it alive while it is installed.
+    static CURRENT: Cell<*const PicachvProfiler> = const { Cell::new(std::ptr::null()) };
+}
+
+/// Returns the nanoseconds elapsed since the profiler clock started.
+///
+/// On x86-64 Linux this reads the time stamp counter if it runs at a constant rate and the
+/// kernel uses it as its clock source, i.e., it is synchronized across cores. It is then
+/// converted with the rate measured against [`Instant`] when the clock starts.
+#[inline]
+pub fn now() -> u64 {
+    CLOCK.now()
+}
+
+/// The interval over which the rate of the time stamp counter is measured.
+#[cfg(all(target_arch = "x86_64", target_os = "linux"))]
+const TSC_CALIBRATION: Duration = Duration::from_millis(2);
+
+struct Clock {
+    /// The origin of the clock.
+    epoch: Instant,
+    /// The time stamp counter at `epoch` and the nanoseconds per tick as a 32.32 fixed-point
+    /// number, if the counter is used.
+    tsc: Option<(u64, u64)>,
+}
+
+impl Clock {
+    fn new() -> Self {
+        #[cfg(all(target_arch = "x86_64", target_os = "linux"))]
+        if Self::tsc_is_reliable() {
+            // Pairs a reading of the monotonic clock with the counter halfway through it,
+            // keeping the tightest of a few tries so that an interrupt does not skew the rate.
+            let read = || {
+                (0..16)
+                    .map(|_| {
+                        let before = Self::rdtsc();
+                        let instant = Instant::now();
+                        let window = Self::rdtsc().saturating_sub(before);
+                        (window, instant, before + window / 2)
+                    })
+                    .min_by_key(|&(window, ..)| window)
+                    .map(|(_, instant, tsc)| (instant, tsc))
+                    .unwrap()
+            };
+
+            let (epoch, base) = read();
+            std::thread::sleep(TSC_CALIBRATION);
+            let (end, tsc) = read();
+
+            let nanos = end.duration_since(epoch).as_nanos();
+            let ticks = tsc.saturating_sub(base) as u128;
+            if ticks > 0 {
+                let scale = ((nanos << 32) / ticks) as u64;
+                return Self {
+                    epoch,
+                    tsc: Some((base, scale)),
+                };
+            }
+        }
+
+        Self {
+            epoch: Instant::now(),
+            tsc: None,
+        }
+    }
+
+    #[inline]
+    fn now(&self) -> u64 {
+        match self.tsc {
+            #[cfg(all(target_arch = "x86_64", target_os = "linux"))]
+            Some((base, scale)) => {
+                let ticks = Self::rdtsc().saturating_sub(base) as u128;
+                ((ticks * scale as u128) >> 32) as u64
+            },
+            _ => self.epoch.elapsed().as_nanos() as u64,
+        }
+    }
+
+    #[cfg(all(target_arch = "x86_64", target_os = "linux"))]
+    #[inline]
+    fn rdtsc() -> u64 {
+        // SAFETY: `rdtsc` is available on every x86-64 CPU.
+        unsafe { std::arch::x86_64::_rdtsc() }
+    }
+
+    /// Returns whether the time stamp counter is invariant (CPUID `0x80000007`, EDX bit 8) and
+    /// the kernel keeps using it as its clock source, which it stops doing if the counters of
+    /// the cores drift apart.
+    #[cfg(all(target_arch = "x86_64", target_os = "linux"))]
+    fn tsc_is_reliable() -> bool {
+        use std::arch::x86_64::__cpuid;
+
+        // SAFETY: `cpuid` is available on every x86-64 CPU.
+        let invariant = unsafe {
+            __cpuid(0x8000_0000).eax >= 0x8000_0007 && __cpuid(0x8000_0007).edx & (1 << 8) != 0
+        };
+
+        invariant
+            && std::fs::read_to_string(
+                "/sys/devices/system/clocksource/clocksource0/current_clocksource",
+            )
+            .is_ok_and(|source| source.trim() == "tsc")
+    }
+}
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
-pub struct Stat<'a> {
+pub struct Stat {
     /// The name of this stat
-    pub name: Cow<'a, str>,
+    pub name: Cow<'static, str>,
     pub tick: Vec<Tick>,
 }
 
-/// A simple Rust profiler for collecting more accurate information.
-pub struct PicachvProfiler<'a> {
-    /// The stats collected by the profiler.
+/// A finished span.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct Span {
+    /// The index of this span in [`PicachvProfiler::spans`].
+    pub id: usize,
+    /// The innermost span that was open on the same thread when this one started.
+    pub parent: Option<usize>,
+    pub name: Cow<'static, str>,
+    pub tick: Tick,
+    /// The index of the thread; see [`PicachvProfiler::threads`].
+    pub thread: usize,
+}
+
+impl Span {
+    #[inline]
+    pub fn duration(&self) -> Duration {
+        Duration::from_nanos(self.tick.1 - self.tick.0)
+    }
+}
+
+/// The spans with the same name under the same chain of parents, aggregated.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct SpanStat {
+    pub name: Cow<'static, str>,
+    pub calls: usize,
+    /// The time spent in the spans.
+    pub total: Duration,
+    /// The time spent in the spans but not in their children.
+    pub self_time: Duration,
+    /// Ordered by decreasing total time.
+    pub children: Vec<SpanStat>,
+}
+
+/// The phases of a query that [`PicachvProfiler::phases`] attributes the spans to.
+#[repr(usize)]
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub enum Phase {
+    /// Reading policies from files.
+    Load,
+    /// Checking scans.
+    Scan,
+    /// Checking selections and filtering the dataframes.
+    Filter,
+    /// Checking aggregations.
+    Aggregate,
+    /// Transforming dataframes by joins.
+    Join,
+    /// Checking the output of a query.
+    Finalize,
+    /// Everything not attributed to another phase.
+    Other,
+}
+
+impl Phase {
+    /// All the phases, in the order of their discriminants.
+    pub const ALL: &'static [Phase] = &[
+        Phase::Load,
+        Phase::Scan,
+        Phase::Filter,
+        Phase::Aggregate,
+        Phase::Join,
+        Phase::Finalize,
+        Phase::Other,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Phase::Load => "load",
+            Phase::Scan => "scan",
+            Phase::Filter => "filter",
+            Phase::Aggregate => "aggregate",
+            Phase::Join => "join",
+            Phase::Finalize => "finalize",
+            Phase::Other => "other",
+        }
+    }
+
+    /// Returns the phase of the spans named `name`, or `None` if they belong to that of their
+    /// parents.
+    pub fn of(name: &str) -> Option<Phase> {
+        match name {
+            "read_parquet" | "read_row_group" | "read_policy_rows" => Some(Phase::Load),
+            "DataFrameScan" => Some(Phase::Scan),
+            "Select" | "filter" => Some(Phase::Filter),
+            "Aggregation" => Some(Phase::Aggregate),
+            "join" | "join_probe" | "join_filter" | "join_gather" => Some(Phase::Join),
+            "finalize" => Some(Phase::Finalize),
+            _ => None,
+        }
+    }
+
+    /// Formats the time spent in each phase as a JSON object of nanoseconds keyed by the names
+    /// of the phases.
+    pub fn to_json(phases: &[(Phase, Duration)]) -> String {
+        phases_json(phases).to_string()
+    }
+}
+
+struct RawSpan {
+    name: Cow<'static, str>,
+    start: u64,
+    parent: Option<usize>,
+}
+
+/// A span in a [`ThreadBuffer`]. Only its end changes once it is published.
+struct Slot {
+    span: UnsafeCell<MaybeUninit<RawSpan>>,
+    end: AtomicU64,
+}
+
+impl Default for Slot {
+    fn default() -> Self {
+        Slot {
+            span: UnsafeCell::new(MaybeUninit::uninit()),
+            end: AtomicU64::new(OPEN),
+        }
+    }
+}
+
+/// The state of a [`ThreadBuffer`] that only the owning thread touches.
+#[derive(Default)]
+struct Writer {
+    /// The segments of the buffer. They are boxed, so their addresses never change.
+    segments: Vec<*const Slot>,
+    /// The indices of the open spans, innermost last.
+    open: Vec<usize>,
+    /// The epoch the spans in the buffer were taken in.
+    epoch: u64,
+}
+
+/// The spans taken by one thread for one profiler.
+///
+/// Only the owning thread writes. It appends spans to fixed-size segments and publishes them
+/// by bumping `len`, so taking a span needs no lock. The lock is only taken by the owning thread
+/// to add a segment or to drop the spans after a reset, and by readers to keep the segments in
+/// place while they copy the published spans.
+struct ThreadBuffer {
+    thread: usize,
+    thread_name: Option<String>,
+    segments: Mutex<Vec<Box<[Slot]>>>,
+    /// The number of published spans.
+    len: AtomicUsize,
+    /// The spans before this index have been dropped by [`PicachvProfiler::reset`].
+    cleared: AtomicUsize,
+    /// Bumped by [`PicachvProfiler::reset`] so that spans opened before are dropped.
+    epoch: AtomicU64,
+    writer: UnsafeCell<Writer>,
+}
+
+// SAFETY: `writer` is only touched by the owning thread (see `ThreadBuffer::writer`), and the
+// published spans are only read, or dropped by the owning thread while holding the lock.
+unsafe impl Send for ThreadBuffer {}
+unsafe impl Sync for ThreadBuffer {}
+
+impl ThreadBuffer {
+    fn new() -> Self {
+        ThreadBuffer {
+            thread: THREAD_ID.with(|id| *id),
+            thread_name: std::thread::current().name().map(Into::into),
+            segments: Mutex::new(Vec::new()),
+            len: AtomicUsize::new(0),
+            cleared: AtomicUsize::new(0),
+            epoch: AtomicU64::new(0),
+            writer: UnsafeCell::new(Writer::default()),
+        }
+    }
+
+    /// # Safety
     ///
-    /// The hashmap key is the group name of the stats, and the value is the stat itself.
-    /// A stat contains a vector of start and end time of the profiling.
-    pub stats: Arc<RwLock<HashMap<Cow<'a, str>, Stat<'a>>>>,
+    /// Must only be called by the owning thread, and the reference must not outlive the call
+    /// to [`ThreadBuffer::push`] or [`ThreadBuffer::close`] that takes it.
+    #[allow(clippy::mut_from_ref)]
+    unsafe fn writer(&self) -> &mut Writer {
+        &mut *self.writer.get()
+    }
+
+    /// Appends an open span and returns its index and epoch. Must only be called by the owning
+    /// thread.
+    #[inline]
+    fn push(&self, name: Cow<'static, str>, start: u64) -> (usize, u64) {
+        // SAFETY: see `SpanGuard`; the buffer is only handed out to its owning thread.
+        let writer = unsafe { self.writer() };
+
+        let epoch = self.epoch.load(Ordering::Acquire);
+        if epoch != writer.epoch {
+            self.clear(writer, epoch);
+        }
+
+        let index = self.len.load(Ordering::Relaxed);
+        if index / SEGMENT_LEN == writer.segments.len() {
+            let segment = (0..SEGMENT_LEN)
+                .map(|_| Slot::default())
+                .collect::<Box<[_]>>();
+            writer.segments.push(segment.as_ptr());
+            self.segments.lock().push(segment);
+        }
+
+        // SAFETY: the segment is alive as long as the buffer, and the slot at `index` is not
+        // published yet, so no reader looks at it.
+        let slot = unsafe { &*writer.segments[index / SEGMENT_LEN].add(index % SEGMENT_LEN) };
+        unsafe {
+            (*slot.span.get()).write(RawSpan {
+                name,
+                start,
+                parent: writer.open.last().copied(),
+            })
+        };
+        slot.end.store(OPEN, Ordering::Relaxed);
+        self.len.store(index + 1, Ordering::Release);
+        writer.open.push(index);
+
+        (index, writer.epoch)
+    }
+
+    /// Closes the innermost open span unless it has been dropped by a reset. Must only be
+    /// called by the owning thread.
+    #[inline]
+    fn close(&self, index: usize, epoch: u64, end: u64) {
+        // SAFETY: as in `push`.
+        let writer = unsafe { self.writer() };
+        if writer.epoch == epoch {
+            // SAFETY: the span is published and is only dropped by this thread.
+            let slot = unsafe { &*writer.segments[index / SEGMENT_LEN].add(index % SEGMENT_LEN) };
+            slot.end.store(end, Ordering::Release);
+            // Spans on a thread are closed in the reverse order of their opening.
+            writer.open.pop();
+        }
+    }
+
+    /// Drops the spans after a reset to `epoch`, keeping the segments for the next ones.
+    #[cold]
+    fn clear(&self, writer: &mut Writer, epoch: u64) {
+        let segments = self.segments.lock();
+        Self::drop_spans(&segments, self.len.load(Ordering::Relaxed));
+        self.len.store(0, Ordering::Release);
+        self.cleared.store(0, Ordering::Release);
+        writer.open.clear();
+        writer.epoch = epoch;
+    }
+
+    /// Drops the first `len` spans, which must be published.
+    fn drop_spans(segments: &[Box<[Slot]>], len: usize) {
+        for i in 0..len {
+            // SAFETY: the caller holds the lock or owns the buffer, so no one reads the span.
+            unsafe { (*segments[i / SEGMENT_LEN][i % SEGMENT_LEN].span.get()).assume_init_drop() };
+        }
+    }
+
+    /// Appends the published spans that have not been dropped to `raw`.
+    fn read(&self, raw: &mut Vec<Span>) {
+        let segments = self.segments.lock();
+        let len = self.len.load(Ordering::Acquire);
+        let cleared = self.cleared.load(Ordering::Acquire).min(len);
+        let base = raw.len();
+
+        raw.extend((cleared..len).map(|i| {
+            let slot = &segments[i / SEGMENT_LEN][i % SEGMENT_LEN];
+            // SAFETY: published spans are only dropped by the owning thread under the lock.
+            let span = unsafe { (*slot.span.get()).assume_init_ref() };
+            Span {
+                id: 0,
+                // The parent may have been dropped.
+                parent: span
+                    .parent
+                    .filter(|&p| p >= cleared)
+                    .map(|p| base + p - cleared),
+                name: span.name.clone(),
+                tick: (span.start, slot.end.load(Ordering::Acquire)),
+                thread: self.thread,
+            }
+        }));
+    }
+
+    /// Drops all the spans taken so far; the owning thread frees them when it takes the next.
+    fn reset(&self) {
+        let _segments = self.segments.lock();
+        self.cleared
+            .store(self.len.load(Ordering::Acquire), Ordering::Release);
+        self.epoch.fetch_add(1, Ordering::Release);
+    }
+}
+
+impl Drop for ThreadBuffer {
+    fn drop(&mut self) {
+        Self::drop_spans(self.segments.get_mut(), *self.len.get_mut());
+    }
+}
+
+/// Closes its span when dropped, even if the profiled function panics.
+struct SpanGuard<'a> {
+    buffer: &'a ThreadBuffer,
+    index: usize,
+    epoch: u64,
+    /// The span must be closed on the thread that opened it, which owns the buffer.
+    _not_send: PhantomData<*const ()>,
+}
+
+impl Drop for SpanGuard<'_> {
+    #[inline]
+    fn drop(&mut self) {
+        self.buffer.close(self.index, self.epoch, now());
+    }
+}
+
+/// A simple Rust profiler for collecting more accurate information.
+pub struct PicachvProfiler {
+    id: usize,
+    /// The buffers of all the threads that have taken a span.
+    threads: Mutex<Vec<Arc<ThreadBuffer>>>,
 }
 
-impl<'a> Default for PicachvProfiler<'a> {
+impl Default for PicachvProfiler {
     fn default() -> Self {
         Self::new()
     }
 }
 
-impl<'a> PicachvProfiler<'a> {
+impl PicachvProfiler {
     pub fn new() -> Self {
         PicachvProfiler {
-            stats: Arc::new(RwLock::new(HashMap::new())),
+            id: NEXT_PROFILER_ID.fetch_add(1, Ordering::Relaxed),
+            threads: Mutex::new(Vec::new()),
         }
     }
 
-    pub fn dump(&self) -> Vec<(Cow<'a, str>, Duration)> {
-        let lock: std::sync::RwLockReadGuard<HashMap<Cow<'a, str>, Stat<'a>>> =
-            self.stats.read().unwrap();
-        lock.iter()
-            .map(|(name, stat)| {
-                let mut duration = Duration::from_micros(0);
-                for &(start, end) in &stat.tick {
-                    duration += Duration::from_micros((end - start) as _);
-                }
-                (name.clone(), duration)
+    /// Returns all the finished spans ordered by their start.
+    pub fn spans(&self) -> Vec<Span> {
+        let mut raw = vec![];
+        for buffer in self.threads.lock().iter() {
+            buffer.read(&mut raw);
+        }
+
+        let mut order = (0..raw.len())
+            .filter(|&i| raw[i].tick.1 != OPEN)
+            .collect::<Vec<_>>();
+        order.sort_unstable_by_key(|&i| raw[i].tick);
+        let mut ids = vec![None; raw.len()];
+        for (id, &i) in order.iter().enumerate() {
+            ids[i] = Some(id);
+        }
+
+        order
+            .iter()
+            .enumerate()
+            .map(|(id, &i)| Span {
+                id,
+                // The parent may still be open.
+                parent: raw[i].parent.and_then(|p| ids[p]),
+                ..raw[i].clone()
             })
             .collect()
     }
 
-    pub fn dump_raw(&self) -> Vec<(Cow<'a, str>, Vec<Duration>)> {
-        self.stats
-            .read()
-            .unwrap()
+    /// Returns the spans grouped by name.
+    pub fn stats(&self) -> HashMap<Cow<'static, str>, Stat> {
+        let mut stats = HashMap::new();
+        for span in self.spans() {
+            stats
+                .entry(span.name.clone())
+                .or_insert_with(|| Stat {
+                    name: span.name,
+                    tick: vec![],
+                })
+                .tick
+                .push(span.tick);
+        }
+
+        stats
+    }
+
+    /// Returns the index and the name of every thread that has taken a span.
+    pub fn threads(&self) -> Vec<(usize, Option<String>)> {
+        self.threads
+            .lock()
             .iter()
-            .map(|(k, v)| {
+            .map(|buffer| (buffer.thread, buffer.thread_name.clone()))
+            .collect()
+    }
+
+    pub fn dump(&self) -> Vec<(Cow<'static, str>, Duration)> {
+        self.stats()
+            .into_iter()
+            .map(|(name, stat)| {
+                let duration = stat
+                    .tick
+                    .iter()
+                    .map(|&(start, end)| Duration::from_nanos(end - start))
+                    .sum();
+                (name, duration)
+            })
+            .collect()
+    }
+
+    pub fn dump_raw(&self) -> Vec<(Cow<'static, str>, Vec<Duration>)> {
+        self.stats()
+            .into_iter()
+            .map(|(name, stat)| {
                 (
-                    k.clone(),
-                    v.tick
+                    name,
+                    stat.tick
                         .iter()
-                        .map(|(start, end)| Duration::from_micros(*end as u64 - *start as u64))
+                        .map(|&(start, end)| Duration::from_nanos(end - start))
                         .collect::<Vec<Duration>>(),
                 )
             })
             .collect()
     }
 
+    /// Returns the total time of each stat on each thread.
+    pub fn dump_by_thread(&self) -> Vec<(usize, Vec<(Cow<'static, str>, Duration)>)> {
+        let mut threads = HashMap::<usize, HashMap<Cow<'static, str>, Duration>>::new();
+        for span in self.spans() {
+            *threads
+                .entry(span.thread)
+                .or_default()
+                .entry(span.name.clone())
+                .or_default() += span.duration();
+        }
+
+        threads
+            .into_iter()
+            .map(|(thread, stats)| (thread, stats.into_iter().collect()))
+            .collect()
+    }
+
+    /// Aggregates the spans into a call tree, ordered by decreasing total time.
+    pub fn tree(&self) -> Vec<SpanStat> {
+        let spans = self.spans();
+        let self_times = self_times(&spans);
+
+        // Spans are merged into a node if they have the same name and their parents are
+        // merged into the same node.
+        let mut nodes: Vec<SpanStat> = vec![];
+        let mut children: Vec<Vec<usize>> = vec![];
+        let mut roots = vec![];
+        let mut node_of = vec![None; spans.len()];
+        // A span starts no earlier than its parent, so the parent has been visited unless
+        // they start at the same instant.
+        let mut pending = (0..spans.len()).collect::<Vec<_>>();
+        while !pending.is_empty() {
+            pending.retain(|&i| {
+                let siblings = match spans[i].parent {
+                    None => &mut roots,
+                    Some(p) => match node_of[p] {
+                        Some(node) => &mut children[node],
+                        None => return true,
+                    },
+                };
+                let node = match siblings
+                    .iter()
+                    .copied()
+                    .find(|&n: &usize| nodes[n].name == spans[i].name)
+                {
+                    Some(node) => node,
+                    None => {
+                        nodes.push(SpanStat {
+                            name: spans[i].name.clone(),
+                            calls: 0,
+                            total: Duration::ZERO,
+                            self_time: Duration::ZERO,
+                            children: vec![],
+                        });
+                        siblings.push(nodes.len() - 1);
+                        children.push(vec![]);
+                        nodes.len() - 1
+                    },
+                };
+
+                nodes[node].calls += 1;
+                nodes[node].total += spans[i].duration();
+                nodes[node].self_time += self_times[i];
+                node_of[i] = Some(node);
+
+                false
+            });
+        }
+
+        fn build(node: usize, nodes: &[SpanStat], children: &[Vec<usize>]) -> SpanStat {
+            let mut stat = nodes[node].clone();
+            stat.children = children[node]
+                .iter()
+                .map(|&c| build(c, nodes, children))
+                .collect();
+            stat.children.sort_by(|a, b| b.total.cmp(&a.total));
+            stat
+        }
+
+        let mut tree = roots
+            .iter()
+            .map(|&r| build(r, &nodes, &children))
+            .collect::<Vec<_>>();
+        tree.sort_by(|a, b| b.total.cmp(&a.total));
+
+        tree
+    }
+
+    /// Exports the spans in the Chrome trace event format, which can be opened with
+    /// `chrome://tracing` or Perfetto. Each thread is a track, and the self time of each span
+    /// is kept in its arguments.
+    pub fn chrome_trace(&self) -> String {
+        let spans = self.spans();
+        let self_times = self_times(&spans);
+        let pid = std::process::id();
+
+        let threads = self.threads().into_iter().map(|(tid, name)| {
+            json!({
+                "name": "thread_name",
+                "ph": "M",
+                "pid": pid,
+                "tid": tid,
+                "args": { "name": name.unwrap_or_else(|| format!("thread-{tid}")) },
+            })
+        });
+        let events = spans
+            .iter()
+            .zip(self_times.iter())
+            .map(|(span, self_time)| {
+                json!({
+                    "name": span.name,
+                    "cat": "picachv",
+                    "ph": "X",
+                    "ts": span.tick.0 as f64 / 1e3,
+                    "dur": (span.tick.1 - span.tick.0) as f64 / 1e3,
+                    "pid": pid,
+                    "tid": span.thread,
+                    "args": { "self_us": self_time.as_nanos() as f64 / 1e3 },
+                })
+            });
+
+        json!({
+            "traceEvents": threads.chain(events).collect::<Vec<_>>(),
+            "displayTimeUnit": "ns",
+        })
+        .to_string()
+    }
+
+    /// Summarizes the spans as JSON: the number of spans, the wall time they cover, and the
+    /// call tree with the total and self time of each node in nanoseconds.
+    pub fn summary(&self) -> String {
+        fn node(stat: &SpanStat) -> serde_json::Value {
+            json!({
+                "name": stat.name,
+                "calls": stat.calls,
+                "total_ns": stat.total.as_nanos() as u64,
+                "self_ns": stat.self_time.as_nanos() as u64,
+                "children": stat.children.iter().map(node).collect::<Vec<_>>(),
+            })
+        }
+
+        let spans = self.spans();
+        let wall = match (spans.first(), spans.iter().map(|s| s.tick.1).max()) {
+            (Some(first), Some(end)) => end - first.tick.0,
+            _ => 0,
+        };
+
+        let tree = self.tree();
+
+        json!({
+            "spans": spans.len(),
+            "wall_ns": wall,
+            "phases": phases_json(&phases(&tree)),
+            "tree": tree.iter().map(node).collect::<Vec<_>>(),
+        })
+        .to_string()
+    }
+
+    /// Returns the time spent in each phase, in the order of [`Phase::ALL`].
+    ///
+    /// A span counts towards the phase of its outermost ancestor that has one (see
+    /// [`Phase::of`]); the self time of the other spans counts towards [`Phase::Other`]. Work
+    /// handed over to the thread pool is recorded in top-level spans of the workers and thus
+    /// counts towards [`Phase::Other`] on top of the waiting time of the span that handed it
+    /// over, so the phases may add up to more than the wall time.
+    pub fn phases(&self) -> Vec<(Phase, Duration)> {
+        phases(&self.tree())
+    }
+
+    /// Drops all the spans taken so far. Spans that are still open are dropped as well.
+    pub fn reset(&self) {
+        for buffer in self.threads.lock().iter() {
+            buffer.reset();
+        }
+    }
+
     /// Profile a function call.
+    #[inline]
     pub fn profile<T, F: FnOnce() -> T>(&self, func: F, name: Cow<'static, str>) -> T {
-        let start = SystemTime::now()
-            .duration_since(SystemTime::UNIX_EPOCH)
-            .unwrap()
-            .as_micros();
-        let result = func();
-        let end = SystemTime::now()
-            .duration_since(SystemTime::UNIX_EPOCH)
-            .unwrap()
-            .as_micros();
-
-        let mut lock = self.stats.write().unwrap();
-        match lock.get_mut(&name) {
-            Some(stat) => {
-                stat.tick.push((start, end));
-            },
+        let _span = self.enter(name);
+
+        func()
+    }
+
+    /// Makes [`profile`] record into this profiler on the current thread while `func` runs.
+    pub fn install<T, F: FnOnce() -> T>(self: &Arc<Self>, func: F) -> T {
+        /// Restores the previous profiler, even if `func` panics.
+        struct Restore(*const PicachvProfiler);
+
+        impl Drop for Restore {
+            fn drop(&mut self) {
+                CURRENT.with(|current| current.set(self.0));
+            }
+        }
+
+        // `self` is borrowed until `func` returns, so the profiler outlives its installation.
+        let _restore = Restore(CURRENT.with(|current| current.replace(Arc::as_ptr(self))));
+
+        func()
+    }
+
+    #[inline]
+    fn enter(&self, name: Cow<'static, str>) -> SpanGuard<'_> {
+        let buffer = self.buffer();
+        let (index, epoch) = buffer.push(name, now());
+
+        SpanGuard {
+            buffer,
+            index,
+            epoch,
+            _not_send: PhantomData,
+        }
+    }
+
+    /// Returns the buffer of the current thread.
+    #[inline]
+    fn buffer(&self) -> &ThreadBuffer {
+        let (id, buffer) = LAST_BUFFER.with(Cell::get);
+        if id == self.id {
+            // SAFETY: `self.threads` keeps the buffer alive.
+            return unsafe { &*buffer };
+        }
+
+        let buffer = BUFFERS.with(|buffers| {
+            let mut buffers = buffers.borrow_mut();
+            if let Some((_, buffer)) = buffers.iter().find(|(id, _)| *id == self.id) {
+                return Arc::as_ptr(buffer);
+            }
+
+            // A buffer that only this thread holds belongs to a dropped profiler.
+            buffers.retain(|(_, buffer)| Arc::strong_count(buffer) > 1);
+
+            let buffer = Arc::new(ThreadBuffer::new());
+            self.threads.lock().push(buffer.clone());
+            let ptr = Arc::as_ptr(&buffer);
+            buffers.push((self.id, buffer));
+
+            ptr
+        });
+        LAST_BUFFER.with(|last| last.set((self.id, buffer)));
+
+        // SAFETY: as above.
+        unsafe { &*buffer }
+    }
+}
+
+fn phases(tree: &[SpanStat]) -> Vec<(Phase, Duration)> {
+    fn visit(stat: &SpanStat, acc: &mut [Duration]) {
+        match Phase::of(&stat.name) {
+            Some(phase) => acc[phase as usize] += stat.total,
             None => {
-                lock.insert(
-                    name.clone(),
-                    Stat {
-                        name,
-                        tick: vec![(start, end)],
-                    },
-                );
+                acc[Phase::Other as usize] += stat.self_time;
+                stat.children.iter().for_each(|c| visit(c, acc));
             },
         }
+    }
 
-        result
+    let mut acc = vec![Duration::ZERO; Phase::ALL.len()];
+    tree.iter().for_each(|stat| visit(stat, &mut acc));
+
+    Phase::ALL.iter().map(|&p| (p, acc[p as usize])).collect()
+}
+
+fn phases_json(phases: &[(Phase, Duration)]) -> serde_json::Value {
+    phases
+        .iter()
+        .map(|(phase, d)| (phase.name().to_string(), json!(d.as_nanos() as u64)))
+        .collect::<serde_json::Map<_, _>>()
+        .into()
+}
+
+/// Returns the self time of each span, i.e., its duration minus that of its children.
+fn self_times(spans: &[Span]) -> Vec<Duration> {
+    let mut self_times = spans.iter().map(Span::duration).collect::<Vec<_>>();
+    for span in spans.iter() {
+        if let Some(parent) = span.parent {
+            self_times[parent] = self_times[parent].saturating_sub(span.duration());
+        }
+    }
+
+    self_times
+}
+
+/// Records the spans taken outside of any installed profiler.
+pub static PROFILER: LazyLock<Arc<PicachvProfiler>> =
+    LazyLock::new(|| Arc::new(PicachvProfiler::new()));
+
+/// Returns the profiler installed on the current thread, or [`PROFILER`].
+pub fn current() -> Arc<PicachvProfiler> {
+    let profiler = CURRENT.with(Cell::get);
+    if profiler.is_null() {
+        return PROFILER.clone();
+    }
+
+    // SAFETY: the pointer comes from an `Arc` that `install` keeps alive while it is installed.
+    unsafe {
+        Arc::increment_strong_count(profiler);
+        Arc::from_raw(profiler)
     }
 }
 
-pub static PROFILER: LazyLock<PicachvProfiler> = LazyLock::new(PicachvProfiler::new);
+/// Profiles a function call with the profiler installed on the current thread.
+#[inline]
+pub fn profile<T, F: FnOnce() -> T>(func: F, name: Cow<'static, str>) -> T {
+    let profiler = CURRENT.with(Cell::get);
+    let profiler = match profiler.is_null() {
+        true => &**PROFILER,
+        // SAFETY: the profiler stays installed, and thus alive, until `func` returns, because
+        // `func` runs inside the call to `install` that installed it.
+        false => unsafe { &*profiler },
+    };
+
+    profiler.profile(func, name)
+}
+
+#[cfg(test)]
+mod tests {
+    use rayon::prelude::*;
+
+    use super::*;
+    use crate::thread_pool::THREAD_POOL;
+
+    #[test]
+    fn test_profiler_merges_threads() {
+        let profiler = PicachvProfiler::new();
+        THREAD_POOL.install(|| {
+            (0..1000).into_par_iter().for_each(|i| {
+                profiler.profile(|| i * 2, "task".into());
+            })
+        });
+        profiler.profile(|| (), "outer".into());
+
+        let spans = profiler.spans();
+        assert_eq!(spans.len(), 1001);
+        assert!(spans.windows(2).all(|w| w[0].tick <= w[1].tick));
+        assert!(spans.iter().all(|s| s.tick.0 <= s.tick.1));
+        assert_eq!(profiler.dump_raw().len(), 2);
+        assert!(!profiler.threads().is_empty());
+
+        profiler.reset();
+        assert!(profiler.spans().is_empty());
+    }
+
+    #[test]
+    fn test_profiler_nested_spans() {
+        let profiler = PicachvProfiler::new();
+        let spin = |d: Duration| {
+            let start = Instant::now();
+            while start.elapsed() < d {}
+        };
+
+        profiler.profile(
+            || {
+                spin(Duration::from_millis(2));
+                for _ in 0..2 {
+                    profiler.profile(|| spin(Duration::from_millis(3)), "inner".into());
+                }
+            },
+            "outer".into(),
+        );
+
+        let tree = profiler.tree();
+        assert_eq!(tree.len(), 1);
+        let outer = &tree[0];
+        assert_eq!((outer.name.as_ref(), outer.calls), ("outer", 1));
+        assert_eq!(outer.children.len(), 1);
+
+        let inner = &outer.children[0];
+        assert_eq!((inner.name.as_ref(), inner.calls), ("inner", 2));
+        assert_eq!(inner.self_time, inner.total);
+        assert_eq!(outer.self_time, outer.total - inner.total);
+        assert!(outer.self_time >= Duration::from_millis(2));
+
+        let trace: serde_json::Value = serde_json::from_str(&profiler.chrome_trace()).unwrap();
+        let events = trace["traceEvents"].as_array().unwrap();
+        assert_eq!(events.iter().filter(|e| e["ph"] == "X").count(), 3);
+    }
+
+    #[test]
+    fn test_profiler_install() {
+        let (a, b) = (
+            Arc::new(PicachvProfiler::new()),
+            Arc::new(PicachvProfiler::new()),
+        );
+        a.install(|| {
+            profile(|| (), "a".into());
+            b.install(|| profile(|| (), "b".into()));
+            assert!(Arc::ptr_eq(&current(), &a));
+        });
+        assert!(Arc::ptr_eq(&current(), &PROFILER));
+
+        assert_eq!(a.spans().len(), 1);
+        assert_eq!(b.spans()[0].name, "b");
+
+        let summary: serde_json::Value = serde_json::from_str(&a.summary()).unwrap();
+        assert_eq!(summary["tree"][0]["name"], "a");
+        assert_eq!(summary["spans"], 1);
+    }
+
+    #[test]
+    fn test_profiler_phases() {
+        let profiler = PicachvProfiler::new();
+        let spin = |d: Duration| {
+            let start = Instant::now();
+            while start.elapsed() < d {}
+        };
+
+        profiler.profile(
+            || {
+                spin(Duration::from_millis(1));
+                profiler.profile(
+                    || profiler.profile(|| spin(Duration::from_millis(2)), "filter".into()),
+                    "Aggregation".into(),
+                );
+            },
+            "execute_epilogue".into(),
+        );
+        profiler.profile(|| spin(Duration::from_millis(1)), "finalize".into());
+
+        let phases = profiler.phases();
+        let get = |phase: Phase| phases[phase as usize].1;
+        assert_eq!(phases.len(), Phase::ALL.len());
+        // The filter counts towards the aggregation it is nested in.
+        assert_eq!(get(Phase::Filter), Duration::ZERO);
+        assert!(get(Phase::Aggregate) >= Duration::from_millis(2));
+        assert!(get(Phase::Finalize) >= Duration::from_millis(1));
+        assert!(get(Phase::Other) >= Duration::from_millis(1));
+
+        let summary: serde_json::Value = serde_json::from_str(&profiler.summary()).unwrap();
+        assert_eq!(summary["phases"]["load"], 0);
+        assert!(summary["phases"]["finalize"].as_u64().unwrap() > 0);
+    }
+}
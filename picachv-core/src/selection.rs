@@ -0,0 +1,235 @@
+use picachv_error::{picachv_ensure, PicachvError, PicachvResult};
+use picachv_message::FilterInformation;
+use rayon::prelude::*;
+
+use crate::thread_pool::THREAD_POOL;
+
+const WORD_BITS: usize = u64::BITS as usize;
+
+/// The rows kept by a filter, packed as a bitmap.
+///
+/// Bit `i % 64` of word `i / 64` tells whether the `i`-th row is kept. Along with the bitmap
+/// we keep the number of kept rows before each word so that the position of a row after
+/// filtering is one lookup plus one popcount. A [`Selection`] is built once per filter and
+/// shared by all the columns (and chunks) of a dataframe.
+#[derive(Clone, Debug, Default)]
+pub struct Selection {
+    words: Vec<u64>,
+    /// `ranks[w]` is the number of kept rows in `words[..w]`.
+    ranks: Vec<usize>,
+    len: usize,
+}
+
+impl Selection {
+    fn from_words(words: Vec<u64>, len: usize) -> Self {
+        let mut ranks = Vec::with_capacity(words.len() + 1);
+        let mut count = 0;
+        for w in words.iter() {
+            ranks.push(count);
+            count += w.count_ones() as usize;
+        }
+        ranks.push(count);
+
+        Self { words, ranks, len }
+    }
+
+    /// Packs a boolean filter.
+    pub fn from_bools(filter: &[bool]) -> Self {
+        let words = THREAD_POOL.install(|| {
+            filter
+                .par_chunks(WORD_BITS)
+                .map(|bits| {
+                    bits.iter()
+                        .enumerate()
+                        .fold(0u64, |w, (i, &b)| w | ((b as u64) << i))
+                })
+                .collect()
+        });
+
+        Self::from_words(words, filter.len())
+    }
+
+    /// Reads a bitmap of `len` rows where bit `i % 8` of byte `i / 8` is set if the `i`-th
+    /// row is kept, i.e., the layout of an Arrow validity bitmap.
+    pub fn from_bitmap(bitmap: &[u8], len: usize) -> PicachvResult<Self> {
+        picachv_ensure!(
+            bitmap.len() == len.div_ceil(8),
+            ComputeError: "The bitmap has {} bytes but {} rows need {} bytes", bitmap.len(), len, len.div_ceil(8),
+        );
+
+        let mut words = bitmap
+            .chunks(WORD_BITS / 8)
+            .map(|bytes| {
+                let mut buf = [0u8; WORD_BITS / 8];
+                buf[..bytes.len()].copy_from_slice(bytes);
+                u64::from_le_bytes(buf)
+            })
+            .collect::<Vec<_>>();
+        // The padding bits are not rows.
+        if len % WORD_BITS != 0 {
+            if let Some(last) = words.last_mut() {
+                *last &= (1u64 << (len % WORD_BITS)) - 1;
+            }
+        }
+
+        Ok(Self::from_words(words, len))
+    }
+
+    /// Reads the ascending indices of the kept rows among `len` rows, e.g., a DuckDB selection
+    /// vector.
+    pub fn from_indices(indices: &[u32], len: usize) -> PicachvResult<Self> {
+        picachv_ensure!(
+            indices.windows(2).all(|w| w[0] < w[1]),
+            ComputeError: "The selection vector must be strictly ascending",
+        );
+        picachv_ensure!(
+            indices.last().map_or(true, |&i| (i as usize) < len),
+            ComputeError: "The selection vector is out of bound: {} rows", len,
+        );
+
+        let mut words = vec![0u64; len.div_ceil(WORD_BITS)];
+        for &i in indices {
+            let i = i as usize;
+            words[i / WORD_BITS] |= 1 << (i % WORD_BITS);
+        }
+
+        Ok(Self::from_words(words, len))
+    }
+
+    /// Reads the filter of a transform for a dataframe of `len` rows.
+    ///
+    /// The boolean form takes precedence over the bitmap, which in turn takes precedence over
+    /// the selection vector. It is an error if none of them is set on a non-empty dataframe.
+    pub fn from_filter_info(info: &FilterInformation, len: usize) -> PicachvResult<Self> {
+        if !info.filter.is_empty() {
+            picachv_ensure!(
+                info.filter.len() == len,
+                ComputeError: "The length of the predicate does not match the dataframe: {} != {}", info.filter.len(), len,
+            );
+
+            Ok(Self::from_bools(&info.filter))
+        } else if !info.bitmap.is_empty() {
+            Self::from_bitmap(&info.bitmap, len)
+        } else {
+            // An empty repeated field is indistinguishable from a missing one, so dropping every
+            // row must be spelled out with the boolean form or the bitmap.
+            picachv_ensure!(
+                !info.selection.is_empty() || len == 0,
+                ComputeError: "The filter carries no predicate for a dataframe of {} rows", len,
+            );
+
+            Self::from_indices(&info.selection, len)
+        }
+    }
+
+    /// The number of rows before filtering.
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// The number of kept rows.
+    #[inline]
+    pub fn count(&self) -> usize {
+        *self.ranks.last().unwrap_or(&0)
+    }
+
+    /// Returns the kept rows in ascending order.
+    pub fn indices(&self) -> Vec<usize> {
+        THREAD_POOL.install(|| {
+            self.words
+                .par_iter()
+                .enumerate()
+                .flat_map_iter(|(w, &word)| {
+                    let mut bits = word;
+                    std::iter::from_fn(move || match bits {
+                        0 => None,
+                        _ => {
+                            let i = bits.trailing_zeros() as usize;
+                            bits &= bits - 1;
+                            Some(w * WORD_BITS + i)
+                        },
+                    })
+                })
+                .collect()
+        })
+    }
+
+    #[inline]
+    pub fn is_selected(&self, row: usize) -> bool {
+        self.words[row / WORD_BITS] & (1 << (row % WORD_BITS)) != 0
+    }
+
+    /// Returns the number of kept rows before `row`, which is the position of `row` after
+    /// filtering if it is kept. `row` may be [`Selection::len`].
+    #[inline]
+    pub fn rank(&self, row: usize) -> usize {
+        let (word, bit) = (row / WORD_BITS, row % WORD_BITS);
+        match bit {
+            0 => self.ranks[word],
+            _ => self.ranks[word] + (self.words[word] & ((1 << bit) - 1)).count_ones() as usize,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_selection_forms() {
+        let filter = (0..200).map(|i| i % 3 == 0).collect::<Vec<_>>();
+        let indices = (0..200u32).filter(|i| i % 3 == 0).collect::<Vec<_>>();
+        let mut bitmap = vec![0u8; 25];
+        for &i in indices.iter() {
+            bitmap[i as usize / 8] |= 1 << (i % 8);
+        }
+
+        let forms = [
+            Selection::from_bools(&filter),
+            Selection::from_bitmap(&bitmap, 200).unwrap(),
+            Selection::from_indices(&indices, 200).unwrap(),
+        ];
+        for sel in forms.iter() {
+            assert_eq!(sel.count(), indices.len());
+            assert_eq!(sel.rank(200), indices.len());
+            assert_eq!(
+                sel.indices(),
+                indices.iter().map(|&i| i as usize).collect::<Vec<_>>()
+            );
+            for (pos, &i) in indices.iter().enumerate() {
+                assert!(sel.is_selected(i as usize));
+                assert_eq!(sel.rank(i as usize), pos);
+            }
+        }
+
+        assert!(Selection::from_indices(&[3, 1], 200).is_err());
+        assert!(Selection::from_bitmap(&bitmap, 100).is_err());
+    }
+
+    #[test]
+    fn test_selection_from_filter_info() {
+        let info = FilterInformation {
+            selection: vec![1, 3],
+            ..Default::default()
+        };
+        let sel = Selection::from_filter_info(&info, 4).unwrap();
+        assert_eq!(sel.indices(), vec![1, 3]);
+
+        // Nothing set is not read as "keep nothing".
+        let info = FilterInformation::default();
+        assert!(Selection::from_filter_info(&info, 4).is_err());
+        assert!(Selection::from_filter_info(&info, 0).is_ok_and(|sel| sel.count() == 0));
+
+        let info = FilterInformation {
+            bitmap: vec![0],
+            ..Default::default()
+        };
+        assert!(Selection::from_filter_info(&info, 4).is_ok_and(|sel| sel.count() == 0));
+    }
+}
@@ -241,6 +241,11 @@ pub enum JoinType {
     Left = 1,
     Cross = 2,
     Outer = 3,
+    Right = 4,
+    /// Keeps the left rows that have a match; nothing of the right relation is kept.
+    Semi = 5,
+    /// Keeps the left rows that have no match; nothing of the right relation is kept.
+    Anti = 6,
 }
 impl JoinType {
     /// String value of the enum field names used in the ProtoBuf definition.
@@ -253,6 +258,9 @@ impl JoinType {
             JoinType::Left => "Left",
             JoinType::Cross => "Cross",
             JoinType::Outer => "Outer",
+            JoinType::Right => "Right",
+            JoinType::Semi => "Semi",
+            JoinType::Anti => "Anti",
         }
     }
     /// Creates an enum from field names used in the ProtoBuf definition.
@@ -262,6 +270,9 @@ impl JoinType {
             "Left" => Some(Self::Left),
             "Cross" => Some(Self::Cross),
             "Outer" => Some(Self::Outer),
+            "Right" => Some(Self::Right),
+            "Semi" => Some(Self::Semi),
+            "Anti" => Some(Self::Anti),
             _ => None,
         }
     }
@@ -666,6 +677,16 @@ pub struct FilterInformation {
     /// filter\[idx\] = 1 means the idx-th row is not dropped.
     #[prost(bool, repeated, tag = "1")]
     pub filter: ::prost::alloc::vec::Vec<bool>,
+    /// The same filter packed as a bitmap: bit (idx % 8) of byte (idx / 8) is
+    /// filter\[idx\], as in an Arrow validity bitmap. Used when `filter` is empty.
+    #[prost(bytes = "vec", tag = "2")]
+    pub bitmap: ::prost::alloc::vec::Vec<u8>,
+    /// The indices of the rows that are not dropped in ascending order, e.g., a
+    /// DuckDB selection vector. Used when `filter` and `bitmap` are both empty.
+    /// Since an empty field is the same as a missing one, a filter that drops
+    /// every row of a non-empty relation must be sent as `filter` or `bitmap`.
+    #[prost(uint32, repeated, tag = "3")]
+    pub selection: ::prost::alloc::vec::Vec<u32>,
 }
 /// This message is used to describe for each row in the joined
 /// relation, which rows in the left and right relations are used to join.
@@ -709,6 +730,17 @@ pub struct JoinInformation {
     /// Optional renaming information denoting the new names of the columns for the rhs side.
     #[prost(message, repeated, tag = "6")]
     pub renaming_info: ::prost::alloc::vec::Vec<RenamingInformation>,
+    /// The packed form of `row_join_info`: the i-th joined row consists of the
+    /// left_rows\[i\]-th row of the left relation and the right_rows\[i\]-th row of
+    /// the right relation. Used when `row_join_info` is empty.
+    #[prost(uint64, repeated, tag = "7")]
+    pub left_rows: ::prost::alloc::vec::Vec<u64>,
+    #[prost(uint64, repeated, tag = "8")]
+    pub right_rows: ::prost::alloc::vec::Vec<u64>,
+    /// For outer joins, the row index of the missing side of a null-extended row
+    /// is 2^64 - 1. Semi and anti joins only use `left_rows`.
+    #[prost(enumeration = "JoinType", tag = "9")]
+    pub join_type: i32,
 }
 #[allow(clippy::derive_partial_eq_without_eq)]
 #[derive(Clone, PartialEq, ::prost::Message)]
@@ -729,6 +761,9 @@ pub struct ReorderInformation {
     /// The permutation of rows in case reorder occurs.
     #[prost(uint64, repeated, tag = "1")]
     pub perm: ::prost::alloc::vec::Vec<u64>,
+    /// The number of rows kept after reordering (ORDER BY ... LIMIT).
+    #[prost(uint64, optional, tag = "2")]
+    pub limit: ::core::option::Option<u64>,
 }
 #[allow(clippy::derive_partial_eq_without_eq)]
 #[derive(Clone, PartialEq, ::prost::Message)]
@@ -3,8 +3,8 @@ use uuid::Uuid;
 
 use crate::transform_info::Information;
 use crate::{
-    FilterInformation, JoinInformation, RenamingInformation, RowJoinInformation, TransformInfo,
-    UnionInformation,
+    FilterInformation, JoinInformation, JoinType, RenamingInformation, RowJoinInformation,
+    TransformInfo, UnionInformation,
 };
 
 impl TransformInfo {
@@ -12,6 +12,17 @@ impl TransformInfo {
         Ok(Self {
             information: Some(Information::Filter(FilterInformation {
                 filter: pred.to_vec(),
+                ..Default::default()
+            })),
+        })
+    }
+
+    /// Constructs the filter information from a bitmap laid out as an Arrow validity bitmap.
+    pub fn from_filter_bitmap(bitmap: &[u8]) -> PicachvResult<Self> {
+        Ok(Self {
+            information: Some(Information::Filter(FilterInformation {
+                bitmap: bitmap.to_vec(),
+                ..Default::default()
             })),
         })
     }
@@ -43,6 +54,34 @@ impl TransformInfo {
                 right_columns,
                 row_join_info,
                 renaming_info,
+                ..Default::default()
+            })),
+        })
+    }
+
+    /// Constructs the join information with the joined rows given as packed index arrays.
+    #[allow(clippy::too_many_arguments)]
+    pub fn from_join_packed(
+        lhs_df_uuid: Uuid,
+        rhs_df_uuid: Uuid,
+        left_columns: Vec<u64>,
+        right_columns: Vec<u64>,
+        left_rows: Vec<u64>,
+        right_rows: Vec<u64>,
+        renaming_info: Vec<RenamingInformation>,
+        join_type: JoinType,
+    ) -> PicachvResult<Self> {
+        Ok(Self {
+            information: Some(Information::Join(JoinInformation {
+                lhs_df_uuid: lhs_df_uuid.to_bytes_le().to_vec(),
+                rhs_df_uuid: rhs_df_uuid.to_bytes_le().to_vec(),
+                left_columns,
+                right_columns,
+                left_rows,
+                right_rows,
+                renaming_info,
+                join_type: join_type as i32,
+                ..Default::default()
             })),
         })
     }
@@ -1,17 +1,24 @@
 use std::fmt;
 use std::path::Path;
 use std::sync::{Arc, LazyLock};
+use std::time::Duration;
 
 use ahash::{HashMap, HashMapExt};
-use picachv_core::dataframe::{apply_transform, PolicyGuardedDataFrame};
+use picachv_core::counters::{self, Counter};
+use picachv_core::dataframe::{apply_transform, filter_df, PolicyGuardedDataFrame};
 use picachv_core::expr::{AExpr, ColumnIdent};
+use picachv_core::io::scan::PolicyScan;
 use picachv_core::io::{BinIo, JsonIO};
+use picachv_core::join::JoinSession;
+use picachv_core::memory::{self, ContextMemoryStats};
 use picachv_core::plan::{early_projection, Plan};
-use picachv_core::profiler::PROFILER;
+use picachv_core::policy::PolicyLabel;
+use picachv_core::profiler::{profile, Phase, PicachvProfiler};
+use picachv_core::selection::Selection;
 use picachv_core::udf::Udf;
-use picachv_core::{get_new_uuid, record_batch_from_bytes, Arenas};
+use picachv_core::{get_new_uuid, record_batches_from_bytes, Arenas};
 use picachv_error::{PicachvError, PicachvResult};
-use picachv_message::{plan_argument, ContextOptions, ExprArgument, PlanArgument};
+use picachv_message::{plan_argument, ContextOptions, ExprArgument, JoinType, PlanArgument};
 use prost::Message;
 use spin::RwLock;
 use uuid::Uuid;
@@ -24,6 +31,12 @@ pub struct Context {
     arena: Arenas,
     /// Context options.
     pub(crate) options: Arc<RwLock<ContextOptions>>,
+    /// The opened policy scans.
+    scans: RwLock<HashMap<Uuid, Arc<PolicyScan>>>,
+    /// The joins whose build side has been pinned.
+    joins: RwLock<HashMap<Uuid, Arc<JoinSession>>>,
+    /// The spans taken while profiling is enabled.
+    profiler: Arc<PicachvProfiler>,
 }
 
 impl fmt::Debug for Context {
@@ -57,12 +70,54 @@ impl Context {
         self.options.read().enable_profiling
     }
 
+    /// Returns the profiler of this context.
+    #[inline]
+    pub fn profiler(&self) -> &PicachvProfiler {
+        &self.profiler
+    }
+
+    /// Summarizes the spans taken so far as JSON; see [`PicachvProfiler::summary`].
+    pub fn get_profile(&self) -> PicachvResult<String> {
+        Ok(self.profiler.summary())
+    }
+
+    /// Exports the spans taken so far in the Chrome trace event format.
+    pub fn get_profile_trace(&self) -> PicachvResult<String> {
+        Ok(self.profiler.chrome_trace())
+    }
+
+    pub fn reset_profile(&self) -> PicachvResult<()> {
+        self.profiler.reset();
+
+        Ok(())
+    }
+
+    /// Returns the memory used by the process along with the number of objects kept by this
+    /// context.
+    pub fn memory_stats(&self) -> PicachvResult<ContextMemoryStats> {
+        Ok(ContextMemoryStats {
+            process: memory::stats()?,
+            dataframes: self.arena.df_arena.read().len(),
+            expressions: self.arena.expr_arena.read().len(),
+        })
+    }
+
+    /// Records a span for `f` in the profiler of this context. The spans taken by the core
+    /// while `f` runs on this thread go to the same profiler.
+    #[inline]
+    fn profile<T, F: FnOnce() -> T>(&self, f: F, name: &'static str) -> T {
+        self.profiler.install(|| profile(f, name.into()))
+    }
+
     #[inline]
     pub fn new(id: Uuid) -> Self {
         Context {
             id,
             arena: Arenas::new(),
             options: Arc::new(RwLock::new(ContextOptions::default())),
+            scans: RwLock::new(HashMap::new()),
+            joins: RwLock::new(HashMap::new()),
+            profiler: Arc::new(PicachvProfiler::new()),
         }
     }
 
@@ -105,25 +160,262 @@ impl Context {
         self.register_policy_dataframe(df)
     }
 
+    /// Opens a persistent scan over the policy file so that its row groups can be read
+    /// without parsing the footer again.
+    ///
+    /// If `downgrade` is given, the scan is rejected before any row group is read when the
+    /// policy statistics show a policy of the projected columns that it cannot downgrade.
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn open_policy_scan<P: AsRef<Path> + fmt::Debug>(
+        &self,
+        path: P,
+        projection: &[usize],
+        downgrade: Option<&Arc<PolicyLabel>>,
+    ) -> PicachvResult<Uuid> {
+        let scan = PolicyScan::open(path, projection)?;
+        if let Some(by) = downgrade {
+            scan.check_downgrade(by)?;
+        }
+        let uuid = get_new_uuid();
+        self.scans.write().insert(uuid, Arc::new(scan));
+
+        Ok(uuid)
+    }
+
+    /// Reads a row group from an opened scan. This can be called concurrently on the same scan.
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn next_row_group(
+        &self,
+        scan_uuid: Uuid,
+        row_group: usize,
+        selection: Option<&[bool]>,
+    ) -> PicachvResult<Uuid> {
+        let scan =
+            self.scans
+                .read()
+                .get(&scan_uuid)
+                .cloned()
+                .ok_or(PicachvError::InvalidOperation(
+                    format!("The scan {scan_uuid} does not exist.").into(),
+                ))?;
+
+        let df = if self.options.read().enable_profiling {
+            self.profile(
+                || scan.read_row_group(row_group, selection),
+                "read_row_group",
+            )
+        } else {
+            scan.read_row_group(row_group, selection)
+        }?;
+
+        self.register_policy_dataframe(df)
+    }
+
+    /// Reads the logical rows `start_row..start_row + len` from an opened scan, regardless of
+    /// how the policy file is split into row groups.
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn read_policy_rows(
+        &self,
+        scan_uuid: Uuid,
+        start_row: usize,
+        len: usize,
+        selection: Option<&[bool]>,
+    ) -> PicachvResult<Uuid> {
+        let scan =
+            self.scans
+                .read()
+                .get(&scan_uuid)
+                .cloned()
+                .ok_or(PicachvError::InvalidOperation(
+                    format!("The scan {scan_uuid} does not exist.").into(),
+                ))?;
+
+        let df = if self.options.read().enable_profiling {
+            self.profile(
+                || scan.read_rows(start_row, len, selection),
+                "read_policy_rows",
+            )
+        } else {
+            scan.read_rows(start_row, len, selection)
+        }?;
+
+        self.register_policy_dataframe(df)
+    }
+
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn close_policy_scan(&self, scan_uuid: Uuid) -> PicachvResult<()> {
+        match self.scans.write().remove(&scan_uuid) {
+            Some(_) => Ok(()),
+            None => Err(PicachvError::InvalidOperation(
+                format!("The scan {scan_uuid} does not exist.").into(),
+            )),
+        }
+    }
+
+    /// Reads the policy file. If `downgrade` is given, this fails before any row group is
+    /// decoded when the policy statistics show a policy that it cannot downgrade.
     #[cfg_attr(feature = "trace", tracing::instrument)]
     pub fn register_policy_dataframe_parquet<P: AsRef<Path> + fmt::Debug>(
         &self,
         path: P,
         projection: &[usize],
         selection: Option<&[bool]>,
+        downgrade: Option<&Arc<PolicyLabel>>,
     ) -> PicachvResult<Uuid> {
+        let read = || match downgrade {
+            Some(by) => PolicyGuardedDataFrame::from_parquet_checked(
+                path.as_ref(),
+                projection,
+                selection,
+                by,
+            ),
+            None => PolicyGuardedDataFrame::from_parquet(path.as_ref(), projection, selection),
+        };
         let df = if self.options.read().enable_profiling {
-            PROFILER.profile(
-                || PolicyGuardedDataFrame::from_parquet(path.as_ref(), projection, selection),
-                "read_parquet".into(),
+            self.profile(read, "read_parquet")
+        } else {
+            read()
+        }?;
+
+        self.register_policy_dataframe(df)
+    }
+
+    /// Joins two dataframes where the `i`-th joined row consists of the `left_idx[i]`-th row
+    /// of `lhs` and the `right_idx[i]`-th row of `rhs`. See
+    /// [`PolicyGuardedDataFrame::join_by_idx`] for outer, semi and anti joins.
+    #[allow(clippy::too_many_arguments)]
+    #[cfg_attr(feature = "trace", tracing::instrument(skip(left_idx, right_idx)))]
+    pub fn join_by_idx(
+        &self,
+        lhs_uuid: Uuid,
+        rhs_uuid: Uuid,
+        left_columns: &[usize],
+        right_columns: &[usize],
+        left_idx: &[usize],
+        right_idx: &[usize],
+        join_type: JoinType,
+    ) -> PicachvResult<Uuid> {
+        let (lhs, rhs) = {
+            let df_arena = self.arena.df_arena.read();
+            (
+                df_arena.get(&lhs_uuid)?.clone(),
+                df_arena.get(&rhs_uuid)?.clone(),
+            )
+        };
+
+        let options = self.options.read().clone();
+        let f = || {
+            PolicyGuardedDataFrame::join_by_idx(
+                &lhs,
+                &rhs,
+                left_columns,
+                right_columns,
+                left_idx,
+                right_idx,
+                join_type,
+                &options,
+            )
+        };
+        let df = if options.enable_profiling {
+            self.profile(f, "join")
+        } else {
+            f()
+        }?;
+
+        self.register_policy_dataframe(df)
+    }
+
+    /// Pins the `left_columns` of the build side `lhs_uuid` for a join whose probe side is
+    /// streamed with [`Context::join_probe`].
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn begin_join(
+        &self,
+        lhs_uuid: Uuid,
+        left_columns: &[usize],
+        right_columns: &[usize],
+        join_type: JoinType,
+    ) -> PicachvResult<Uuid> {
+        let lhs = self.arena.df_arena.read().get(&lhs_uuid)?.clone();
+        let session = JoinSession::new(&lhs, left_columns, right_columns, join_type)?;
+        let uuid = get_new_uuid();
+        self.joins.write().insert(uuid, Arc::new(session));
+
+        Ok(uuid)
+    }
+
+    /// Joins a probe vector with the build side of the session. This can be called
+    /// concurrently on the same session.
+    #[cfg_attr(feature = "trace", tracing::instrument(skip(left_idx, right_idx)))]
+    pub fn join_probe(
+        &self,
+        session_uuid: Uuid,
+        rhs_uuid: Uuid,
+        left_idx: &[usize],
+        right_idx: &[usize],
+    ) -> PicachvResult<Uuid> {
+        let session =
+            self.joins
+                .read()
+                .get(&session_uuid)
+                .cloned()
+                .ok_or(PicachvError::InvalidOperation(
+                    format!("The join session {session_uuid} does not exist.").into(),
+                ))?;
+        let rhs = self.arena.df_arena.read().get(&rhs_uuid)?.clone();
+
+        let options = self.options.read().clone();
+        let df = if options.enable_profiling {
+            self.profile(
+                || session.probe(&rhs, left_idx, right_idx, &options),
+                "join_probe",
             )
         } else {
-            PolicyGuardedDataFrame::from_parquet(path.as_ref(), projection, selection)
+            session.probe(&rhs, left_idx, right_idx, &options)
         }?;
 
         self.register_policy_dataframe(df)
     }
 
+    #[cfg_attr(feature = "trace", tracing::instrument)]
+    pub fn end_join(&self, session_uuid: Uuid) -> PicachvResult<()> {
+        match self.joins.write().remove(&session_uuid) {
+            Some(_) => Ok(()),
+            None => Err(PicachvError::InvalidOperation(
+                format!("The join session {session_uuid} does not exist.").into(),
+            )),
+        }
+    }
+
+    /// Filters a dataframe with a bitmap laid out as an Arrow validity bitmap.
+    #[cfg_attr(feature = "trace", tracing::instrument(skip(bitmap)))]
+    pub fn filter_by_bitmap(&self, df_uuid: Uuid, bitmap: &[u8]) -> PicachvResult<Uuid> {
+        self.filter_with(df_uuid, |num_rows| Selection::from_bitmap(bitmap, num_rows))
+    }
+
+    /// Filters a dataframe with the ascending indices of the rows to keep.
+    #[cfg_attr(feature = "trace", tracing::instrument(skip(selection)))]
+    pub fn filter_by_selection(&self, df_uuid: Uuid, selection: &[u32]) -> PicachvResult<Uuid> {
+        self.filter_with(df_uuid, |num_rows| {
+            Selection::from_indices(selection, num_rows)
+        })
+    }
+
+    fn filter_with<F>(&self, df_uuid: Uuid, selection: F) -> PicachvResult<Uuid>
+    where
+        F: FnOnce(usize) -> PicachvResult<Selection>,
+    {
+        let f = || {
+            let num_rows = self.arena.df_arena.read().get(&df_uuid)?.shape().0;
+            filter_df(&self.arena.df_arena, df_uuid, &selection(num_rows)?)
+        };
+
+        if self.options.read().enable_profiling {
+            self.profile(f, "filter")
+        } else {
+            f()
+        }
+    }
+
     #[inline]
     #[cfg_attr(feature = "trace", tracing::instrument)]
     pub fn early_projection(&self, df_uuid: Uuid, project_list: &[usize]) -> PicachvResult<Uuid> {
@@ -170,7 +462,7 @@ impl Context {
                         ))?;
 
                     return if self.options.read().enable_profiling {
-                        PROFILER.profile(
+                        self.profile(
                             || {
                                 apply_transform(
                                     &self.arena.df_arena,
@@ -179,7 +471,7 @@ impl Context {
                                     &self.options.read().clone(),
                                 )
                             },
-                            "apply_transform".into(),
+                            "apply_transform",
                         )
                     } else {
                         apply_transform(
@@ -193,7 +485,7 @@ impl Context {
 
                 let plan = Plan::from_args(&self.arena, arg)?;
                 let df_uuid = if self.options.read().enable_profiling {
-                    PROFILER.profile(
+                    self.profile(
                         || {
                             plan.check_executor(
                                 &self.arena,
@@ -202,7 +494,7 @@ impl Context {
                                 &self.options.read().clone(),
                             )
                         },
-                        "check_executor".into(),
+                        "check_executor",
                     )
                 } else {
                     plan.check_executor(
@@ -215,7 +507,7 @@ impl Context {
 
                 if let Some(ti) = plan_arg.transform_info {
                     if self.options.read().enable_profiling {
-                        PROFILER.profile(
+                        self.profile(
                             || {
                                 apply_transform(
                                     &self.arena.df_arena,
@@ -224,7 +516,7 @@ impl Context {
                                     &self.options.read().clone(),
                                 )
                             },
-                            "apply_transform".into(),
+                            "apply_transform",
                         )
                     } else {
                         apply_transform(
@@ -244,12 +536,12 @@ impl Context {
 
     #[cfg_attr(feature = "trace", tracing::instrument)]
     pub fn create_slice(&self, df_uuid: Uuid, sel_vec: &[u32]) -> PicachvResult<Uuid> {
-        let mut df_arena = self.arena.df_arena.write();
-        let df = df_arena.get(&df_uuid)?;
-        let sel_vec = sel_vec.into_iter().map(|e| *e as usize).collect::<Vec<_>>();
+        // The slice is a view over `df`, so the arena is only locked to look up `df` and to
+        // insert the view.
+        let df = self.arena.df_arena.read().get(&df_uuid)?.clone();
+        let new_df = df.slice_view(sel_vec)?;
 
-        let new_df = df.new_from_slice(&sel_vec)?;
-        df_arena.insert(new_df)
+        self.arena.df_arena.write().insert(new_df)
     }
 
     #[cfg_attr(feature = "trace", tracing::instrument)]
@@ -258,29 +550,19 @@ impl Context {
 
         let df = df_arena.get(&df_uuid)?;
 
-        if self.profiling_enabled() {
-            let dump = PROFILER.dump();
-            let raw = PROFILER.dump_raw();
-            std::fs::write(
-                "./profile.log",
-                format!("Aggregated:\n{:#?}\nRaw:\n{:#?}", dump, raw),
-            )
-            .map_err(|e| {
-                PicachvError::InvalidOperation(format!("Failed to write profile: {e}").into())
-            })?;
+        if self.options.read().enable_profiling {
+            self.profile(|| df.finalize(), "finalize")
+        } else {
+            df.finalize()
         }
-
-        df.finalize()
     }
 
     #[cfg_attr(feature = "trace", tracing::instrument)]
     pub fn select_group(&self, df_uuid: Uuid, hashes: &[u64]) -> PicachvResult<Uuid> {
-        let mut df_arena = self.arena.df_arena.write();
-        let df = df_arena.get(&df_uuid)?;
+        let df = self.arena.df_arena.read().get(&df_uuid)?.clone();
+        let new_df = df.select_group(hashes)?;
 
-        let new_df = df.select_group(hashes);
-        println!("new_df.is_err() = {}", new_df.is_err());
-        df_arena.insert(new_df?)
+        self.arena.df_arena.write().insert(new_df)
     }
 
     /// Reify an abstract value of the expression with the given values encoded in the bytes.
@@ -288,6 +570,8 @@ impl Context {
     /// The input values are just a serialized Arrow IPC data represented as record batches.
     // #[cfg_attr(feature = "trace", tracing::instrument)]
     pub fn reify_expression(&self, expr_uuid: Uuid, value: &[u8]) -> PicachvResult<()> {
+        counters::add(Counter::BytesReified, value.len() as u64);
+
         let expr_arena = self.arena.expr_arena.read();
 
         let expr = unsafe {
@@ -319,15 +603,15 @@ impl Context {
         } else {
             let f = || {
                 // Convert values into the Arrow record batch.
-                record_batch_from_bytes(value)
+                record_batches_from_bytes(value)
             };
             let rb = if self.options.read().enable_profiling {
-                PROFILER.profile(f, "reify_expression".into())
+                self.profile(f, "reify_expression")
             } else {
                 f()
             }?;
 
-            expr.reify(rb)?;
+            expr.reify(&rb)?;
         }
 
         Ok(())
@@ -392,6 +676,30 @@ impl PicachvMonitor {
         ctx.enable_profiling(enable)
     }
 
+    /// Returns the time spent in each phase by all the contexts; see
+    /// [`PicachvProfiler::phases`].
+    pub fn get_profile_phases(&self) -> Vec<(Phase, Duration)> {
+        let mut phases = Phase::ALL
+            .iter()
+            .map(|&phase| (phase, Duration::ZERO))
+            .collect::<Vec<_>>();
+
+        for ctx in self.ctx.values() {
+            for (phase, d) in ctx.profiler.phases() {
+                phases[phase as usize].1 += d;
+            }
+        }
+
+        phases
+    }
+
+    /// Drops the spans recorded by the profilers of all the contexts.
+    pub fn reset_profiles(&self) {
+        for ctx in self.ctx.values() {
+            ctx.profiler.reset();
+        }
+    }
+
     pub fn get_ctx(&self) -> &HashMap<Uuid, Context> {
         &self.ctx
     }
@@ -9,7 +9,8 @@ use clap::{Parser, ValueEnum};
 use indicatif::{ProgressBar, ProgressStyle};
 use parquet::arrow::arrow_reader::ParquetRecordBatchReaderBuilder;
 use picachv_core::constants::GroupByMethod;
-use picachv_core::dataframe::{PolicyGuardedColumn, PolicyGuardedDataFrame};
+use picachv_core::dataframe::{has_policy, PolicyGuardedColumn, PolicyGuardedDataFrame};
+use picachv_core::io::parquet::{PolicyCompression, PolicyParquetOptions};
 use picachv_core::io::{BinIo, JsonIO};
 use picachv_core::policy::types::AnyValue;
 use picachv_core::policy::{AggType, BinaryTransformType, Policy, PolicyLabel, TransformType};
@@ -63,6 +64,14 @@ impl Display for Format {
     }
 }
 
+#[derive(Clone, Debug, PartialEq, Eq, PartialOrd, Ord, ValueEnum)]
+pub enum Codec {
+    None,
+    Snappy,
+    Lz4,
+    Zstd,
+}
+
 #[derive(Parser, Debug)]
 pub struct Args {
     #[clap(
@@ -97,6 +106,43 @@ pub struct Args {
 
     #[clap(long, default_value = "A")]
     policy_type: String,
+
+    #[clap(
+        long,
+        default_value = "none",
+        help = "The compression codec of the policy file (parquet only)"
+    )]
+    compression: Codec,
+    #[clap(long, default_value = "1", help = "The compression level for zstd")]
+    compression_level: i32,
+    #[clap(
+        long,
+        help = "The fraction of cells that carry a non-clean policy. Ignored when `is_micro` is set."
+    )]
+    density: Option<f64>,
+    #[clap(
+        long,
+        default_value = "2048",
+        help = "The number of rows in a row group of the policy file (parquet only)"
+    )]
+    row_group_size: usize,
+}
+
+impl Args {
+    fn parquet_options(&self) -> PolicyParquetOptions {
+        let compression = match self.compression {
+            Codec::None => PolicyCompression::None,
+            Codec::Snappy => PolicyCompression::Snappy,
+            Codec::Lz4 => PolicyCompression::Lz4,
+            Codec::Zstd => PolicyCompression::Zstd(self.compression_level),
+        };
+
+        PolicyParquetOptions {
+            compression,
+            row_group_size: self.row_group_size,
+            ..Default::default()
+        }
+    }
 }
 
 /// A simple generator that produces dummy policies for testing.
@@ -125,7 +171,9 @@ impl PolicyGenerator {
                 match self.args.format {
                     Format::Json => df.to_json(&output_path)?,
                     Format::Bin => df.to_bytes(&output_path)?,
-                    Format::Parquet => df.to_parquet(&output_path)?,
+                    Format::Parquet => {
+                        df.to_parquet_with_options(&output_path, &self.args.parquet_options())?
+                    },
                 }
 
                 Ok(())
@@ -157,7 +205,9 @@ impl PolicyGenerator {
                     match self.args.format {
                         Format::Json => df.to_json(&output_path)?,
                         Format::Bin => df.to_bytes(&output_path)?,
-                        Format::Parquet => df.to_parquet(&output_path)?,
+                        Format::Parquet => {
+                            df.to_parquet_with_options(&output_path, &self.args.parquet_options())?
+                        },
                     }
                 }
 
@@ -187,7 +237,7 @@ impl PolicyGenerator {
             let pb = ProgressBar::new(row_num as _);
             pb.set_style(ProgressStyle::with_template("{spinner:.green} [{elapsed_precise}] [{wide_bar:.cyan/blue}] {bytes}/{total_bytes} ({bytes_per_sec}, {eta})").unwrap().progress_chars("#>-"));
 
-            for _ in 0..row_num {
+            for i in 0..row_num as usize {
                 let p = if self.args.is_micro {
                     if col.name() == "l_discount" {
                         match self.args.policy_type.as_str() {
@@ -201,7 +251,10 @@ impl PolicyGenerator {
                         Policy::PolicyClean
                     }
                 } else {
-                    Policy::PolicyClean
+                    match self.args.density {
+                        Some(density) if has_policy(i, density) => (*POLICY_B).clone(),
+                        _ => Policy::PolicyClean,
+                    }
                 };
 
                 let p = Arc::new(p);